@@ -0,0 +1,23 @@
+# Included by the kbuild part of the modules' Makefiles, with PAK_COMMON_DIR
+# pointing to this directory.
+
+# PR_DEBUG() sites go through dynamic debug even on kernels only built with
+# its core, see utils.h. 'make DEBUG=1' turns them all on from the start, or
+# builds them in at all without dynamic debug. The same goes with
+# PAK_COMMON=1, where enabled sites log to pak-common.ko's binary log.
+ccflags-y += -DDYNAMIC_DEBUG_MODULE
+ifneq ($(DEBUG),)
+	ccflags-y += -DDEBUG
+endif
+
+include $(PAK_COMMON_DIR)/profile.mk
+
+# 'make PAK_COMMON=1' builds a module against pak-common.ko, which has to be
+# built before, for its Module.symvers, and loaded before the module is. Left
+# unset, modules don't depend on it at all: pak-common.h still builds, with its
+# stats as empty inline functions.
+ccflags-y += -I$(PAK_COMMON_DIR)
+ifneq ($(PAK_COMMON),)
+	ccflags-y += -DPAK_COMMON
+	KBUILD_EXTRA_SYMBOLS += $(abspath $(PAK_COMMON_DIR))/Module.symvers
+endif
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2017 Bruno E. O. Meneguele <bmeneguele@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ */
+
+/*
+ * Facilities shared by the modules of this repo, provided by pak-common.ko.
+ * Modules only use them when built with 'make PAK_COMMON=1', see common.mk.
+ *
+ * Binary log: PAK_LOG() doesn't format anything nor go through the console.
+ * It stores the call site, a timestamp and the arguments, packed in binary as
+ * vbin_printf() does, in a ring of the running CPU. Messages are formatted only
+ * when read from /sys/kernel/debug/playing-around/log. Each call site is
+ * registered the first time it runs, and listed in the log_sites file next to
+ * it. PAK_LOG() has no switch of its own: in modules built with PAK_COMMON,
+ * PR_DEBUG() calls it behind a dynamic debug site, off until turned on and a
+ * NOP meanwhile, see utils.h.
+ *
+ * Arguments are packed by value, strings included, but whatever a %p extension
+ * points to is only dereferenced at read time: it must still be there.
+ *
+ * Statistics: a module creates its group, a directory named after it under
+ * /sys/kernel/debug/playing-around/, then the stats of the group, a file each:
+ *
+ *  - counters, only going up: events, bytes;
+ *  - gauges, going up and down: the size of a list, items in flight;
+ *  - log2 histograms: latencies in ns, sizes, 32 buckets, values of 2^32 and
+ *    up all landing in the last one.
+ *
+ * Each stat is a per-CPU variable, updated with a this_cpu operation: no lock,
+ * no atomic instruction, no shared cache line, whatever the context. Reads sum
+ * all CPUs, without stopping the updaters. Writing to a counter or histogram
+ * file zeroes it.
+ *
+ * Stats are optional: a module whose stats couldn't be created keeps working
+ * and updating a NULL stat does nothing. Built without PAK_COMMON, all of this
+ * turns into empty inline functions.
+ *
+ * The log2 histogram helpers, pak_hist_*(), are plain inline functions, there
+ * in both builds: modules keeping histograms of their own, in their results or
+ * per-CPU stats, bucket and read them the same way.
+ */
+
+#ifndef __PAK_COMMON_H
+#define __PAK_COMMON_H
+
+#include <linux/types.h>
+#include <linux/list.h>
+#include <linux/compiler.h>
+#include <linux/log2.h>
+#include <linux/minmax.h>
+#include <linux/seq_file.h>
+
+#define PAK_LOG_SITE_REGISTERED 0x1
+
+struct pak_log_site {
+	const char *modname;
+	const char *func;
+	const char *fmt;
+	unsigned int line;
+	unsigned long flags;
+	struct list_head list;	/* in the registered sites */
+};
+
+#define DEFINE_PAK_LOG_SITE(name, _fmt)				\
+	static struct pak_log_site name = {			\
+		.modname = KBUILD_MODNAME,			\
+		.func = __func__,				\
+		.fmt = _fmt,					\
+		.line = __LINE__,				\
+	}
+
+__printf(2, 3) void pak_log(struct pak_log_site *site, const char *fmt, ...);
+
+#define PAK_LOG(fmt, ...)						\
+	do {								\
+		DEFINE_PAK_LOG_SITE(__pak_site, fmt);			\
+		pak_log(&__pak_site, fmt, ##__VA_ARGS__);		\
+	} while (0)
+
+enum pak_stat_type {
+	PAK_STAT_COUNTER,
+	PAK_STAT_GAUGE,
+	PAK_STAT_HIST,
+};
+
+#define PAK_STAT_HIST_BUCKETS 32
+
+struct pak_stat_hist {
+	unsigned long buckets[PAK_STAT_HIST_BUCKETS];
+	u64 sum;
+};
+
+/* Bucket i of a log2 histogram of 'nr' buckets holds the values below
+ * 2^(i + 1), the last one everything above */
+static inline unsigned int pak_hist_bucket(u64 val, unsigned int nr)
+{
+	return min_t(unsigned int, ilog2(val | 1), nr - 1);
+}
+
+/* Upper bound of the bucket where the percentile 'pm' (per mille) falls, 0
+ * for an empty histogram */
+static inline u64 pak_hist_percentile(const unsigned long *buckets,
+				      unsigned int nr, unsigned int pm)
+{
+	unsigned long total = 0, acc = 0;
+	unsigned int i;
+
+	for (i = 0; i < nr; i++)
+		total += buckets[i];
+	if (!total)
+		return 0;
+
+	for (i = 0; i < nr - 1; i++) {
+		acc += buckets[i];
+		if (acc * 1000 >= total * pm)
+			break;
+	}
+	return 2ULL << i;
+}
+
+/* p50, p99 and p999, then the non-empty buckets, a line each */
+static inline void pak_hist_show(struct seq_file *m,
+				 const unsigned long *buckets, unsigned int nr)
+{
+	unsigned int i;
+
+	seq_printf(m, "p50 <%llu p99 <%llu p999 <%llu\n",
+		   pak_hist_percentile(buckets, nr, 500),
+		   pak_hist_percentile(buckets, nr, 990),
+		   pak_hist_percentile(buckets, nr, 999));
+	for (i = 0; i < nr; i++)
+		if (buckets[i])
+			seq_printf(m, "<%12llu: %lu\n", 2ULL << i, buckets[i]);
+}
+
+struct pak_stats;
+
+/* Only 'pcpu' is touched by updates, the rest belongs to pak-common.ko */
+struct pak_stat {
+	void __percpu *pcpu;	/* long, or struct pak_stat_hist */
+	enum pak_stat_type type;
+	const char *name;
+	struct list_head list;	/* in its group */
+};
+
+#if defined(PAK_COMMON) || defined(PAK_COMMON_MODULE)
+#include <linux/percpu.h>
+
+struct pak_stats *pak_stats_create(const char *name);
+void pak_stats_destroy(struct pak_stats *stats);
+struct pak_stat *pak_stat_create(struct pak_stats *stats, const char *name,
+				 enum pak_stat_type type);
+
+static inline void pak_stat_add(struct pak_stat *stat, long n)
+{
+	if (stat)
+		this_cpu_add(*(long __percpu *)stat->pcpu, n);
+}
+
+static inline void pak_stat_record(struct pak_stat *stat, u64 val)
+{
+	struct pak_stat_hist __percpu *hist;
+
+	if (!stat)
+		return;
+	hist = stat->pcpu;
+	this_cpu_inc(hist->buckets[pak_hist_bucket(val,
+						   PAK_STAT_HIST_BUCKETS)]);
+	this_cpu_add(hist->sum, val);
+}
+#else
+static inline struct pak_stats *pak_stats_create(const char *name)
+{
+	return NULL;
+}
+
+static inline void pak_stats_destroy(struct pak_stats *stats)
+{
+}
+
+static inline struct pak_stat *pak_stat_create(struct pak_stats *stats,
+					       const char *name,
+					       enum pak_stat_type type)
+{
+	return NULL;
+}
+
+static inline void pak_stat_add(struct pak_stat *stat, long n)
+{
+}
+
+static inline void pak_stat_record(struct pak_stat *stat, u64 val)
+{
+}
+#endif
+
+#define pak_stat_inc(stat) pak_stat_add(stat, 1)
+#define pak_stat_dec(stat) pak_stat_add(stat, -1)
+
+#endif /* __PAK_COMMON_H */
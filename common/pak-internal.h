@@ -0,0 +1,21 @@
+/*
+ * Copyright (c) 2017 Bruno E. O. Meneguele <bmeneguele@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ */
+
+/* Between the parts of pak-common.ko only */
+
+#ifndef __PAK_INTERNAL_H
+#define __PAK_INTERNAL_H
+
+#include <linux/debugfs.h>
+
+int pak_log_init(struct dentry *root);
+void pak_log_exit(void);
+
+void pak_stats_init(struct dentry *root);
+
+#endif /* __PAK_INTERNAL_H */
@@ -0,0 +1,473 @@
+/*
+ * Copyright (c) 2017 Bruno E. O. Meneguele <bmeneguele@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ */
+
+/*
+ * Binary log behind PAK_LOG(), see pak-common.h for its interface.
+ *
+ * Each CPU has a ring of fixed size records, written with local interrupts
+ * disabled: the only writer of a ring is its CPU, thus no lock is taken, and
+ * nothing is formatted nor printed to the console at log time. Rings are
+ * vmalloc'ed, they're far too big for the per-CPU allocator. A full ring drops
+ * the new records, counting them as lost: readers see what led to a problem
+ * rather than what followed it.
+ *
+ * Readers merge the rings in time order and format the records then, with the
+ * format string of their call site. Records stay until the log file is
+ * written to. A module going away takes its format strings with it, thus its
+ * sites are unregistered and its records dropped before that.
+ *
+ * Sites have no switch of their own: PR_DEBUG() only calls in here once its
+ * dynamic debug site is on, see utils.h.
+ *
+ * Files under /sys/kernel/debug/playing-around/:
+ *  - log: read to format the records, write to clear them.
+ *  - log_sites: read for the sites that logged so far.
+ *  - log_bench: write to measure the cost of a log call, read for the results.
+ *    It clears the log.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/sched/clock.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/hardirq.h>
+
+#include "pak-common.h"
+#include "pak-internal.h"
+#include "utils.h"
+
+/* Records per CPU ring, a power of two */
+#define PAK_LOG_SLOTS 1024
+/* Arguments packed by vbin_printf(), in 32 bits words: 128 B records */
+#define PAK_LOG_ARGS_WORDS 28
+/* Longest message formatted back */
+#define PAK_LOG_MSG_SIZE 256
+
+static unsigned int bench_calls = 100000;
+module_param(bench_calls, uint, 0644);
+MODULE_PARM_DESC(bench_calls, "Log calls per binary log benchmark variant "
+		 "(default: 100000)");
+
+static unsigned int bench_printk_calls = 1000;
+module_param(bench_printk_calls, uint, 0644);
+MODULE_PARM_DESC(bench_printk_calls, "printk() calls per benchmark variant, "
+		 "they do land in the kernel log (default: 1000)");
+
+struct pak_log_rec {
+	u64 ts;			/* local_clock() */
+	struct pak_log_site *site;	/* NULL once its module is gone */
+	u32 args[PAK_LOG_ARGS_WORDS];
+};
+
+/* 'head' only written by the ring's CPU, 'tail' only by the readers */
+struct pak_log_ring {
+	unsigned int head ____cacheline_aligned;
+	unsigned int tail ____cacheline_aligned;
+	unsigned long lost;
+	struct pak_log_rec recs[PAK_LOG_SLOTS] ____cacheline_aligned;
+};
+
+/* Indexed by CPU */
+static struct pak_log_ring **pak_log_rings;
+
+/* Sites register from any context, even hard IRQ */
+static LIST_HEAD(pak_log_sites);
+static DEFINE_RAW_SPINLOCK(pak_log_sites_lock);
+
+/* Readers, clearing and module removal */
+static DEFINE_MUTEX(pak_log_lock);
+static char pak_log_msg[PAK_LOG_MSG_SIZE];
+
+static struct {
+	bool valid;
+	u64 log_ns;
+	u64 printk_debug_ns;
+	u64 printk_notice_ns;
+} pak_log_bench_res;
+
+static void pak_log_register(struct pak_log_site *site)
+{
+	unsigned long irqflags;
+
+	raw_spin_lock_irqsave(&pak_log_sites_lock, irqflags);
+	if (!(site->flags & PAK_LOG_SITE_REGISTERED)) {
+		list_add_tail(&site->list, &pak_log_sites);
+		WRITE_ONCE(site->flags, PAK_LOG_SITE_REGISTERED);
+	}
+	raw_spin_unlock_irqrestore(&pak_log_sites_lock, irqflags);
+}
+
+void pak_log(struct pak_log_site *site, const char *fmt, ...)
+{
+	struct pak_log_ring *ring;
+	struct pak_log_rec *rec;
+	unsigned long irqflags;
+	unsigned int head;
+	va_list args;
+
+	/* An NMI could land in the middle of a record of its CPU, or of a
+	 * site registration */
+	if (in_nmi())
+		return;
+
+	if (unlikely(!(READ_ONCE(site->flags) & PAK_LOG_SITE_REGISTERED)))
+		pak_log_register(site);
+
+	local_irq_save(irqflags);
+	ring = pak_log_rings[smp_processor_id()];
+	head = ring->head;
+	if (head - smp_load_acquire(&ring->tail) >= PAK_LOG_SLOTS) {
+		ring->lost++;
+		goto out;
+	}
+
+	rec = &ring->recs[head & (PAK_LOG_SLOTS - 1)];
+	rec->ts = local_clock();
+	rec->site = site;
+	va_start(args, fmt);
+#ifdef CONFIG_BINARY_PRINTF
+	vbin_printf(rec->args, PAK_LOG_ARGS_WORDS, fmt, args);
+#else
+	/* No binary printf without tracing, format right away */
+	vsnprintf((char *)rec->args, sizeof(rec->args), fmt, args);
+#endif
+	va_end(args);
+	/* Publish the record before the new head */
+	smp_store_release(&ring->head, head + 1);
+out:
+	local_irq_restore(irqflags);
+}
+EXPORT_SYMBOL_GPL(pak_log);
+
+/* Called with pak_log_lock held */
+static void pak_log_clear(void)
+{
+	struct pak_log_ring *ring;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		ring = pak_log_rings[cpu];
+		smp_store_release(&ring->tail, smp_load_acquire(&ring->head));
+		WRITE_ONCE(ring->lost, 0);
+	}
+}
+
+static void pak_log_show_rec(struct seq_file *m, struct pak_log_rec *rec,
+			     int cpu)
+{
+	struct pak_log_site *site = rec->site;
+	u32 rem;
+	u64 sec;
+
+#ifdef CONFIG_BINARY_PRINTF
+	bstr_printf(pak_log_msg, sizeof(pak_log_msg), site->fmt, rec->args);
+#else
+	strscpy(pak_log_msg, (char *)rec->args, sizeof(pak_log_msg));
+#endif
+	sec = div_u64_rem(rec->ts, NSEC_PER_SEC, &rem);
+	seq_printf(m, "[%5llu.%06u] %3d [%s] %s:%u:: %s", sec,
+		   rem / NSEC_PER_USEC, cpu, site->modname, site->func,
+		   site->line, pak_log_msg);
+}
+
+/*
+ * Records aren't consumed by reading them, thus seq_file can run this again
+ * whenever its buffer turns out to be too small.
+ */
+static int pak_log_show(struct seq_file *m, void *v)
+{
+	struct pak_log_ring *ring;
+	struct pak_log_rec *rec, *oldest;
+	unsigned int *pos, *end;
+	unsigned long lost = 0;
+	int cpu, oldest_cpu;
+
+	pos = kcalloc(2 * nr_cpu_ids, sizeof(*pos), GFP_KERNEL);
+	if (!pos)
+		return -ENOMEM;
+	end = pos + nr_cpu_ids;
+
+	mutex_lock(&pak_log_lock);
+	for_each_possible_cpu(cpu) {
+		ring = pak_log_rings[cpu];
+		pos[cpu] = READ_ONCE(ring->tail);
+		end[cpu] = smp_load_acquire(&ring->head);
+		lost += READ_ONCE(ring->lost);
+	}
+
+	for (;;) {
+		oldest = NULL;
+		oldest_cpu = -1;
+		for_each_possible_cpu(cpu) {
+			if (pos[cpu] == end[cpu])
+				continue;
+
+			ring = pak_log_rings[cpu];
+			rec = &ring->recs[pos[cpu] & (PAK_LOG_SLOTS - 1)];
+			if (!oldest || rec->ts < oldest->ts) {
+				oldest = rec;
+				oldest_cpu = cpu;
+			}
+		}
+		if (!oldest)
+			break;
+
+		pos[oldest_cpu]++;
+		if (oldest->site)
+			pak_log_show_rec(m, oldest, oldest_cpu);
+	}
+
+	seq_printf(m, "# lost: %lu\n", lost);
+	mutex_unlock(&pak_log_lock);
+
+	kfree(pos);
+	return 0;
+}
+
+static ssize_t pak_log_write(struct file *file, const char __user *ubuf,
+			     size_t count, loff_t *ppos)
+{
+	mutex_lock(&pak_log_lock);
+	pak_log_clear();
+	mutex_unlock(&pak_log_lock);
+	return count;
+}
+
+static int pak_log_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pak_log_show, NULL);
+}
+
+static const struct file_operations pak_log_fops = {
+	.owner = THIS_MODULE,
+	.open = pak_log_open,
+	.read = seq_read,
+	.write = pak_log_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int pak_log_sites_show(struct seq_file *m, void *v)
+{
+	struct pak_log_site *site;
+
+	raw_spin_lock_irq(&pak_log_sites_lock);
+	list_for_each_entry(site, &pak_log_sites, list) {
+		seq_printf(m, "%s %s:%u \"", site->modname, site->func,
+			   site->line);
+		seq_escape(m, site->fmt, "\t\n\\\"");
+		seq_puts(m, "\"\n");
+	}
+	raw_spin_unlock_irq(&pak_log_sites_lock);
+	return 0;
+}
+
+static int pak_log_sites_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pak_log_sites_show, NULL);
+}
+
+static const struct file_operations pak_log_sites_fops = {
+	.owner = THIS_MODULE,
+	.open = pak_log_sites_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/*
+ * ns per PAK_LOG() call through 'site', in batches that fit in the ring: the
+ * cost of a record, not of finding the ring full. Called with pak_log_lock
+ * held.
+ */
+static u64 pak_log_bench_ring(struct pak_log_site *site)
+{
+	unsigned int i, j, batch;
+	u64 t0, ns = 0;
+
+	for (i = 0; i < bench_calls; i += batch) {
+		batch = min(bench_calls - i, PAK_LOG_SLOTS / 2U);
+		pak_log_clear();
+
+		preempt_disable();
+		t0 = ktime_get_ns();
+		for (j = 0; j < batch; j++)
+			pak_log(site, "bench %u %s\n", j, "call");
+		ns += ktime_get_ns() - t0;
+		preempt_enable();
+		cond_resched();
+	}
+
+	return div64_u64(ns, bench_calls ?: 1);
+}
+
+static void pak_log_bench_run(void)
+{
+	DEFINE_PAK_LOG_SITE(site, "bench %u %s\n");
+	unsigned int i;
+	u64 t0;
+
+	/* Registered by hand, not to show up among the real sites. A site
+	 * that is off costs what any dynamic debug one does, a NOP */
+	site.flags = PAK_LOG_SITE_REGISTERED;
+	pak_log_bench_res.log_ns = pak_log_bench_ring(&site);
+	pak_log_clear();
+
+	/* What PR_DEBUG() costs without the binary log, stored only and
+	 * printed to the console as well */
+	t0 = ktime_get_ns();
+	for (i = 0; i < bench_printk_calls; i++)
+		__PR_FMT(KERN_DEBUG, "bench %u %s\n", i, "call");
+	pak_log_bench_res.printk_debug_ns =
+		div64_u64(ktime_get_ns() - t0, bench_printk_calls ?: 1);
+
+	t0 = ktime_get_ns();
+	for (i = 0; i < bench_printk_calls; i++)
+		__PR_FMT(KERN_NOTICE, "bench %u %s\n", i, "call");
+	pak_log_bench_res.printk_notice_ns =
+		div64_u64(ktime_get_ns() - t0, bench_printk_calls ?: 1);
+
+	pak_log_bench_res.valid = true;
+}
+
+static ssize_t pak_log_bench_write(struct file *file, const char __user *ubuf,
+				   size_t count, loff_t *ppos)
+{
+	mutex_lock(&pak_log_lock);
+	pak_log_bench_run();
+	mutex_unlock(&pak_log_lock);
+	return count;
+}
+
+static int pak_log_bench_show(struct seq_file *m, void *v)
+{
+	mutex_lock(&pak_log_lock);
+	if (pak_log_bench_res.valid) {
+		seq_printf(m, "%-28s %8s\n", "variant", "ns/call");
+		seq_printf(m, "%-28s %8llu\n", "binary log",
+			   pak_log_bench_res.log_ns);
+		seq_printf(m, "%-28s %8llu\n", "printk KERN_DEBUG",
+			   pak_log_bench_res.printk_debug_ns);
+		seq_printf(m, "%-28s %8llu\n", "printk KERN_NOTICE",
+			   pak_log_bench_res.printk_notice_ns);
+	}
+	mutex_unlock(&pak_log_lock);
+	return 0;
+}
+
+static int pak_log_bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pak_log_bench_show, NULL);
+}
+
+static const struct file_operations pak_log_bench_fops = {
+	.owner = THIS_MODULE,
+	.open = pak_log_bench_open,
+	.read = seq_read,
+	.write = pak_log_bench_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/* The format strings of a module going away are about to go with it */
+static int pak_log_module_notify(struct notifier_block *nb,
+				 unsigned long action, void *data)
+{
+	struct pak_log_site *site, *tmp;
+	struct module *mod = data;
+	struct pak_log_ring *ring;
+	struct pak_log_rec *rec;
+	unsigned int pos, end;
+	int cpu;
+
+	if (action != MODULE_STATE_GOING)
+		return NOTIFY_DONE;
+
+	mutex_lock(&pak_log_lock);
+	raw_spin_lock_irq(&pak_log_sites_lock);
+	list_for_each_entry_safe(site, tmp, &pak_log_sites, list)
+		if (within_module((unsigned long)site, mod))
+			list_del(&site->list);
+	raw_spin_unlock_irq(&pak_log_sites_lock);
+
+	/* Its exit function ran already, it doesn't log anymore */
+	for_each_possible_cpu(cpu) {
+		ring = pak_log_rings[cpu];
+		end = smp_load_acquire(&ring->head);
+		for (pos = ring->tail; pos != end; pos++) {
+			rec = &ring->recs[pos & (PAK_LOG_SLOTS - 1)];
+			if (rec->site &&
+			    within_module((unsigned long)rec->site, mod))
+				rec->site = NULL;
+		}
+	}
+	mutex_unlock(&pak_log_lock);
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block pak_log_module_nb = {
+	.notifier_call = pak_log_module_notify,
+};
+
+static void pak_log_free(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		vfree(pak_log_rings[cpu]);
+	kfree(pak_log_rings);
+}
+
+int pak_log_init(struct dentry *root)
+{
+	int cpu, err;
+
+	pak_log_rings = kcalloc(nr_cpu_ids, sizeof(*pak_log_rings),
+				GFP_KERNEL);
+	if (!pak_log_rings)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		pak_log_rings[cpu] = vzalloc_node(sizeof(struct pak_log_ring),
+						  cpu_to_node(cpu));
+		if (!pak_log_rings[cpu]) {
+			err = -ENOMEM;
+			goto err_free;
+		}
+	}
+
+	err = register_module_notifier(&pak_log_module_nb);
+	if (err)
+		goto err_free;
+
+	debugfs_create_file("log", 0600, root, NULL, &pak_log_fops);
+	debugfs_create_file("log_sites", 0400, root, NULL, &pak_log_sites_fops);
+	debugfs_create_file("log_bench", 0600, root, NULL, &pak_log_bench_fops);
+	return 0;
+
+err_free:
+	pak_log_free();
+	return err;
+}
+
+/* Modules using the log hold a reference on this one, none is left */
+void pak_log_exit(void)
+{
+	unregister_module_notifier(&pak_log_module_nb);
+	pak_log_free();
+}
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2017 Bruno E. O. Meneguele <bmeneguele@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ */
+
+/*
+ * pak-common.ko: what the modules of this repo share at runtime, see
+ * pak-common.h. Everything it exports lives under
+ * /sys/kernel/debug/playing-around/.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/debugfs.h>
+
+#include "pak-internal.h"
+#include "utils.h"
+
+#define PAK_DEBUGFS_ROOT "playing-around"
+
+static struct dentry *pak_debugfs;
+
+static int __init pak_init(void)
+{
+	int err;
+
+	pak_debugfs = debugfs_create_dir(PAK_DEBUGFS_ROOT, NULL);
+
+	err = pak_log_init(pak_debugfs);
+	if (err) {
+		PR_ERROR("failed to set the binary log up: %d\n", err);
+		debugfs_remove_recursive(pak_debugfs);
+		return err;
+	}
+	pak_stats_init(pak_debugfs);
+
+	PR_DEBUG("module loaded\n");
+	return 0;
+}
+
+static void __exit pak_exit(void)
+{
+	debugfs_remove_recursive(pak_debugfs);
+	pak_log_exit();
+	PR_DEBUG("module unloaded\n");
+}
+
+module_init(pak_init);
+module_exit(pak_exit);
+
+MODULE_AUTHOR("Bruno E. O. Meneguele <bmeneguele@gmail.com>");
+MODULE_DESCRIPTION("Facilities shared by the playing-around modules");
+MODULE_LICENSE("GPL");
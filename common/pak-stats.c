@@ -0,0 +1,318 @@
+/*
+ * Copyright (c) 2017 Bruno E. O. Meneguele <bmeneguele@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ */
+
+/*
+ * Statistics groups, see pak-common.h for their interface.
+ *
+ * Updates are inline in the modules, this side only allocates the per-CPU
+ * variables and formats them. Each stat is a debugfs file: counters and gauges
+ * read as a single number, ready for scripts, histograms as their sample
+ * count, sum, mean and percentiles followed by the non-empty buckets. Removing
+ * a group's directory waits for its files' readers, only then its stats are
+ * freed.
+ *
+ * Files under /sys/kernel/debug/playing-around/:
+ *  - stats_bench: write to measure the cost of an update, read for the
+ *    results.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/mutex.h>
+#include <linux/preempt.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/atomic.h>
+
+#include "pak-common.h"
+#include "pak-internal.h"
+#include "utils.h"
+
+static unsigned int stats_bench_calls = 100000;
+module_param(stats_bench_calls, uint, 0644);
+MODULE_PARM_DESC(stats_bench_calls, "Updates per stats benchmark variant "
+		 "(default: 100000)");
+
+struct pak_stats {
+	struct dentry *dir;
+	struct list_head stats;
+};
+
+static struct dentry *pak_stats_root;
+
+static DEFINE_MUTEX(pak_stats_bench_lock);
+static struct {
+	bool valid;
+	u64 counter_ns;
+	u64 hist_ns;
+	u64 atomic_ns;
+} pak_stats_bench_res;
+
+static long pak_stat_sum(struct pak_stat *stat)
+{
+	long sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		sum += *(long *)per_cpu_ptr(stat->pcpu, cpu);
+	return sum;
+}
+
+/* Buckets and sum of all CPUs into 'hist' */
+static void pak_stat_hist_sum(struct pak_stat *stat, struct pak_stat_hist *hist)
+{
+	struct pak_stat_hist *h;
+	unsigned int i;
+	int cpu;
+
+	memset(hist, 0, sizeof(*hist));
+	for_each_possible_cpu(cpu) {
+		h = per_cpu_ptr(stat->pcpu, cpu);
+		for (i = 0; i < PAK_STAT_HIST_BUCKETS; i++)
+			hist->buckets[i] += READ_ONCE(h->buckets[i]);
+		hist->sum += READ_ONCE(h->sum);
+	}
+}
+
+/* Counters are read while being updated, a sample may be off by a few */
+static int pak_stat_show(struct seq_file *m, void *v)
+{
+	struct pak_stat *stat = m->private;
+	struct pak_stat_hist hist;
+	unsigned long total = 0;
+	unsigned int i;
+
+	if (stat->type == PAK_STAT_COUNTER) {
+		seq_printf(m, "%lu\n", (unsigned long)pak_stat_sum(stat));
+		return 0;
+	}
+	if (stat->type == PAK_STAT_GAUGE) {
+		seq_printf(m, "%ld\n", pak_stat_sum(stat));
+		return 0;
+	}
+
+	pak_stat_hist_sum(stat, &hist);
+	for (i = 0; i < PAK_STAT_HIST_BUCKETS; i++)
+		total += hist.buckets[i];
+	seq_printf(m, "count %lu sum %llu mean %llu\n", total, hist.sum,
+		   total ? div64_u64(hist.sum, total) : 0);
+	if (total)
+		pak_hist_show(m, hist.buckets, PAK_STAT_HIST_BUCKETS);
+	return 0;
+}
+
+/*
+ * Zeroing races with the updaters of other CPUs: an update landing at the same
+ * time may survive it or get lost, which is fine for a reset. Gauges track the
+ * state of something, they can't be reset.
+ */
+static ssize_t pak_stat_write(struct file *file, const char __user *ubuf,
+			      size_t count, loff_t *ppos)
+{
+	struct seq_file *m = file->private_data;
+	struct pak_stat *stat = m->private;
+	size_t size;
+	int cpu;
+
+	if (stat->type == PAK_STAT_GAUGE)
+		return -EPERM;
+
+	size = stat->type == PAK_STAT_HIST ? sizeof(struct pak_stat_hist) :
+		sizeof(long);
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(stat->pcpu, cpu), 0, size);
+	return count;
+}
+
+static int pak_stat_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pak_stat_show, inode->i_private);
+}
+
+static const struct file_operations pak_stat_fops = {
+	.owner = THIS_MODULE,
+	.open = pak_stat_open,
+	.read = seq_read,
+	.write = pak_stat_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+struct pak_stats *pak_stats_create(const char *name)
+{
+	struct pak_stats *stats;
+
+	stats = kzalloc(sizeof(*stats), GFP_KERNEL);
+	if (!stats)
+		return NULL;
+
+	stats->dir = debugfs_create_dir(name, pak_stats_root);
+	if (IS_ERR(stats->dir)) {
+		PR_ERROR("failed to create the stats directory of %s: %ld\n",
+			 name, PTR_ERR(stats->dir));
+		kfree(stats);
+		return NULL;
+	}
+
+	INIT_LIST_HEAD(&stats->stats);
+	return stats;
+}
+EXPORT_SYMBOL_GPL(pak_stats_create);
+
+struct pak_stat *pak_stat_create(struct pak_stats *stats, const char *name,
+				 enum pak_stat_type type)
+{
+	struct pak_stat *stat;
+
+	if (!stats)
+		return NULL;
+
+	stat = kzalloc(sizeof(*stat), GFP_KERNEL);
+	if (!stat)
+		return NULL;
+
+	if (type == PAK_STAT_HIST)
+		stat->pcpu = alloc_percpu(struct pak_stat_hist);
+	else
+		stat->pcpu = alloc_percpu(long);
+	if (!stat->pcpu) {
+		kfree(stat);
+		return NULL;
+	}
+
+	stat->type = type;
+	stat->name = name;
+	list_add_tail(&stat->list, &stats->stats);
+	debugfs_create_file(name, type == PAK_STAT_GAUGE ? 0400 : 0600,
+			    stats->dir, stat, &pak_stat_fops);
+
+	return stat;
+}
+EXPORT_SYMBOL_GPL(pak_stat_create);
+
+/* Updaters of the group must be gone already */
+void pak_stats_destroy(struct pak_stats *stats)
+{
+	struct pak_stat *stat, *tmp;
+
+	if (!stats)
+		return;
+
+	debugfs_remove_recursive(stats->dir);
+	list_for_each_entry_safe(stat, tmp, &stats->stats, list) {
+		free_percpu(stat->pcpu);
+		kfree(stat);
+	}
+	kfree(stats);
+}
+EXPORT_SYMBOL_GPL(pak_stats_destroy);
+
+/*
+ * ns per update of a counter and of a histogram, next to an atomic increment
+ * of a single shared counter, the usual alternative. Run on a single CPU, the
+ * atomic doesn't even pay for the cache line bouncing it gets with concurrent
+ * updaters.
+ */
+static void pak_stats_bench_run(void)
+{
+	struct pak_stat *counter, *hist;
+	struct pak_stats *stats;
+	atomic_long_t shared = ATOMIC_LONG_INIT(0);
+	unsigned int i, n = stats_bench_calls ?: 1;
+	u64 t0, t1, t2, t3;
+
+	stats = pak_stats_create("stats_bench.tmp");
+	counter = pak_stat_create(stats, "counter", PAK_STAT_COUNTER);
+	hist = pak_stat_create(stats, "hist", PAK_STAT_HIST);
+	if (!counter || !hist) {
+		PR_ERROR("failed to create the benchmark stats\n");
+		goto out;
+	}
+
+	preempt_disable();
+	t0 = ktime_get_ns();
+	for (i = 0; i < n; i++)
+		pak_stat_inc(counter);
+	t1 = ktime_get_ns();
+	for (i = 0; i < n; i++)
+		pak_stat_record(hist, i);
+	t2 = ktime_get_ns();
+	for (i = 0; i < n; i++)
+		atomic_long_inc(&shared);
+	t3 = ktime_get_ns();
+	preempt_enable();
+
+	/* In hundredths of ns per update: a counter costs less than one */
+	pak_stats_bench_res.counter_ns = div_u64((t1 - t0) * 100, n);
+	pak_stats_bench_res.hist_ns = div_u64((t2 - t1) * 100, n);
+	pak_stats_bench_res.atomic_ns = div_u64((t3 - t2) * 100, n);
+	pak_stats_bench_res.valid = true;
+out:
+	pak_stats_destroy(stats);
+}
+
+static ssize_t pak_stats_bench_write(struct file *file,
+				     const char __user *ubuf, size_t count,
+				     loff_t *ppos)
+{
+	mutex_lock(&pak_stats_bench_lock);
+	pak_stats_bench_run();
+	mutex_unlock(&pak_stats_bench_lock);
+	return count;
+}
+
+static void pak_stats_bench_show_one(struct seq_file *m, const char *variant,
+				     u64 cns)
+{
+	u32 rem;
+	u64 ns = div_u64_rem(cns, 100, &rem);
+
+	seq_printf(m, "%-28s %5llu.%02u\n", variant, ns, rem);
+}
+
+static int pak_stats_bench_show(struct seq_file *m, void *v)
+{
+	mutex_lock(&pak_stats_bench_lock);
+	if (pak_stats_bench_res.valid) {
+		seq_printf(m, "%-28s %8s\n", "variant", "ns/call");
+		pak_stats_bench_show_one(m, "per-CPU counter",
+					 pak_stats_bench_res.counter_ns);
+		pak_stats_bench_show_one(m, "per-CPU log2 histogram",
+					 pak_stats_bench_res.hist_ns);
+		pak_stats_bench_show_one(m, "shared atomic counter",
+					 pak_stats_bench_res.atomic_ns);
+	}
+	mutex_unlock(&pak_stats_bench_lock);
+	return 0;
+}
+
+static int pak_stats_bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, pak_stats_bench_show, NULL);
+}
+
+static const struct file_operations pak_stats_bench_fops = {
+	.owner = THIS_MODULE,
+	.open = pak_stats_bench_open,
+	.read = seq_read,
+	.write = pak_stats_bench_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+void pak_stats_init(struct dentry *root)
+{
+	pak_stats_root = root;
+	debugfs_create_file("stats_bench", 0600, root, NULL,
+			    &pak_stats_bench_fops);
+}
@@ -0,0 +1,21 @@
+# Build profiles, included by the kbuild part of every module's Makefile
+# (through common.mk for all but pak-common.ko itself):
+#
+#  - 'make PROFILE=release': -O2, what the kernel itself is usually built with,
+#    also on kernels optimized for size. The one to benchmark.
+#  - 'make PROFILE=debug': -Og -g3, with every PR_DEBUG() site on from the
+#    start. Not -O0: the compile time checks of the kernel headers rely on
+#    constant folding, some of them don't build without it.
+#  - 'make PROFILE=size': -Os, for modules loaded at boot, where their size
+#    costs more than their speed.
+#
+# Left unset, modules take the flags of the kernel they're built against.
+ifeq ($(PROFILE),release)
+	ccflags-y += -O2
+else ifeq ($(PROFILE),debug)
+	ccflags-y += -Og -g3 -DDEBUG
+else ifeq ($(PROFILE),size)
+	ccflags-y += -Os
+else ifneq ($(PROFILE),)
+	$(error unknown PROFILE '$(PROFILE)', either release, debug or size)
+endif
@@ -1,23 +1,404 @@
-#include <linux/init.h>
+/*
+ * Copyright (c) 2017 Bruno E. O. Meneguele <bmeneguele@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ */
+
+/*
+ * Fault injection: crash the kernel in a few different ways, from the context
+ * asked for, to see what the crash capture path (pstore, kdump) gets out of
+ * it and how long it takes. See harness/crash.sh.
+ *
+ * Faults:
+ *  - oops: NULL pointer dereference;
+ *  - panic: panic() straight away;
+ *  - bug: BUG();
+ *  - softlockup: spin with preemption off for lockup_secs. From hardirq
+ *    context interrupts are off too, which makes it a hard lockup;
+ *  - hung_task: a kernel thread sleeping uninterruptibly for lockup_secs.
+ *    Only from process context, irq contexts can't sleep.
+ *
+ * Contexts: process (a kernel thread of the module's own), softirq (a softirq
+ * hrtimer) and hardirq (a hardirq hrtimer).
+ *
+ * Only oops and bug from process context leave the kernel running by default,
+ * the thread that hit them killed; lockups and hung tasks are only reported.
+ * The task loading the module or writing to debugfs is never the one hitting
+ * them: killed inside debugfs' ->write(), it would keep the file in use for
+ * good, and the module from being unloaded.
+ * The oops=panic, softlockup_panic=1, hung_task_panic=1 and nmi_watchdog=panic
+ * kernel parameters turn them all into panics, as crash capture expects.
+ *
+ * Nothing happens at load time unless a fault is given:
+ *
+ *	# insmod oops.ko fault=oops context=softirq
+ *
+ * or later, from debugfs:
+ *
+ *	# echo "softlockup hardirq" > /sys/kernel/debug/oops/trigger
+ */
+
+/* __init/exit, macros (MODULE_*) that initializes the module itself */
 #include <linux/module.h>
+/* Printing function definitions */
 #include <linux/kernel.h>
+/* BUG() */
+#include <linux/bug.h>
+/* Contexts faults are injected from */
+#include <linux/hrtimer.h>
+#include <linux/interrupt.h>
+#include <linux/preempt.h>
+/* Process context faults and the hung task */
+#include <linux/kthread.h>
+#include <linux/sched.h>
+#include <linux/sched/task.h>
+/* Triggering at runtime */
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/string.h>
+#include <linux/ktime.h>
 
+/* Utilities file. For now there are only printing helper functions */
 #include "utils.h"
 
+enum oops_fault {
+	OOPS_FAULT_NONE,
+	OOPS_FAULT_OOPS,
+	OOPS_FAULT_PANIC,
+	OOPS_FAULT_BUG,
+	OOPS_FAULT_SOFTLOCKUP,
+	OOPS_FAULT_HUNG_TASK,
+	OOPS_NR_FAULTS,
+};
+
+static const char * const oops_fault_names[] = {
+	[OOPS_FAULT_NONE] = "none",
+	[OOPS_FAULT_OOPS] = "oops",
+	[OOPS_FAULT_PANIC] = "panic",
+	[OOPS_FAULT_BUG] = "bug",
+	[OOPS_FAULT_SOFTLOCKUP] = "softlockup",
+	[OOPS_FAULT_HUNG_TASK] = "hung_task",
+};
+
+enum oops_context {
+	OOPS_CTX_PROCESS,
+	OOPS_CTX_SOFTIRQ,
+	OOPS_CTX_HARDIRQ,
+	OOPS_NR_CONTEXTS,
+};
+
+static const char * const oops_context_names[] = {
+	[OOPS_CTX_PROCESS] = "process",
+	[OOPS_CTX_SOFTIRQ] = "softirq",
+	[OOPS_CTX_HARDIRQ] = "hardirq",
+};
+
+static char *fault = "none";
+module_param(fault, charp, 0444);
+MODULE_PARM_DESC(fault,
+		 "Fault injected at load time: none, oops, panic, bug, softlockup or hung_task");
+
+static char *context = "process";
+module_param(context, charp, 0444);
+MODULE_PARM_DESC(context,
+		 "Context of the load time fault: process, softirq or hardirq");
+
+static unsigned int lockup_secs = 30;
+module_param(lockup_secs, uint, 0644);
+MODULE_PARM_DESC(lockup_secs,
+		 "How long softlockup spins and hung_task sleeps, in seconds");
+
+/*
+ * A single fault at a time. The bit is held while a fault is waiting for its
+ * timer, while a lockup spins and while the hung task sleeps. Oops, panic and
+ * BUG clear it right before hitting, as nothing runs after them to do it: the
+ * thread hitting an oops or a BUG is killed, while the kernel may well survive.
+ */
+#define OOPS_BUSY	0
+static unsigned long oops_flags;
+
+/* Fault of the last trigger, the one the irq context timers inject */
+static enum oops_fault oops_pending;
+static struct hrtimer oops_softirq_timer;
+static struct hrtimer oops_hardirq_timer;
+
+/* Thread of the last process context fault, hung task included */
+static struct task_struct *oops_task;
+
+/* Directory holding the module's debugfs files */
+static struct dentry *oops_debugfs;
+
+static const char *oops_current_context(void)
+{
+	if (in_hardirq())
+		return "hardirq";
+	if (in_serving_softirq())
+		return "softirq";
+	return "process";
+}
+
 static void create_oops(void)
 {
 	*(int *)0 = 0;
 }
 
+/*
+ * Busy loop on the clock, never scheduling. The soft lockup detector's hrtimer
+ * still fires on this CPU when interrupts are on, and finds its watchdog thread
+ * not having run for too long.
+ */
+static void oops_spin(void)
+{
+	u64 end = ktime_get_mono_fast_ns() + (u64)lockup_secs * NSEC_PER_SEC;
+
+	preempt_disable();
+	while (ktime_get_mono_fast_ns() < end)
+		cpu_relax();
+	preempt_enable();
+}
+
+/*
+ * A single uninterruptible sleep: the hung task detector reports tasks in D
+ * state not scheduled for hung_task_timeout_secs. kthread_stop() still wakes
+ * it up, at unload.
+ */
+static int oops_hung_fn(void *data)
+{
+	unsigned long end = jiffies + lockup_secs * HZ;
+
+	PR_INFO("hung_task: sleeping for %us in D state\n", lockup_secs);
+	while (!kthread_should_stop() && time_before(jiffies, end))
+		schedule_timeout_uninterruptible(end - jiffies);
+
+	clear_bit(OOPS_BUSY, &oops_flags);
+	return 0;
+}
+
+/* Injects the fault in the context it is called from */
+static void oops_inject(enum oops_fault f)
+{
+	const char *ctx = oops_current_context();
+
+	PR_INFO("injecting %s from %s context\n", oops_fault_names[f], ctx);
+
+	if (f != OOPS_FAULT_SOFTLOCKUP)
+		clear_bit(OOPS_BUSY, &oops_flags);
+
+	switch (f) {
+	case OOPS_FAULT_OOPS:
+		create_oops();
+		break;
+	case OOPS_FAULT_PANIC:
+		panic("oops: panic injected from %s context\n", ctx);
+		break;
+	case OOPS_FAULT_BUG:
+		BUG();
+		break;
+	case OOPS_FAULT_SOFTLOCKUP:
+		oops_spin();
+		PR_INFO("softlockup: survived %us of spinning\n", lockup_secs);
+		clear_bit(OOPS_BUSY, &oops_flags);
+		break;
+	default:
+		break;
+	}
+}
+
+static int oops_process_fn(void *data)
+{
+	oops_inject(READ_ONCE(oops_pending));
+	return 0;
+}
+
+/*
+ * Process context faults run from a thread of their own, which ends either
+ * returning or killed by the fault: kthread_stop() copes with both, as long as
+ * the task_struct is still there.
+ */
+static int oops_start_task(enum oops_fault f)
+{
+	struct task_struct *task;
+
+	/* The previous one is over, or about to be, the busy bit said so */
+	if (oops_task) {
+		kthread_stop(oops_task);
+		put_task_struct(oops_task);
+		oops_task = NULL;
+	}
+
+	task = kthread_create(f == OOPS_FAULT_HUNG_TASK ? oops_hung_fn :
+			      oops_process_fn, NULL, "oops_%s",
+			      oops_fault_names[f]);
+	if (IS_ERR(task))
+		return PTR_ERR(task);
+	/* It may be over before kthread_stop() is called at unload */
+	get_task_struct(task);
+	oops_task = task;
+	wake_up_process(task);
+	return 0;
+}
+
+static enum hrtimer_restart oops_timer_fn(struct hrtimer *timer)
+{
+	oops_inject(READ_ONCE(oops_pending));
+	return HRTIMER_NORESTART;
+}
+
+static int oops_trigger(enum oops_fault f, enum oops_context ctx)
+{
+	int err = 0;
+
+	if (f == OOPS_FAULT_NONE)
+		return 0;
+	if (f == OOPS_FAULT_HUNG_TASK && ctx != OOPS_CTX_PROCESS)
+		return -EINVAL;
+	if (test_and_set_bit(OOPS_BUSY, &oops_flags))
+		return -EBUSY;
+	WRITE_ONCE(oops_pending, f);
+
+	switch (ctx) {
+	case OOPS_CTX_PROCESS:
+		err = oops_start_task(f);
+		if (err)
+			clear_bit(OOPS_BUSY, &oops_flags);
+		break;
+	case OOPS_CTX_SOFTIRQ:
+		hrtimer_start(&oops_softirq_timer, 0, HRTIMER_MODE_REL_SOFT);
+		break;
+	case OOPS_CTX_HARDIRQ:
+		hrtimer_start(&oops_hardirq_timer, 0, HRTIMER_MODE_REL_HARD);
+		break;
+	default:
+		break;
+	}
+	return err;
+}
+
+static int oops_match(const char * const *names, unsigned int n,
+		      const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		if (sysfs_streq(name, names[i]))
+			return i;
+	return -EINVAL;
+}
+
+/*
+ * "<fault> [<context>]", process context by default.
+ * Example: echo "bug softirq" > /sys/kernel/debug/oops/trigger
+ */
+static ssize_t oops_trigger_write(struct file *file, const char __user *ubuf,
+				  size_t count, loff_t *ppos)
+{
+	char buf[32], *s, *f_name, *ctx_name;
+	int f, ctx = OOPS_CTX_PROCESS;
+	int err;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, ubuf, count))
+		return -EFAULT;
+	buf[count] = '\0';
+
+	s = strim(buf);
+	f_name = strsep(&s, " \t");
+	ctx_name = s ? skip_spaces(s) : NULL;
+
+	f = oops_match(oops_fault_names, OOPS_NR_FAULTS, f_name);
+	if (f < 0)
+		return f;
+	if (ctx_name && *ctx_name) {
+		ctx = oops_match(oops_context_names, OOPS_NR_CONTEXTS,
+				 ctx_name);
+		if (ctx < 0)
+			return ctx;
+	}
+
+	err = oops_trigger(f, ctx);
+	return err ? err : count;
+}
+
+static int oops_trigger_show(struct seq_file *m, void *v)
+{
+	unsigned int i;
+
+	seq_puts(m, "faults:");
+	for (i = 0; i < OOPS_NR_FAULTS; i++)
+		seq_printf(m, " %s", oops_fault_names[i]);
+	seq_puts(m, "\ncontexts:");
+	for (i = 0; i < OOPS_NR_CONTEXTS; i++)
+		seq_printf(m, " %s", oops_context_names[i]);
+	seq_printf(m, "\nlockup_secs: %u\n", lockup_secs);
+	/* Busy only until an oops, a panic or a BUG hits, see OOPS_BUSY */
+	if (test_bit(OOPS_BUSY, &oops_flags))
+		seq_printf(m, "state: busy, %s\n",
+			   oops_fault_names[READ_ONCE(oops_pending)]);
+	else
+		seq_puts(m, "state: idle\n");
+	return 0;
+}
+
+static int oops_trigger_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, oops_trigger_show, NULL);
+}
+
+static const struct file_operations oops_trigger_fops = {
+	.owner = THIS_MODULE,
+	.open = oops_trigger_open,
+	.read = seq_read,
+	.write = oops_trigger_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
 static int __init my_oops_init(void)
 {
+	int f, ctx, err;
+
+	f = oops_match(oops_fault_names, OOPS_NR_FAULTS, fault);
+	ctx = oops_match(oops_context_names, OOPS_NR_CONTEXTS, context);
+	if (f < 0 || ctx < 0) {
+		PR_ERROR("unknown fault '%s' or context '%s'\n", fault,
+			 context);
+		return -EINVAL;
+	}
+
+	hrtimer_init(&oops_softirq_timer, CLOCK_MONOTONIC,
+		     HRTIMER_MODE_REL_SOFT);
+	oops_softirq_timer.function = oops_timer_fn;
+	hrtimer_init(&oops_hardirq_timer, CLOCK_MONOTONIC,
+		     HRTIMER_MODE_REL_HARD);
+	oops_hardirq_timer.function = oops_timer_fn;
+
+	oops_debugfs = debugfs_create_dir("oops", NULL);
+	debugfs_create_file("trigger", 0600, oops_debugfs, NULL,
+			    &oops_trigger_fops);
+
 	PR_DEBUG("Hello world! Lets cause some mess!\n");
-	create_oops();
-	return 0;
+	err = oops_trigger(f, ctx);
+	if (err) {
+		PR_ERROR("failed to inject %s from %s context\n", fault,
+			 context);
+		debugfs_remove_recursive(oops_debugfs);
+	}
+	return err;
 }
 
 static void __exit my_oops_exit(void)
 {
+	debugfs_remove_recursive(oops_debugfs);
+	hrtimer_cancel(&oops_softirq_timer);
+	hrtimer_cancel(&oops_hardirq_timer);
+	if (oops_task) {
+		kthread_stop(oops_task);
+		put_task_struct(oops_task);
+	}
 	PR_DEBUG("Byee");
 }
 
@@ -25,5 +406,5 @@ module_init(my_oops_init);
 module_exit(my_oops_exit);
 
 MODULE_AUTHOR("Bruno E. O. Meneguele <bmeneguele@gmail.com>");
-MODULE_DESCRIPTION("Create Kernel Oops");
+MODULE_DESCRIPTION("Inject kernel crashes, lockups and hung tasks");
 MODULE_LICENSE("GPL");
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2020 Bruno Meneguele <bmeneguele@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ */
+
+/*
+ * Tracepoints around each cipher operation. Both modules of this directory
+ * include this header, async.c defining CRYPTO_TRACE_ASYNC before, so each
+ * gets its own trace system and they can be loaded together:
+ *
+ *	# echo 1 > /sys/kernel/tracing/events/crypto_sync/enable
+ *	# cat /sys/kernel/tracing/trace_pipe
+ *
+ * A disabled tracepoint is a static branch, a NOP, in the caller.
+ */
+
+#undef TRACE_SYSTEM
+#ifdef CRYPTO_TRACE_ASYNC
+#define TRACE_SYSTEM crypto_async
+#else
+#define TRACE_SYSTEM crypto_sync
+#endif
+
+#if !defined(__CRYPTO_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define __CRYPTO_TRACE_H
+
+#include <linux/tracepoint.h>
+#include <linux/string.h>
+#include <linux/crypto.h>
+
+TRACE_EVENT(crypto_op_start,
+	TP_PROTO(const char *alg, bool encrypt, unsigned int len),
+	TP_ARGS(alg, encrypt, len),
+
+	TP_STRUCT__entry(
+		__array(char, alg, CRYPTO_MAX_ALG_NAME)
+		__field(bool, encrypt)
+		__field(unsigned int, len)
+	),
+
+	TP_fast_assign(
+		strscpy(__entry->alg, alg, CRYPTO_MAX_ALG_NAME);
+		__entry->encrypt = encrypt;
+		__entry->len = len;
+	),
+
+	TP_printk("alg=%s op=%s len=%u", __entry->alg,
+		  __entry->encrypt ? "encrypt" : "decrypt", __entry->len)
+);
+
+TRACE_EVENT(crypto_op_finish,
+	TP_PROTO(const char *alg, bool encrypt, unsigned int len, int err),
+	TP_ARGS(alg, encrypt, len, err),
+
+	TP_STRUCT__entry(
+		__array(char, alg, CRYPTO_MAX_ALG_NAME)
+		__field(bool, encrypt)
+		__field(unsigned int, len)
+		__field(int, err)
+	),
+
+	TP_fast_assign(
+		strscpy(__entry->alg, alg, CRYPTO_MAX_ALG_NAME);
+		__entry->encrypt = encrypt;
+		__entry->len = len;
+		__entry->err = err;
+	),
+
+	TP_printk("alg=%s op=%s len=%u err=%d", __entry->alg,
+		  __entry->encrypt ? "encrypt" : "decrypt", __entry->len,
+		  __entry->err)
+);
+
+#endif /* __CRYPTO_TRACE_H */
+
+/* Out of the kernel tree: the header is found through -I$(src) */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE crypto-trace
+#include <trace/define_trace.h>
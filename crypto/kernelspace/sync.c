@@ -31,10 +31,30 @@
 #include <linux/scatterlist.h>
 /* Error macros */
 #include <linux/err.h>
+/* ktime_get_ns(), to time each operation */
+#include <linux/ktime.h>
 
 /* Printing helper functions */
 #include "../utils.h"
 
+#define CREATE_TRACE_POINTS
+#include "crypto-trace.h"
+/* Runtime stats, exported by pak-common.ko when built with PAK_COMMON=1 */
+#include "pak-common.h"
+
+/* Under /sys/kernel/debug/playing-around/sync/ while the module is loaded */
+static struct pak_stats *crypto_stats;
+static struct pak_stat *crypto_stat_ops;
+static struct pak_stat *crypto_stat_bytes;
+static struct pak_stat *crypto_stat_ns;
+
+static void crypto_stats_account(u64 start, unsigned int len)
+{
+	pak_stat_inc(crypto_stat_ops);
+	pak_stat_add(crypto_stat_bytes, len);
+	pak_stat_record(crypto_stat_ns, ktime_get_ns() - start);
+}
+
 static int __init crypto_sync_init(void)
 {
 	int err;
@@ -52,6 +72,10 @@ static int __init crypto_sync_init(void)
 	char *iv;
 	size_t ivsize;
 
+	/* Driver actually doing the work, for the tracepoints */
+	const char *alg;
+	u64 start;
+
 	PR_DEBUG("initializing module\n");
 
 	/* Check the existence of the cipher in the kernel (it might be a
@@ -77,6 +101,15 @@ static int __init crypto_sync_init(void)
 		PR_ERROR("impossible to allocate skcipher\n");
 		return PTR_ERR(tfm);
 	}
+	alg = crypto_skcipher_driver_name(tfm);
+
+	/* Stats aren't essential, the module works without them */
+	crypto_stats = pak_stats_create(KBUILD_MODNAME);
+	crypto_stat_ops = pak_stat_create(crypto_stats, "ops",
+					  PAK_STAT_COUNTER);
+	crypto_stat_bytes = pak_stat_create(crypto_stats, "bytes",
+					    PAK_STAT_COUNTER);
+	crypto_stat_ns = pak_stat_create(crypto_stats, "ns", PAK_STAT_HIST);
 
 	/* Default function to set the key for the symetric key cipher */
 	err = crypto_skcipher_setkey(tfm, key, sizeof(key));
@@ -84,8 +117,7 @@ static int __init crypto_sync_init(void)
 		PR_ERROR("fail setting key for transformation: %d\n", err);
 		goto error0;
 	}
-	print_hex_dump(KERN_DEBUG, "key: ", DUMP_PREFIX_NONE, 16, 1, key, 16,
-		       false);
+	print_hex_dump_debug("key: ", DUMP_PREFIX_NONE, 16, 1, key, 16, false);
 
 	/* Each crypto cipher has its own Initialization Vector (IV) size,
 	 * because of that I first request the correct size for salsa20 IV and
@@ -98,8 +130,8 @@ static int __init crypto_sync_init(void)
 		err = -ENOMEM;
 		goto error0;
 	}
-	print_hex_dump(KERN_DEBUG, "iv: ", DUMP_PREFIX_NONE, 16, 1, iv,
-		       ivsize, false);
+	print_hex_dump_debug("iv: ", DUMP_PREFIX_NONE, 16, 1, iv, ivsize,
+		     false);
 
 	/* Requests are objects that hold all information about a crypto
 	 * operation, from the tfm itself to the buffers and IV that will be
@@ -122,19 +154,23 @@ static int __init crypto_sync_init(void)
 	sg_init_one(&sg, plaintext, 16);
 	skcipher_request_set_crypt(req, &sg, &sg, 16, iv);
 
-	print_hex_dump(KERN_DEBUG, "orig text: ", DUMP_PREFIX_NONE, 16, 1,
-		       plaintext, 16, true);
+	print_hex_dump_debug("orig text: ", DUMP_PREFIX_NONE, 16, 1, plaintext,
+		     16, true);
 
 	/* Encrypt operation against "plaintext" content */
+	trace_crypto_op_start(alg, true, 16);
+	start = ktime_get_ns();
 	err = crypto_skcipher_encrypt(req);
+	crypto_stats_account(start, 16);
+	trace_crypto_op_finish(alg, true, 16, err);
 	if (err) {
 		PR_ERROR("could not encrypt data\n");
 		goto error1;
 	}
 
 	sg_copy_to_buffer(&sg, 1, ciphertext, 16);
-	print_hex_dump(KERN_DEBUG, "encr text: ", DUMP_PREFIX_NONE, 16, 1,
-		       ciphertext, 16, true);
+	print_hex_dump_debug("encr text: ", DUMP_PREFIX_NONE, 16, 1, ciphertext,
+		     16, true);
 
 	/* Time to decrypt */
 	memset(plaintext, 0, 16);
@@ -142,24 +178,31 @@ static int __init crypto_sync_init(void)
 
 	/* Decrypt operation against the new buffer (scatterlist that holds
 	 * the ciphered text). */
+	trace_crypto_op_start(alg, false, 16);
+	start = ktime_get_ns();
 	err = crypto_skcipher_decrypt(req);
+	crypto_stats_account(start, 16);
+	trace_crypto_op_finish(alg, false, 16, err);
 	if (err) {
 		PR_ERROR("could not decrypt data\n");
 		goto error1;
 	}
 
 	sg_copy_to_buffer(&sg, 1, plaintext, 16);
-	print_hex_dump(KERN_DEBUG, "decr text: ", DUMP_PREFIX_NONE, 16, 1,
-		       plaintext, 16, true);
+	print_hex_dump_debug("decr text: ", DUMP_PREFIX_NONE, 16, 1, plaintext,
+		     16, true);
 error1:
 	skcipher_request_free(req);
 error0:
 	crypto_free_skcipher(tfm);
+	if (err)
+		pak_stats_destroy(crypto_stats);
 	return err;
 }
 
 static void __exit crypto_sync_exit(void)
 {
+	pak_stats_destroy(crypto_stats);
 	PR_DEBUG("exiting module\n");
 }
 
@@ -0,0 +1,654 @@
+/*
+ * Copyright (c) 2017 Bruno E. O. Meneguele <bmeneguele@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ */
+
+/*
+ * In-kernel container benchmark.
+ *
+ * The same set of dogs, keyed by an id, is loaded into each of the kernel's
+ * generic containers: list_head, hlist (hash table), rb_root_cached, xarray
+ * and maple_tree. Each one is measured for:
+ *
+ *  - insert: adding every entry;
+ *  - lookup: finding 'nr_lookups' entries by id, picked at random;
+ *  - iterate: walking all entries in id order. The plain list must be sorted
+ *    first (list_sort(), counted in), the hash table can't do it at all;
+ *  - delete: removing every entry. Intrusive containers unlink the entry they
+ *    are given, xarray and maple tree erase by id.
+ *
+ * Runs go through every size in 'sizes' and every id distribution: 'seq'
+ * (0, 1, 2, ...), 'random' (spread over 32 bits) and 'clustered' (runs of 64
+ * consecutive ids at random places). Results, in ns per operation, are kept in
+ * debugfs:
+ *
+ *	# echo 1000,100000,1000000 > /sys/module/container_bench/parameters/sizes
+ *	# echo 1 > /sys/kernel/debug/container-bench/run
+ *	# cat /sys/kernel/debug/container-bench/results
+ */
+
+/* __init/exit, macros (MODULE_*) that initializes the module itself */
+#include <linux/module.h>
+/* Printing function definitions */
+#include <linux/kernel.h>
+#include <linux/version.h>
+/* Things related to memory allocation, e.g. kmalloc */
+#include <linux/slab.h>
+#include <linux/mm.h>
+/* Containers under test */
+#include <linux/list.h>
+#include <linux/list_sort.h>
+#include <linux/hash.h>
+#include <linux/rbtree.h>
+#include <linux/xarray.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 1, 0)
+#define CB_HAVE_MAPLE_TREE
+#include <linux/maple_tree.h>
+#endif
+/* Run control and results */
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/mutex.h>
+/* Workload generation and measurement */
+#include <linux/random.h>
+#include <linux/prandom.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/log2.h>
+
+/* Utilities file. For now there are only printing helper functions */
+#include "utils.h"
+
+#define CB_MAX_SIZES 8
+
+static unsigned long sizes[CB_MAX_SIZES] = { 1000, 100000, 1000000 };
+static int nr_sizes = 3;
+module_param_array(sizes, ulong, &nr_sizes, 0644);
+MODULE_PARM_DESC(sizes, "Numbers of entries to run with, comma separated");
+
+static unsigned int nr_lookups = 10000;
+module_param(nr_lookups, uint, 0644);
+MODULE_PARM_DESC(nr_lookups, "Lookups measured in each run");
+
+/* Dog keyed by id, with a link for each of the intrusive containers. Only one
+ * container holds the entry at a time */
+struct cb_dog {
+	u32 id;
+	int age; /* in months */
+	bool training_easy;
+	union {
+		struct list_head list;
+		struct hlist_node hnode;
+		struct rb_node rb;
+	};
+};
+
+/* Ids distributions */
+enum cb_dist {
+	CB_DIST_SEQ,
+	CB_DIST_RANDOM,
+	CB_DIST_CLUSTERED,
+	CB_NR_DISTS,
+};
+
+static const char * const cb_dist_names[] = {
+	[CB_DIST_SEQ] = "seq",
+	[CB_DIST_RANDOM] = "random",
+	[CB_DIST_CLUSTERED] = "clustered",
+};
+
+/* Consecutive ids in a cluster */
+#define CB_CLUSTER_SHIFT 6
+
+/*
+ * The i-th id of a distribution. Multiplying by an odd constant is a bijection
+ * modulo a power of two, so ids come out unique and scattered without keeping
+ * track of the ones already taken.
+ */
+static u32 cb_dist_id(enum cb_dist dist, u32 i, u32 seed)
+{
+	switch (dist) {
+	case CB_DIST_RANDOM:
+		return (i ^ seed) * GOLDEN_RATIO_32;
+	case CB_DIST_CLUSTERED:
+		return (((i >> CB_CLUSTER_SHIFT) ^ seed) * GOLDEN_RATIO_32)
+			<< CB_CLUSTER_SHIFT | (i & ((1 << CB_CLUSTER_SHIFT) - 1));
+	default:
+		return i;
+	}
+}
+
+/*
+ * Container operations. Containers not able to walk in id order return
+ * -EOPNOTSUPP from iterate().
+ */
+struct cb_ops {
+	const char *name;
+	int (*init)(unsigned long n);
+	int (*insert)(struct cb_dog *dog);
+	struct cb_dog *(*lookup)(u32 id);
+	int (*iterate)(u64 *sum);
+	void (*delete)(struct cb_dog *dog);
+	void (*destroy)(void);
+};
+
+/* list_head: insert at the tail, everything else is a linear walk */
+static LIST_HEAD(cb_list);
+
+static int cb_list_init(unsigned long n)
+{
+	INIT_LIST_HEAD(&cb_list);
+	return 0;
+}
+
+static int cb_list_insert(struct cb_dog *dog)
+{
+	list_add_tail(&dog->list, &cb_list);
+	return 0;
+}
+
+static struct cb_dog *cb_list_lookup(u32 id)
+{
+	struct cb_dog *dog;
+
+	list_for_each_entry(dog, &cb_list, list) {
+		if (dog->id == id)
+			return dog;
+	}
+	return NULL;
+}
+
+static int cb_list_cmp(void *priv, const struct list_head *a,
+		       const struct list_head *b)
+{
+	u32 ida = list_entry(a, struct cb_dog, list)->id;
+	u32 idb = list_entry(b, struct cb_dog, list)->id;
+
+	return ida > idb;
+}
+
+static int cb_list_iterate(u64 *sum)
+{
+	struct cb_dog *dog;
+
+	list_sort(NULL, &cb_list, cb_list_cmp);
+	list_for_each_entry(dog, &cb_list, list)
+		*sum += dog->age;
+	return 0;
+}
+
+static void cb_list_delete(struct cb_dog *dog)
+{
+	list_del(&dog->list);
+}
+
+static void cb_list_destroy(void)
+{
+	INIT_LIST_HEAD(&cb_list);
+}
+
+/* hlist: hash table with as many buckets as entries, rounded up to a power of
+ * two */
+static struct hlist_head *cb_htable;
+static unsigned int cb_hbits;
+
+static int cb_hlist_init(unsigned long n)
+{
+	unsigned long i;
+
+	cb_hbits = ilog2(roundup_pow_of_two(n));
+	cb_htable = kvmalloc_array(1UL << cb_hbits, sizeof(*cb_htable),
+				   GFP_KERNEL);
+	if (!cb_htable)
+		return -ENOMEM;
+
+	for (i = 0; i < (1UL << cb_hbits); i++)
+		INIT_HLIST_HEAD(&cb_htable[i]);
+	return 0;
+}
+
+static int cb_hlist_insert(struct cb_dog *dog)
+{
+	hlist_add_head(&dog->hnode, &cb_htable[hash_32(dog->id, cb_hbits)]);
+	return 0;
+}
+
+static struct cb_dog *cb_hlist_lookup(u32 id)
+{
+	struct cb_dog *dog;
+
+	hlist_for_each_entry(dog, &cb_htable[hash_32(id, cb_hbits)], hnode) {
+		if (dog->id == id)
+			return dog;
+	}
+	return NULL;
+}
+
+static int cb_hlist_iterate(u64 *sum)
+{
+	return -EOPNOTSUPP;
+}
+
+static void cb_hlist_delete(struct cb_dog *dog)
+{
+	hlist_del(&dog->hnode);
+}
+
+static void cb_hlist_destroy(void)
+{
+	kvfree(cb_htable);
+	cb_htable = NULL;
+}
+
+/* rb_root_cached: red-black tree caching its leftmost (smallest id) node */
+static struct rb_root_cached cb_rbtree;
+
+static int cb_rbtree_init(unsigned long n)
+{
+	cb_rbtree = RB_ROOT_CACHED;
+	return 0;
+}
+
+static int cb_rbtree_insert(struct cb_dog *dog)
+{
+	struct rb_node **link = &cb_rbtree.rb_root.rb_node, *parent = NULL;
+	bool leftmost = true;
+	struct cb_dog *entry;
+
+	while (*link) {
+		parent = *link;
+		entry = rb_entry(parent, struct cb_dog, rb);
+		if (dog->id < entry->id) {
+			link = &parent->rb_left;
+		} else if (dog->id > entry->id) {
+			link = &parent->rb_right;
+			leftmost = false;
+		} else {
+			return -EEXIST;
+		}
+	}
+
+	rb_link_node(&dog->rb, parent, link);
+	rb_insert_color_cached(&dog->rb, &cb_rbtree, leftmost);
+	return 0;
+}
+
+static struct cb_dog *cb_rbtree_lookup(u32 id)
+{
+	struct rb_node *node = cb_rbtree.rb_root.rb_node;
+	struct cb_dog *entry;
+
+	while (node) {
+		entry = rb_entry(node, struct cb_dog, rb);
+		if (id < entry->id)
+			node = node->rb_left;
+		else if (id > entry->id)
+			node = node->rb_right;
+		else
+			return entry;
+	}
+	return NULL;
+}
+
+static int cb_rbtree_iterate(u64 *sum)
+{
+	struct rb_node *node;
+
+	for (node = rb_first_cached(&cb_rbtree); node; node = rb_next(node))
+		*sum += rb_entry(node, struct cb_dog, rb)->age;
+	return 0;
+}
+
+static void cb_rbtree_delete(struct cb_dog *dog)
+{
+	rb_erase_cached(&dog->rb, &cb_rbtree);
+}
+
+static void cb_rbtree_destroy(void)
+{
+	cb_rbtree = RB_ROOT_CACHED;
+}
+
+/* xarray: radix tree of pointers indexed by id */
+static DEFINE_XARRAY(cb_xa);
+
+static int cb_xa_init(unsigned long n)
+{
+	xa_init(&cb_xa);
+	return 0;
+}
+
+static int cb_xa_insert(struct cb_dog *dog)
+{
+	return xa_insert(&cb_xa, dog->id, dog, GFP_KERNEL);
+}
+
+static struct cb_dog *cb_xa_lookup(u32 id)
+{
+	return xa_load(&cb_xa, id);
+}
+
+static int cb_xa_iterate(u64 *sum)
+{
+	struct cb_dog *dog;
+	unsigned long id;
+
+	xa_for_each(&cb_xa, id, dog)
+		*sum += dog->age;
+	return 0;
+}
+
+static void cb_xa_delete(struct cb_dog *dog)
+{
+	xa_erase(&cb_xa, dog->id);
+}
+
+static void cb_xa_destroy(void)
+{
+	xa_destroy(&cb_xa);
+}
+
+#ifdef CB_HAVE_MAPLE_TREE
+/* maple_tree: B-tree of ranges, here every range is a single id */
+static struct maple_tree cb_mt;
+
+static int cb_mt_init(unsigned long n)
+{
+	mt_init(&cb_mt);
+	return 0;
+}
+
+static int cb_mt_insert(struct cb_dog *dog)
+{
+	return mtree_insert(&cb_mt, dog->id, dog, GFP_KERNEL);
+}
+
+static struct cb_dog *cb_mt_lookup(u32 id)
+{
+	return mtree_load(&cb_mt, id);
+}
+
+static int cb_mt_iterate(u64 *sum)
+{
+	struct cb_dog *dog;
+	unsigned long id = 0;
+
+	mt_for_each(&cb_mt, dog, id, ULONG_MAX)
+		*sum += dog->age;
+	return 0;
+}
+
+static void cb_mt_delete(struct cb_dog *dog)
+{
+	mtree_erase(&cb_mt, dog->id);
+}
+
+static void cb_mt_destroy(void)
+{
+	mtree_destroy(&cb_mt);
+}
+#endif
+
+#define CB_OPS(_name, _prefix) {			\
+	.name = _name,					\
+	.init = _prefix##_init,				\
+	.insert = _prefix##_insert,			\
+	.lookup = _prefix##_lookup,			\
+	.iterate = _prefix##_iterate,			\
+	.delete = _prefix##_delete,			\
+	.destroy = _prefix##_destroy,			\
+}
+
+static const struct cb_ops cb_containers[] = {
+	CB_OPS("list_head", cb_list),
+	CB_OPS("hlist", cb_hlist),
+	CB_OPS("rb_root_cached", cb_rbtree),
+	CB_OPS("xarray", cb_xa),
+#ifdef CB_HAVE_MAPLE_TREE
+	CB_OPS("maple_tree", cb_mt),
+#endif
+};
+
+#define CB_NR_CONTAINERS ARRAY_SIZE(cb_containers)
+
+/* Nanoseconds per operation of each phase, U64_MAX if not supported */
+struct cb_result {
+	const char *container;
+	enum cb_dist dist;
+	unsigned long size;
+	u64 insert_ns;
+	u64 lookup_ns;
+	u64 iterate_ns;
+	u64 delete_ns;
+};
+
+/* Serializes runs and results reading */
+static DEFINE_MUTEX(cb_mutex);
+static struct cb_result cb_results[CB_MAX_SIZES * CB_NR_DISTS *
+				   ARRAY_SIZE(cb_containers)];
+static unsigned int cb_nr_results;
+
+/* Directory holding the module's debugfs files */
+static struct dentry *cb_debugfs;
+
+static u64 cb_per_op(u64 ns, unsigned long ops)
+{
+	return ops ? div64_u64(ns, ops) : 0;
+}
+
+/*
+ * Run every phase of a container over 'dogs'. Lookup ids were picked
+ * beforehand, so that the random generation doesn't count in.
+ */
+static int cb_run_one(const struct cb_ops *ops, struct cb_dog *dogs,
+		      unsigned long n, u32 *lookup_ids,
+		      struct cb_result *res)
+{
+	unsigned long i, misses = 0;
+	u64 start, sum = 0;
+	int err;
+
+	err = ops->init(n);
+	if (err)
+		return err;
+
+	start = ktime_get_ns();
+	for (i = 0; i < n; i++) {
+		err = ops->insert(&dogs[i]);
+		if (err) {
+			/* Only the entries inserted so far are deleted
+			 * below */
+			n = i;
+			goto out;
+		}
+		if (!(i % 4096))
+			cond_resched();
+	}
+	res->insert_ns = cb_per_op(ktime_get_ns() - start, n);
+
+	start = ktime_get_ns();
+	for (i = 0; i < nr_lookups; i++) {
+		if (!ops->lookup(lookup_ids[i]))
+			misses++;
+		cond_resched();
+	}
+	res->lookup_ns = cb_per_op(ktime_get_ns() - start, nr_lookups);
+	if (misses) {
+		PR_ERROR("%s: %lu lookups of existing ids failed\n", ops->name,
+			 misses);
+		err = -EIO;
+	}
+
+	start = ktime_get_ns();
+	if (ops->iterate(&sum))
+		res->iterate_ns = U64_MAX;
+	else
+		res->iterate_ns = cb_per_op(ktime_get_ns() - start, n);
+
+out:
+	start = ktime_get_ns();
+	for (i = 0; i < n; i++) {
+		ops->delete(&dogs[i]);
+		if (!(i % 4096))
+			cond_resched();
+	}
+	res->delete_ns = cb_per_op(ktime_get_ns() - start, n);
+
+	ops->destroy();
+	PR_DEBUG("%s %s %lu: done (%llu)\n", ops->name, cb_dist_names[res->dist],
+		 res->size, sum);
+	return err;
+}
+
+static int cb_run(void)
+{
+	struct cb_result *res = cb_results;
+	struct cb_dog *dogs = NULL;
+	struct rnd_state rnd;
+	u32 *lookup_ids;
+	unsigned long n, i;
+	unsigned int s, c;
+	enum cb_dist dist;
+	u32 seed;
+	int err = 0;
+
+	cb_nr_results = 0;
+	prandom_seed_state(&rnd, get_random_u64());
+
+	lookup_ids = kvmalloc_array(nr_lookups, sizeof(*lookup_ids), GFP_KERNEL);
+	if (!lookup_ids)
+		return -ENOMEM;
+
+	for (s = 0; s < nr_sizes; s++) {
+		n = sizes[s];
+		/* Ids must fit in 32 bits */
+		if (!n || n > U32_MAX) {
+			err = -EINVAL;
+			goto out;
+		}
+
+		/* The same entries go into every container, one after the
+		 * other */
+		kvfree(dogs);
+		dogs = kvmalloc_array(n, sizeof(*dogs), GFP_KERNEL);
+		if (!dogs) {
+			err = -ENOMEM;
+			goto out;
+		}
+
+		for (dist = 0; dist < CB_NR_DISTS; dist++) {
+			seed = prandom_u32_state(&rnd);
+			for (i = 0; i < n; i++) {
+				dogs[i].id = cb_dist_id(dist, i, seed);
+				dogs[i].age = i % 240;
+				dogs[i].training_easy = i & 1;
+			}
+			for (i = 0; i < nr_lookups; i++) {
+				lookup_ids[i] =
+					dogs[prandom_u32_state(&rnd) % n].id;
+			}
+
+			for (c = 0; c < CB_NR_CONTAINERS; c++, res++) {
+				res->container = cb_containers[c].name;
+				res->dist = dist;
+				res->size = n;
+				err = cb_run_one(&cb_containers[c], dogs, n,
+						 lookup_ids, res);
+				if (err)
+					goto out;
+				cb_nr_results++;
+			}
+		}
+	}
+
+out:
+	kvfree(dogs);
+	kvfree(lookup_ids);
+	return err;
+}
+
+/*
+ * Function called everytime the run debugfs file is written, it returns only
+ * once every size, distribution and container was measured.
+ * Example: echo 1 > /sys/kernel/debug/container-bench/run
+ */
+static ssize_t cb_run_write(struct file *file, const char __user *buf,
+			    size_t count, loff_t *ppos)
+{
+	int err;
+
+	mutex_lock(&cb_mutex);
+	err = cb_run();
+	mutex_unlock(&cb_mutex);
+
+	return err ? err : count;
+}
+
+static const struct file_operations cb_run_fops = {
+	.owner = THIS_MODULE,
+	.write = cb_run_write,
+	.llseek = noop_llseek,
+};
+
+static void cb_show_ns(struct seq_file *m, u64 ns)
+{
+	if (ns == U64_MAX)
+		seq_printf(m, " %12s", "-");
+	else
+		seq_printf(m, " %12llu", ns);
+}
+
+static int cb_results_show(struct seq_file *m, void *v)
+{
+	struct cb_result *res;
+	unsigned int i;
+
+	mutex_lock(&cb_mutex);
+	if (!cb_nr_results)
+		goto out;
+
+	seq_printf(m, "%-16s %-10s %10s %12s %12s %12s %12s\n", "container",
+		   "ids", "entries", "insert_ns", "lookup_ns", "iterate_ns",
+		   "delete_ns");
+	for (i = 0; i < cb_nr_results; i++) {
+		res = &cb_results[i];
+		seq_printf(m, "%-16s %-10s %10lu", res->container,
+			   cb_dist_names[res->dist], res->size);
+		cb_show_ns(m, res->insert_ns);
+		cb_show_ns(m, res->lookup_ns);
+		cb_show_ns(m, res->iterate_ns);
+		cb_show_ns(m, res->delete_ns);
+		seq_putc(m, '\n');
+	}
+out:
+	mutex_unlock(&cb_mutex);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(cb_results);
+
+static int __init container_bench_init(void)
+{
+	cb_debugfs = debugfs_create_dir("container-bench", NULL);
+	debugfs_create_file("run", 0200, cb_debugfs, NULL, &cb_run_fops);
+	debugfs_create_file("results", 0444, cb_debugfs, NULL,
+			    &cb_results_fops);
+
+	PR_DEBUG("module loaded\n");
+	return 0;
+}
+
+static void __exit container_bench_exit(void)
+{
+	debugfs_remove_recursive(cb_debugfs);
+	PR_DEBUG("module unloaded\n");
+}
+
+module_init(container_bench_init);
+module_exit(container_bench_exit);
+
+MODULE_AUTHOR("Bruno E. O. Meneguele <bmeneguele@gmail.com>");
+MODULE_DESCRIPTION("list_head, hlist, rbtree, xarray and maple tree benchmark");
+MODULE_LICENSE("GPL");
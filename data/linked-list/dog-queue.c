@@ -0,0 +1,335 @@
+/*
+ * Copyright (c) 2017 Bruno E. O. Meneguele <bmeneguele@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ */
+
+/*
+ * Stress test of the dog queues in dog-queue.h.
+ *
+ * At load time, each queue is fed by one producer kernel thread bound to each
+ * online CPU, plus a hrtimer producing from IRQ context, while the loading
+ * task drains it as the single consumer. Every producer tags its entries with
+ * a sequence number, so the consumer checks that the FIFO order of each
+ * producer is kept. The throughput of the whole pipeline and the mean enqueue
+ * cost seen by the producers go to the kernel log:
+ *
+ *	# insmod dog-queue.ko nr_items=100000
+ *	# dmesg | tail
+ */
+
+/* __init/exit, macros (MODULE_*) that initializes the module itself */
+#include <linux/module.h>
+/* Printing function definitions */
+#include <linux/kernel.h>
+/* Producers: a kernel thread per CPU and a timer */
+#include <linux/kthread.h>
+#include <linux/cpu.h>
+#include <linux/hrtimer.h>
+#include <linux/completion.h>
+/* Things related to memory allocation, e.g. kmalloc */
+#include <linux/slab.h>
+#include <linux/mm.h>
+/* Measurement */
+#include <linux/ktime.h>
+#include <linux/math64.h>
+
+/* Utilities file. For now there are only printing helper functions */
+#include "utils.h"
+#include "dog-queue.h"
+
+static unsigned int nr_items = 100000;
+module_param(nr_items, uint, 0444);
+MODULE_PARM_DESC(nr_items, "Entries enqueued by each producer");
+
+static unsigned int irq_period_us = 10;
+module_param(irq_period_us, uint, 0444);
+MODULE_PARM_DESC(irq_period_us, "IRQ producer period, 0 disables it");
+
+static unsigned int irq_batch = 16;
+module_param(irq_batch, uint, 0444);
+MODULE_PARM_DESC(irq_batch, "Entries enqueued by each IRQ producer run");
+
+/* The consumer gives up if nothing arrives for this long */
+#define QBENCH_TIMEOUT_NS (5 * NSEC_PER_SEC)
+
+enum qbench_mode {
+	QBENCH_LFQ,
+	QBENCH_LOCKQ,
+	QBENCH_NR_MODES,
+};
+
+static const char * const qbench_mode_names[] = {
+	[QBENCH_LFQ] = "llist",
+	[QBENCH_LOCKQ] = "spinlock",
+};
+
+/* Queued entry, tagged with its origin and position */
+struct qbench_dog {
+	struct dog dog;
+	u32 producer;
+	u32 seq;
+};
+
+struct qbench_producer {
+	struct task_struct *task;	/* NULL for the IRQ producer */
+	u32 id;
+	struct qbench_dog *pool;	/* nr_items entries */
+	u32 next;			/* next entry of the pool to enqueue */
+	u64 elapsed_ns;
+};
+
+static enum qbench_mode qbench_mode;
+static struct dog_lfq qbench_lfq;
+static struct dog_lockq qbench_lockq;
+static DECLARE_COMPLETION(qbench_start);
+
+static struct hrtimer qbench_timer;
+static struct qbench_producer *qbench_irq_producer;
+
+static void qbench_enqueue(struct qbench_producer *p)
+{
+	struct qbench_dog *qdog = &p->pool[p->next];
+
+	qdog->producer = p->id;
+	qdog->seq = p->next++;
+	qdog->dog.breed = "Golden Retriever";
+	qdog->dog.age = qdog->seq % 240;
+	qdog->dog.training_easy = qdog->seq & 1;
+
+	if (qbench_mode == QBENCH_LFQ)
+		dog_lfq_enqueue(&qbench_lfq, &qdog->dog);
+	else
+		dog_lockq_enqueue(&qbench_lockq, &qdog->dog);
+}
+
+static struct dog *qbench_dequeue(void)
+{
+	if (qbench_mode == QBENCH_LFQ)
+		return dog_lfq_dequeue(&qbench_lfq);
+	return dog_lockq_dequeue(&qbench_lockq);
+}
+
+static int qbench_thread_fn(void *arg)
+{
+	struct qbench_producer *p = arg;
+	u64 start;
+
+	wait_for_completion(&qbench_start);
+
+	start = ktime_get_ns();
+	while (p->next < nr_items) {
+		qbench_enqueue(p);
+		if (!(p->next & 0xff))
+			cond_resched();
+	}
+	p->elapsed_ns = ktime_get_ns() - start;
+
+	/* Wait to be collected by kthread_stop() */
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+/* Hard IRQ context: the queue must cope with being entered from here while a
+ * producer thread of the same CPU is in the middle of an enqueue */
+static enum hrtimer_restart qbench_timer_fn(struct hrtimer *timer)
+{
+	struct qbench_producer *p = qbench_irq_producer;
+	unsigned int i;
+	u64 start;
+
+	start = ktime_get_ns();
+	for (i = 0; i < irq_batch && p->next < nr_items; i++)
+		qbench_enqueue(p);
+	p->elapsed_ns += ktime_get_ns() - start;
+
+	if (p->next == nr_items)
+		return HRTIMER_NORESTART;
+
+	hrtimer_forward_now(timer, us_to_ktime(irq_period_us));
+	return HRTIMER_RESTART;
+}
+
+/*
+ * Drain the queue as the only consumer until every entry of every producer
+ * arrived, checking that each producer's entries come in the order they were
+ * enqueued, counting the ones out of order in 'disorders'.
+ */
+static int qbench_consume(struct qbench_producer *producers,
+			  unsigned int nproducers, unsigned long *disorders)
+{
+	unsigned long total = (unsigned long)nproducers * nr_items;
+	unsigned long received = 0, idle = 0;
+	struct qbench_dog *qdog;
+	u32 *expected;
+	u64 last = ktime_get_ns();
+	struct dog *dog;
+	int err = 0;
+
+	expected = kcalloc(nproducers, sizeof(*expected), GFP_KERNEL);
+	if (!expected)
+		return -ENOMEM;
+
+	*disorders = 0;
+	while (received < total) {
+		dog = qbench_dequeue();
+		if (!dog) {
+			cpu_relax();
+			if (++idle & 0x3ff)
+				continue;
+			cond_resched();
+			if (ktime_get_ns() - last > QBENCH_TIMEOUT_NS) {
+				PR_ERROR("%lu of %lu entries lost\n",
+					 total - received, total);
+				err = -ETIMEDOUT;
+				break;
+			}
+			continue;
+		}
+
+		qdog = container_of(dog, struct qbench_dog, dog);
+		if (qdog->seq != expected[qdog->producer]++)
+			(*disorders)++;
+		received++;
+		last = ktime_get_ns();
+	}
+
+	kfree(expected);
+	return err;
+}
+
+static int qbench_run(enum qbench_mode mode)
+{
+	struct qbench_producer *producers;
+	unsigned int nr_pools, nproducers, n = 0, i, cpu;
+	unsigned long total, disorders = 0;
+	u64 start, ns, enqueue_ns = 0;
+	int err = 0;
+
+	/* CPUs may come and go until the threads are bound, see below */
+	nr_pools = num_online_cpus() + (irq_period_us ? 1 : 0);
+	producers = kcalloc(nr_pools, sizeof(*producers), GFP_KERNEL);
+	if (!producers)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_pools; i++) {
+		producers[i].id = i;
+		producers[i].pool = kvmalloc_array(nr_items,
+						   sizeof(struct qbench_dog),
+						   GFP_KERNEL);
+		if (!producers[i].pool) {
+			err = -ENOMEM;
+			goto out_free;
+		}
+	}
+
+	qbench_mode = mode;
+	dog_lfq_init(&qbench_lfq);
+	dog_lockq_init(&qbench_lockq);
+	reinit_completion(&qbench_start);
+
+	cpus_read_lock();
+	for_each_online_cpu(cpu) {
+		struct qbench_producer *p = &producers[n];
+
+		if (n == nr_pools - (irq_period_us ? 1 : 0))
+			break;
+		p->task = kthread_create_on_node(qbench_thread_fn, p,
+						 cpu_to_node(cpu),
+						 "dog_queue/%u", cpu);
+		if (IS_ERR(p->task)) {
+			err = PTR_ERR(p->task);
+			p->task = NULL;
+			break;
+		}
+		kthread_bind(p->task, cpu);
+		wake_up_process(p->task);
+		n++;
+	}
+	cpus_read_unlock();
+
+	/* A CPU gone offline meanwhile leaves a pool unused: the timer's
+	 * producer comes right after the threads' */
+	nproducers = n + (irq_period_us ? 1 : 0);
+
+	start = ktime_get_ns();
+	complete_all(&qbench_start);
+	if (irq_period_us) {
+		qbench_irq_producer = &producers[n];
+		hrtimer_init(&qbench_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+		qbench_timer.function = qbench_timer_fn;
+		hrtimer_start(&qbench_timer, us_to_ktime(irq_period_us),
+			      HRTIMER_MODE_REL);
+	}
+
+	if (!err)
+		err = qbench_consume(producers, nproducers, &disorders);
+	ns = ktime_get_ns() - start;
+
+	if (irq_period_us)
+		hrtimer_cancel(&qbench_timer);
+	for (i = 0; i < n; i++)
+		kthread_stop(producers[i].task);
+
+	if (!err) {
+		total = (unsigned long)nproducers * nr_items;
+		for (i = 0; i < nproducers; i++)
+			enqueue_ns += producers[i].elapsed_ns;
+		PR_INFO("%s: %u producers (%u threads), %lu entries, %llu ns\n",
+			qbench_mode_names[mode], nproducers, n, total, ns);
+		PR_INFO("%s: %llu entries/sec, %llu ns per enqueue, %lu out of order\n",
+			qbench_mode_names[mode],
+			div64_u64((u64)total * NSEC_PER_SEC, ns),
+			div64_u64(enqueue_ns, total), disorders);
+		if (disorders)
+			err = -EIO;
+	}
+
+out_free:
+	for (i = 0; i < nr_pools; i++)
+		kvfree(producers[i].pool);
+	kfree(producers);
+	return err;
+}
+
+static int __init dog_queue_init(void)
+{
+	enum qbench_mode mode;
+	int err;
+
+	if (!nr_items || !irq_batch) {
+		PR_ERROR("nr_items and irq_batch must be positive\n");
+		return -EINVAL;
+	}
+
+	for (mode = 0; mode < QBENCH_NR_MODES; mode++) {
+		err = qbench_run(mode);
+		if (err) {
+			PR_ERROR("%s queue run failed: %d\n",
+				 qbench_mode_names[mode], err);
+			return err;
+		}
+	}
+
+	PR_DEBUG("module loaded\n");
+	return 0;
+}
+
+static void __exit dog_queue_exit(void)
+{
+	PR_DEBUG("module unloaded\n");
+}
+
+module_init(dog_queue_init);
+module_exit(dog_queue_exit);
+
+MODULE_AUTHOR("Bruno E. O. Meneguele <bmeneguele@gmail.com>");
+MODULE_DESCRIPTION("Lock-free vs spinlock FIFO dog queue stress test");
+MODULE_LICENSE("GPL");
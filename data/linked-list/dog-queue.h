@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2017 Bruno E. O. Meneguele <bmeneguele@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ */
+
+/*
+ * FIFO queues of dogs safe to be fed from any context, process or IRQ, by any
+ * number of producers at the same time.
+ *
+ * dog_lfq is lock-free, built on llist: producers push entries with a single
+ * cmpxchg() on the list head, which makes the list a LIFO stack. The only
+ * consumer takes the whole stack at once with an xchg(), reverses it back to
+ * arrival order and serves entries from this private list until it is empty.
+ * Being a single consumer queue (MPSC), dog_lfq_dequeue() callers must be
+ * serialized somehow, e.g. by having a single consumer thread.
+ *
+ * dog_lockq is the classic counterpart: a list_head queue (list_add_tail())
+ * protected by a spinlock, taken with interrupts disabled since producers may
+ * run in IRQ context. Any number of consumers may use it.
+ */
+
+#ifndef __DOG_QUEUE_H
+#define __DOG_QUEUE_H
+
+#include <linux/list.h>
+#include <linux/llist.h>
+#include <linux/spinlock.h>
+
+/* Same content as the linked-list.c entry, linked in either kind of queue */
+struct dog {
+	union {
+		struct list_head list;
+		struct llist_node lnode;
+	};
+	char *breed;
+	int age; /* in months */
+	bool training_easy;
+};
+
+struct dog_lfq {
+	struct llist_head in;		/* pushed by producers, newest first */
+	struct llist_node *out;		/* consumer's own, oldest first */
+};
+
+static inline void dog_lfq_init(struct dog_lfq *q)
+{
+	init_llist_head(&q->in);
+	q->out = NULL;
+}
+
+/* Any context, any number of producers */
+static inline void dog_lfq_enqueue(struct dog_lfq *q, struct dog *dog)
+{
+	llist_add(&dog->lnode, &q->in);
+}
+
+/* Single consumer only. Returns NULL if the queue is empty */
+static inline struct dog *dog_lfq_dequeue(struct dog_lfq *q)
+{
+	struct llist_node *node;
+
+	if (!q->out)
+		q->out = llist_reverse_order(llist_del_all(&q->in));
+
+	node = q->out;
+	if (!node)
+		return NULL;
+	q->out = node->next;
+	return llist_entry(node, struct dog, lnode);
+}
+
+struct dog_lockq {
+	spinlock_t lock;
+	struct list_head list;
+};
+
+static inline void dog_lockq_init(struct dog_lockq *q)
+{
+	spin_lock_init(&q->lock);
+	INIT_LIST_HEAD(&q->list);
+}
+
+static inline void dog_lockq_enqueue(struct dog_lockq *q, struct dog *dog)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&q->lock, flags);
+	list_add_tail(&dog->list, &q->list);
+	spin_unlock_irqrestore(&q->lock, flags);
+}
+
+static inline struct dog *dog_lockq_dequeue(struct dog_lockq *q)
+{
+	unsigned long flags;
+	struct dog *dog;
+
+	spin_lock_irqsave(&q->lock, flags);
+	dog = list_first_entry_or_null(&q->list, struct dog, list);
+	if (dog)
+		list_del(&dog->list);
+	spin_unlock_irqrestore(&q->lock, flags);
+	return dog;
+}
+
+#endif /* __DOG_QUEUE_H */
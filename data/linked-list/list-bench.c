@@ -0,0 +1,374 @@
+/*
+ * Copyright (c) 2017 Bruno E. O. Meneguele <bmeneguele@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ */
+
+/*
+ * Iteration cost of the classic intrusive list_head, with one kmalloc() per
+ * entry, against the unrolled list of unrolled-list.h, where entries are
+ * stored by value in arrays.
+ *
+ * At load time both layouts are filled with the same 'nr_entries' dogs and
+ * walked 'passes' times, reporting the best ns/element and the cache misses
+ * counted by perf events during that walk. Then every entry is deleted
+ * through the iteration, as in a FIFO drain. Results go to the kernel log:
+ *
+ *	# insmod list-bench.ko nr_entries=10000000
+ *	# dmesg | tail
+ *
+ * A freshly booted system hands out slab objects almost in address order, so
+ * by default the list_head entries are linked in random order ('shuffle'),
+ * mimicking a list built over time on a long running system.
+ */
+
+/* __init/exit, macros (MODULE_*) that initializes the module itself */
+#include <linux/module.h>
+/* Printing function definitions */
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/slab.h>
+/* Array of entries used to link them in random order */
+#include <linux/vmalloc.h>
+#include <linux/random.h>
+#include <linux/prandom.h>
+/* Measurement */
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/perf_event.h>
+#include <linux/sched.h>
+
+/* Utilities file. For now there are only printing helper functions */
+#include "utils.h"
+#include "unrolled-list.h"
+
+static unsigned long nr_entries = 10000000;
+module_param(nr_entries, ulong, 0444);
+MODULE_PARM_DESC(nr_entries, "Number of entries in each list");
+
+static unsigned int passes = 5;
+module_param(passes, uint, 0444);
+MODULE_PARM_DESC(passes, "Walks over each list, the best one is reported");
+
+static bool shuffle = true;
+module_param(shuffle, bool, 0444);
+MODULE_PARM_DESC(shuffle, "Link the list_head entries in random order");
+
+/* Same entry as in linked-list.c */
+struct dog {
+	struct list_head list;
+	char *breed;
+	int age; /* in months */
+	bool training_easy;
+};
+
+/* The very same data, without the links: what the unrolled list stores */
+struct dog_rec {
+	char *breed;
+	int age; /* in months */
+	bool training_easy;
+};
+
+static char *breeds[] = {
+	"Golden Retriever", "Border Collie", "Beagle", "Poodle", "Boxer",
+};
+
+/* Hardware counters read around each walk. The counters may not exist, e.g.
+ * on virtual machines without PMU emulation, in which case the numbers are
+ * simply not reported */
+enum bench_counter {
+	BENCH_CACHE_MISSES,
+	BENCH_L1D_MISSES,
+	BENCH_NR_COUNTERS,
+};
+
+static const char * const bench_counter_names[] = {
+	[BENCH_CACHE_MISSES] = "cache-misses",
+	[BENCH_L1D_MISSES] = "L1-dcache-load-misses",
+};
+
+static struct perf_event *bench_events[BENCH_NR_COUNTERS];
+
+struct bench_result {
+	u64 ns;
+	u64 counts[BENCH_NR_COUNTERS];
+	u64 sum;	/* printed, keeps the walk from being optimized out */
+};
+
+static void bench_events_create(void)
+{
+	struct perf_event_attr attr = {
+		.size = sizeof(attr),
+		.disabled = 1,
+		.exclude_hv = 1,
+		.exclude_idle = 1,
+	};
+	struct perf_event *event;
+	int i;
+
+	for (i = 0; i < BENCH_NR_COUNTERS; i++) {
+		if (i == BENCH_CACHE_MISSES) {
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = PERF_COUNT_HW_CACHE_MISSES;
+		} else {
+			attr.type = PERF_TYPE_HW_CACHE;
+			attr.config = PERF_COUNT_HW_CACHE_L1D |
+				(PERF_COUNT_HW_CACHE_OP_READ << 8) |
+				(PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		}
+
+		/* Counting the current task only, on whatever CPU it runs */
+		event = perf_event_create_kernel_counter(&attr, -1, current,
+							 NULL, NULL);
+		if (IS_ERR(event)) {
+			PR_INFO("%s counter not available: %ld\n",
+				bench_counter_names[i], PTR_ERR(event));
+			event = NULL;
+		}
+		bench_events[i] = event;
+	}
+}
+
+static void bench_events_release(void)
+{
+	int i;
+
+	for (i = 0; i < BENCH_NR_COUNTERS; i++) {
+		if (bench_events[i])
+			perf_event_release_kernel(bench_events[i]);
+		bench_events[i] = NULL;
+	}
+}
+
+static void bench_events_start(void)
+{
+	int i;
+
+	for (i = 0; i < BENCH_NR_COUNTERS; i++) {
+		if (bench_events[i])
+			perf_event_enable(bench_events[i]);
+	}
+}
+
+static void bench_events_stop(struct bench_result *res)
+{
+	u64 enabled, running;
+	int i;
+
+	for (i = 0; i < BENCH_NR_COUNTERS; i++) {
+		if (!bench_events[i])
+			continue;
+		perf_event_disable(bench_events[i]);
+		res->counts[i] = perf_event_read_value(bench_events[i],
+						       &enabled, &running);
+	}
+}
+
+/*
+ * Walk timing: counters are enabled right before and disabled right after the
+ * walk, and their values accumulated since creation, so the count of each
+ * walk is the difference between two reads.
+ */
+#define BENCH_WALK(res, walk)						\
+	do {								\
+		struct bench_result __before = { 0 };			\
+		u64 __start;						\
+		int __i;						\
+									\
+		bench_events_stop(&__before);				\
+		bench_events_start();					\
+		__start = ktime_get_ns();				\
+		walk;							\
+		(res)->ns = ktime_get_ns() - __start;			\
+		bench_events_stop(res);					\
+		for (__i = 0; __i < BENCH_NR_COUNTERS; __i++)		\
+			(res)->counts[__i] -= __before.counts[__i];	\
+	} while (0)
+
+static void bench_keep_best(struct bench_result *best, struct bench_result *res)
+{
+	if (!best->ns || res->ns < best->ns)
+		*best = *res;
+}
+
+static void bench_report(const char *name, struct bench_result *res,
+			 unsigned long n)
+{
+	int i;
+
+	PR_INFO("%s: %lu entries, %llu ns, %llu.%03llu ns/element\n", name, n,
+		res->ns, div64_u64(res->ns, n),
+		div64_u64(res->ns * 1000, n) % 1000);
+	/* Both walks sum the same ages: equal checksums, same work */
+	PR_INFO("%s: checksum %llu\n", name, res->sum);
+	for (i = 0; i < BENCH_NR_COUNTERS; i++) {
+		if (!bench_events[i])
+			continue;
+		PR_INFO("%s: %llu %s, %llu per 1000 elements\n", name,
+			res->counts[i], bench_counter_names[i],
+			div64_u64(res->counts[i] * 1000, n));
+	}
+}
+
+static void dog_fill(unsigned long i, char **breed, int *age,
+		     bool *training_easy)
+{
+	*breed = breeds[i % ARRAY_SIZE(breeds)];
+	*age = i % 240;
+	*training_easy = i & 1;
+}
+
+static int bench_list_head(void)
+{
+	struct bench_result res, best = { 0 };
+	struct dog **dogs, *entry, *tmp;
+	struct rnd_state rnd;
+	LIST_HEAD(dog_list);
+	unsigned long i, j, n = 0;
+	unsigned int pass;
+	u64 start;
+
+	/* Every entry is allocated first and then linked in the list, in
+	 * allocation order or shuffled */
+	dogs = vmalloc(array_size(nr_entries, sizeof(*dogs)));
+	if (!dogs)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_entries; i++) {
+		dogs[i] = kmalloc(sizeof(struct dog), GFP_KERNEL);
+		if (!dogs[i])
+			goto free_entries;
+		dog_fill(i, &dogs[i]->breed, &dogs[i]->age,
+			 &dogs[i]->training_easy);
+		cond_resched();
+	}
+
+	if (shuffle) {
+		/* Fisher-Yates */
+		prandom_seed_state(&rnd, get_random_u64());
+		for (i = nr_entries - 1; i > 0; i--) {
+			j = prandom_u32_state(&rnd) % (i + 1);
+			swap(dogs[i], dogs[j]);
+		}
+	}
+
+	for (i = 0; i < nr_entries; i++)
+		list_add_tail(&dogs[i]->list, &dog_list);
+	vfree(dogs);
+
+	for (pass = 0; pass < passes; pass++) {
+		res.sum = 0;
+		BENCH_WALK(&res, list_for_each_entry(entry, &dog_list, list)
+				res.sum += entry->age);
+		bench_keep_best(&best, &res);
+		cond_resched();
+	}
+	bench_report("list_head walk", &best, nr_entries);
+
+	/* FIFO drain, entries removed (and released) from the head */
+	start = ktime_get_ns();
+	list_for_each_entry_safe(entry, tmp, &dog_list, list) {
+		list_del(&entry->list);
+		kfree(entry);
+		if (!(++n % 4096))
+			cond_resched();
+	}
+	PR_INFO("list_head delete: %llu ns/element\n",
+		div64_u64(ktime_get_ns() - start, nr_entries));
+	return 0;
+
+free_entries:
+	while (i--)
+		kfree(dogs[i]);
+	vfree(dogs);
+	return -ENOMEM;
+}
+
+static int bench_unrolled(void)
+{
+	struct bench_result res, best = { 0 };
+	struct ulist_head dogs;
+	struct ulist_iter it;
+	struct dog_rec *entry;
+	unsigned long i;
+	unsigned int pass;
+	u64 start;
+	int ret;
+
+	ret = ulist_init(&dogs, sizeof(struct dog_rec));
+	if (ret)
+		return ret;
+	for (i = 0; i < nr_entries; i++) {
+		entry = ulist_add_tail(&dogs, GFP_KERNEL);
+		if (!entry) {
+			ulist_destroy(&dogs);
+			return -ENOMEM;
+		}
+		dog_fill(i, &entry->breed, &entry->age, &entry->training_easy);
+		cond_resched();
+	}
+
+	for (pass = 0; pass < passes; pass++) {
+		res.sum = 0;
+		BENCH_WALK(&res, ulist_for_each_entry(entry, &it, &dogs)
+				res.sum += entry->age);
+		bench_keep_best(&best, &res);
+		cond_resched();
+	}
+	bench_report("unrolled walk", &best, nr_entries);
+	PR_INFO("unrolled: %u entries per %d bytes node\n", dogs.per_node,
+		ULIST_NODE_BYTES);
+
+	/* FIFO drain through the iteration, as list_del() does above */
+	start = ktime_get_ns();
+	ulist_for_each_entry(entry, &it, &dogs) {
+		ulist_del(&dogs, &it);
+		if (!(dogs.count % 4096))
+			cond_resched();
+	}
+	PR_INFO("unrolled delete: %llu ns/element\n",
+		div64_u64(ktime_get_ns() - start, nr_entries));
+	return 0;
+}
+
+static int __init list_bench_init(void)
+{
+	int ret;
+
+	if (!nr_entries || !passes) {
+		PR_ERROR("nr_entries and passes must be positive\n");
+		return -EINVAL;
+	}
+
+	bench_events_create();
+
+	ret = bench_list_head();
+	if (ret) {
+		PR_ERROR("list_head benchmark failed: %d\n", ret);
+		goto out;
+	}
+
+	ret = bench_unrolled();
+	if (ret)
+		PR_ERROR("unrolled benchmark failed: %d\n", ret);
+
+out:
+	bench_events_release();
+	if (!ret)
+		PR_DEBUG("module loaded\n");
+	return ret;
+}
+
+static void __exit list_bench_exit(void)
+{
+	PR_DEBUG("module unloaded\n");
+}
+
+module_init(list_bench_init);
+module_exit(list_bench_exit);
+
+MODULE_AUTHOR("Bruno E. O. Meneguele <bmeneguele@gmail.com>");
+MODULE_DESCRIPTION("list_head vs unrolled list iteration benchmark");
+MODULE_LICENSE("GPL");
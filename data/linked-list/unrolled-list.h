@@ -0,0 +1,176 @@
+/*
+ * Copyright (c) 2017 Bruno E. O. Meneguele <bmeneguele@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ */
+
+/*
+ * Unrolled linked list: instead of one node (and one allocation) per entry,
+ * each node holds a small array of entries stored by value. Walking the list
+ * then reads contiguous memory most of the time, which the CPU prefetchers
+ * love, and only follows a pointer once per node. The price is that entries
+ * move around when others are deleted, so no pointer to an entry may be kept
+ * across a deletion.
+ *
+ * The API mirrors the list_head usage in linked-list.c:
+ *
+ *	list_add_tail(&dog->list, &dog_list)	->  dog = ulist_add_tail(&dogs)
+ *	list_for_each_entry(dog, &dog_list, ..)	->  ulist_for_each_entry(dog, &it,
+ *								 &dogs)
+ *	list_del(&dog->list)			->  ulist_del(&dogs, &it)
+ */
+
+#ifndef __UNROLLED_LIST_H
+#define __UNROLLED_LIST_H
+
+#include <linux/bug.h>
+#include <linux/list.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+/* Whole node size, header included. A few cache lines: large enough to make
+ * the pointer chasing rare, small enough to keep the memmove() of a deletion
+ * cheap */
+#define ULIST_NODE_BYTES 512
+
+struct ulist_node {
+	struct list_head list;
+	unsigned int nr;	/* entries in use, always packed at the start */
+	char data[] __aligned(sizeof(long));
+};
+
+struct ulist_head {
+	struct list_head nodes;
+	size_t elem_size;
+	unsigned int per_node;	/* entries fitting in a node */
+	unsigned long count;
+};
+
+/* Position of an iteration. 'deleted' means the entry at the position was just
+ * removed, so the next step must not move forward */
+struct ulist_iter {
+	struct ulist_node *node;
+	unsigned int idx;
+	bool deleted;
+};
+
+#define ULIST_PER_NODE(size) \
+	((ULIST_NODE_BYTES - sizeof(struct ulist_node)) / (size))
+
+/* Fails with -EINVAL for entries too big to fit a node even alone */
+static inline int ulist_init(struct ulist_head *head, size_t elem_size)
+{
+	if (WARN_ON(!elem_size || !ULIST_PER_NODE(elem_size)))
+		return -EINVAL;
+
+	INIT_LIST_HEAD(&head->nodes);
+	head->elem_size = elem_size;
+	head->per_node = ULIST_PER_NODE(elem_size);
+	head->count = 0;
+	return 0;
+}
+
+static inline void *ulist_elem(struct ulist_head *head, struct ulist_node *node,
+			       unsigned int idx)
+{
+	return node->data + idx * head->elem_size;
+}
+
+/*
+ * Reserve a new entry at the tail of the list and return it to be filled in
+ * by the caller, or NULL if a new node was needed but couldn't be allocated.
+ */
+static inline void *ulist_add_tail(struct ulist_head *head, gfp_t gfp)
+{
+	struct ulist_node *node;
+
+	node = list_last_entry_or_null(&head->nodes, struct ulist_node, list);
+	if (!node || node->nr == head->per_node) {
+		node = kmalloc(ULIST_NODE_BYTES, gfp);
+		if (!node)
+			return NULL;
+		node->nr = 0;
+		list_add_tail(&node->list, &head->nodes);
+	}
+
+	head->count++;
+	return ulist_elem(head, node, node->nr++);
+}
+
+/* Entry at the iterator position, NULL at the end of the list */
+static inline void *ulist_iter_entry(struct ulist_head *head,
+				     struct ulist_iter *it)
+{
+	if (&it->node->list == &head->nodes)
+		return NULL;
+	return ulist_elem(head, it->node, it->idx);
+}
+
+static inline void *ulist_first(struct ulist_head *head, struct ulist_iter *it)
+{
+	it->node = list_first_entry(&head->nodes, struct ulist_node, list);
+	it->idx = 0;
+	it->deleted = false;
+	return ulist_iter_entry(head, it);
+}
+
+static inline void *ulist_next(struct ulist_head *head, struct ulist_iter *it)
+{
+	if (it->deleted)
+		it->deleted = false;
+	else if (++it->idx == it->node->nr) {
+		it->node = list_next_entry(it->node, list);
+		it->idx = 0;
+	}
+	return ulist_iter_entry(head, it);
+}
+
+/* Nodes are never left empty, thus only the end of the list is checked */
+#define ulist_for_each_entry(entry, it, head)				\
+	for (entry = ulist_first(head, it); entry;			\
+	     entry = ulist_next(head, it))
+
+/*
+ * Remove the entry at the iterator position, keeping the FIFO order: the
+ * following entries of the node are moved down a slot and an emptied node is
+ * released. The iteration can go on right after it.
+ */
+static inline void ulist_del(struct ulist_head *head, struct ulist_iter *it)
+{
+	struct ulist_node *node = it->node;
+
+	node->nr--;
+	head->count--;
+	it->deleted = true;
+
+	if (!node->nr) {
+		it->node = list_next_entry(node, list);
+		it->idx = 0;
+		list_del(&node->list);
+		kfree(node);
+		return;
+	}
+
+	memmove(ulist_elem(head, node, it->idx),
+		ulist_elem(head, node, it->idx + 1),
+		(node->nr - it->idx) * head->elem_size);
+	if (it->idx == node->nr) {
+		it->node = list_next_entry(node, list);
+		it->idx = 0;
+	}
+}
+
+/* Release all nodes at once, entries have nothing to be released on their own */
+static inline void ulist_destroy(struct ulist_head *head)
+{
+	struct ulist_node *node, *tmp;
+
+	list_for_each_entry_safe(node, tmp, &head->nodes, list)
+		kfree(node);
+	INIT_LIST_HEAD(&head->nodes);
+	head->count = 0;
+}
+
+#endif /* __UNROLLED_LIST_H */
@@ -6,36 +6,625 @@
  * Free Software Foundation.
  */
 
+/*
+ * Events travel in two steps. The hard IRQ handler does the least it can: it
+ * takes a timestamp, reads the scancode from the i8042 data port and pushes
+ * both into a ring of its own CPU, with no lock at all. Each ring has a single
+ * producer, the handler running on that CPU, and a single consumer, the IRQ
+ * thread, which merges the rings back in time order, translates scancodes to
+ * key codes and reports every key it found with a single input_sync().
+ *
+ * The data port is read only with own_port=1: a byte read from it is gone, so
+ * doing it while the i8042 driver also handles the line steals its input. To
+ * test the whole path under QEMU, boot a kernel with the i8042 driver built as
+ * a module and not loaded, then:
+ *
+ *	# insmod my-kbd.ko irq=1 own_port=1
+ *	(qemu) sendkey a
+ *
+ * evdev stamps the events with the time taken in the hard IRQ handler, thus a
+ * reader comparing it against its own clock sees the IRQ-to-event latency.
+ *
+ * /sys/kernel/debug/my-kbd/stats shows, live, the IRQs taken by each CPU, the
+ * rate since the last read, and histograms of the hard handler duration and of
+ * the latency from the IRQ to the event being handed to the input core, the
+ * point where evdev readers are woken up. The counters are per-CPU and only
+ * summed up by the reader, the handler takes no lock nor atomic to update them.
+ *
+ * Every input_sync() wakes the evdev readers up. At high rates the keys can be
+ * coalesced into fewer, bigger frames, tuned at runtime through
+ * /sys/module/my_kbd/parameters/:
+ *
+ *	coalesce_max	sync once that many keys are pending, 1 syncs every
+ *			single key, 0 puts no bound
+ *	coalesce_us	hold keys for up to that long since the oldest pending
+ *			one, across IRQs, a timer syncing them at the end of the
+ *			window; with 0 whatever is pending is synced as soon as
+ *			the rings are drained
+ *
+ * The stats file shows the keys per sync and the IRQ thread time per key.
+ *
+ * Load can be generated with no keyboard at all: writing N to the debugfs
+ * inject file makes an hrtimer push N scancodes, at inject_rate per second,
+ * into the rings just as the hard IRQ handler does, waking the same IRQ thread
+ * up. With inject_only=1 no IRQ is requested, a kernel thread drains the rings
+ * instead. Shift presses and releases are injected, the console doesn't print
+ * them. Reading the file shows the progress and the rate achieved: the
+ * injector never overflows the rings, it lags behind instead. run.sh drives it
+ * together with userspace/kbd-latency.c, which measures delivery latency.
+ */
+
 #include <linux/init.h>
 #include <linux/module.h>
 #include <linux/input.h>
 #include <linux/interrupt.h>
+#include <linux/percpu.h>
+#include <linux/ktime.h>
+#include <linux/io.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/hrtimer.h>
+#include <linux/spinlock.h>
+#include <linux/kthread.h>
+#include <linux/mutex.h>
+#include <linux/math64.h>
 
 #include "utils.h"
+#include "pak-common.h"
 
 #define KBD_IRQN 12
 
+/* i8042 ports and status bits */
+#define KBD_DATA_PORT 0x60
+#define KBD_STATUS_PORT 0x64
+#define KBD_STATUS_OBF 0x01
+#define KBD_STATUS_AUXDATA 0x20
+
+/* Scancode set 1, as the i8042 translates to by default */
+#define KBD_SC_EXTENDED 0xe0
+#define KBD_SC_BREAK 0x80
+
+/* Events per CPU ring, a power of two */
+#define KBD_RING_SIZE 1024
+
+/* The injector pushes the scancodes due once per period */
+#define KBD_INJECT_PERIOD_NS (50 * NSEC_PER_USEC)
+
+/* log2 buckets of ns, the last one takes everything above ~1s */
+#define KBD_HIST_BUCKETS 32
+
+static int irq = KBD_IRQN;
+module_param(irq, int, 0444);
+MODULE_PARM_DESC(irq, "IRQ line to share (default: 12)");
+
+static bool own_port;
+module_param(own_port, bool, 0444);
+MODULE_PARM_DESC(own_port, "Read scancodes from the i8042 data port, only if "
+		 "no other driver does (default: 0)");
+
+static unsigned int coalesce_max;
+module_param(coalesce_max, uint, 0644);
+MODULE_PARM_DESC(coalesce_max, "Keys pending before a sync, 0 for no bound "
+		 "(default: 0)");
+
+static unsigned int coalesce_us;
+module_param(coalesce_us, uint, 0644);
+MODULE_PARM_DESC(coalesce_us, "Time window to coalesce keys in, 0 syncs once "
+		 "the rings are drained (default: 0)");
+
+static bool inject_only;
+module_param(inject_only, bool, 0444);
+MODULE_PARM_DESC(inject_only, "Don't request the IRQ, only injected events are "
+		 "handled (default: 0)");
+
+static unsigned long inject_rate = 100000;
+module_param(inject_rate, ulong, 0644);
+MODULE_PARM_DESC(inject_rate, "Events injected per second (default: 100000)");
+
+struct kbd_event {
+	u64 ts;			/* ns, taken in the hard IRQ handler */
+	u8 scancode;
+};
+
+/*
+ * 'head' is only written by the producer and 'tail' only by the consumer,
+ * both free running: they're kept apart to not bounce a cache line between
+ * the two at every event.
+ */
+struct kbd_ring {
+	unsigned int head ____cacheline_aligned;
+	unsigned int tail ____cacheline_aligned;
+	struct kbd_event events[KBD_RING_SIZE];
+};
+
+/* Only ever updated by their own CPU */
+struct kbd_stats {
+	unsigned long irqs;
+	unsigned long dropped;		/* ring full */
+	unsigned long injected;
+	unsigned long reported;		/* key events */
+	unsigned long syncs;		/* input_sync() calls */
+	u64 thread_ns;			/* spent draining the rings */
+	unsigned long handler_hist[KBD_HIST_BUCKETS];
+	unsigned long latency_hist[KBD_HIST_BUCKETS];
+};
+
+/* Allocated, too big for the per-CPU area reserved to modules */
+static struct kbd_ring __percpu *kbd_rings;
+static DEFINE_PER_CPU(struct kbd_stats, kbd_stats);
+
+/*
+ * The frame being built: keys reported to the input core but not synced yet.
+ * The IRQ thread adds to it, the thread itself or the timer syncs it.
+ */
+static struct {
+	spinlock_t lock;
+	unsigned int pending;
+	u64 first_ts;		/* of the oldest pending key */
+	struct hrtimer timer;
+} kbd_frame = {
+	.lock = __SPIN_LOCK_UNLOCKED(kbd_frame.lock),
+};
+
+/* A run of the injector, started and stopped through debugfs */
+static struct {
+	struct hrtimer timer;
+	u64 start;
+	u64 end;		/* of the last run, 0 while running */
+	u64 nr;			/* events to inject */
+	u64 done;
+	u64 rate;
+} kbd_inject;
+static DEFINE_MUTEX(kbd_inject_lock);
+
 static struct input_dev *kbd_dev;
-static volatile int irq_ref_count = 0;
+static struct task_struct *kbd_drain_task;	/* with inject_only */
+static struct dentry *kbd_debugfs;
+static u64 kbd_load_ts;
 
-static irqreturn_t kbd_irq_handler(int irq, void *dev)
+/* The IRQ count, also under /sys/kernel/debug/playing-around/my_kbd/ with
+ * PAK_COMMON=1, next to the other modules' stats */
+static struct pak_stats *kbd_pak_stats;
+static struct pak_stat *kbd_pak_irqs;
+
+/*
+ * Key codes of the extended (0xe0 prefixed) scancodes. The plain ones need no
+ * table: Linux key codes were laid out after them, thus KEY_ESC is 1, KEY_A is
+ * 0x1e and so on up to KEY_F12.
+ */
+static const unsigned short kbd_extended_keymap[128] = {
+	[0x1c] = KEY_KPENTER,
+	[0x1d] = KEY_RIGHTCTRL,
+	[0x35] = KEY_KPSLASH,
+	[0x38] = KEY_RIGHTALT,
+	[0x47] = KEY_HOME,
+	[0x48] = KEY_UP,
+	[0x49] = KEY_PAGEUP,
+	[0x4b] = KEY_LEFT,
+	[0x4d] = KEY_RIGHT,
+	[0x4f] = KEY_END,
+	[0x50] = KEY_DOWN,
+	[0x51] = KEY_PAGEDOWN,
+	[0x52] = KEY_INSERT,
+	[0x53] = KEY_DELETE,
+	[0x5b] = KEY_LEFTMETA,
+	[0x5c] = KEY_RIGHTMETA,
+	[0x5d] = KEY_COMPOSE,
+};
+
+/* Set by a 0xe0 prefix, for the scancode right after it */
+static bool kbd_extended;
+
+static unsigned int kbd_translate(u8 scancode, bool *pressed)
 {
-	irq_ref_count++;
+	unsigned int code = scancode & ~KBD_SC_BREAK;
+	bool extended = kbd_extended;
+
+	if (scancode == KBD_SC_EXTENDED) {
+		kbd_extended = true;
+		return KEY_RESERVED;
+	}
+
+	kbd_extended = false;
+	*pressed = !(scancode & KBD_SC_BREAK);
+	if (extended)
+		return kbd_extended_keymap[code];
+	return code <= KEY_F12 ? code : KEY_RESERVED;
+}
+
+static bool kbd_ring_full(struct kbd_ring *ring)
+{
+	return ring->head - smp_load_acquire(&ring->tail) >= KBD_RING_SIZE;
+}
+
+/*
+ * Producer side, hard IRQ context: interrupts are disabled, thus nothing else
+ * pushes into this CPU's ring meanwhile. Returns false if the ring is full.
+ */
+static bool kbd_push(u8 scancode, u64 ts)
+{
+	struct kbd_ring *ring = this_cpu_ptr(kbd_rings);
+	unsigned int head = ring->head;
+	struct kbd_event *ev;
+
+	if (kbd_ring_full(ring)) {
+		__this_cpu_inc(kbd_stats.dropped);
+		return false;
+	}
+
+	ev = &ring->events[head & (KBD_RING_SIZE - 1)];
+	ev->ts = ts;
+	ev->scancode = scancode;
+	/* Publish the event before the new head */
+	smp_store_release(&ring->head, head + 1);
+	return true;
+}
+
+/*
+ * Consumer side: the oldest event among all rings. The same IRQ may be routed
+ * to another CPU between two key strokes, thus events are merged back in the
+ * order they happened, otherwise a 0xe0 prefix could be taken apart from its
+ * scancode.
+ */
+static struct kbd_ring *kbd_oldest(void)
+{
+	struct kbd_ring *ring, *oldest = NULL;
+	u64 oldest_ts = U64_MAX;
+	struct kbd_event *ev;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		ring = per_cpu_ptr(kbd_rings, cpu);
+		if (smp_load_acquire(&ring->head) == ring->tail)
+			continue;
+
+		ev = &ring->events[ring->tail & (KBD_RING_SIZE - 1)];
+		if (ev->ts < oldest_ts) {
+			oldest_ts = ev->ts;
+			oldest = ring;
+		}
+	}
+
+	return oldest;
+}
+
+static unsigned int kbd_bucket(u64 ns)
+{
+	return pak_hist_bucket(ns, KBD_HIST_BUCKETS);
+}
+
+/* Called with kbd_frame.lock held */
+static void kbd_sync(void)
+{
+	if (!kbd_frame.pending)
+		return;
+
+	input_sync(kbd_dev);
+	/* The frame's oldest key is also the one which waited the most */
+	this_cpu_inc(kbd_stats.latency_hist[kbd_bucket(ktime_get_ns() -
+						       kbd_frame.first_ts)]);
+	this_cpu_inc(kbd_stats.syncs);
+	kbd_frame.pending = 0;
+}
+
+static enum hrtimer_restart kbd_frame_timer_fn(struct hrtimer *timer)
+{
+	spin_lock(&kbd_frame.lock);
+	kbd_sync();
+	spin_unlock(&kbd_frame.lock);
+	return HRTIMER_NORESTART;
+}
+
+static void kbd_report(unsigned int code, bool pressed, u64 ts)
+{
+	unsigned int max = READ_ONCE(coalesce_max);
+
+	spin_lock_bh(&kbd_frame.lock);
+	/* The whole frame is stamped with its oldest key */
+	if (!kbd_frame.pending++) {
+		kbd_frame.first_ts = ts;
+		input_set_timestamp(kbd_dev, ns_to_ktime(ts));
+	}
+	input_report_key(kbd_dev, code, pressed);
+	if (max && kbd_frame.pending >= max)
+		kbd_sync();
+	spin_unlock_bh(&kbd_frame.lock);
+}
+
+/* Once the rings are drained: sync now or by the end of the window */
+static void kbd_frame_end(void)
+{
+	unsigned int window = READ_ONCE(coalesce_us);
+
+	spin_lock_bh(&kbd_frame.lock);
+	if (!window)
+		kbd_sync();
+	else if (kbd_frame.pending && !hrtimer_is_queued(&kbd_frame.timer))
+		/* A timer left from an earlier frame only syncs this one
+		 * sooner, never later */
+		hrtimer_start(&kbd_frame.timer,
+			      ns_to_ktime(kbd_frame.first_ts +
+					  (u64)window * NSEC_PER_USEC),
+			      HRTIMER_MODE_ABS_SOFT);
+	spin_unlock_bh(&kbd_frame.lock);
+}
+
+/*
+ * Runs in the IRQ thread, or in kbd_drain_task with inject_only, never
+ * concurrently with itself: the one consumer of every ring.
+ */
+static void kbd_drain(void)
+{
+	struct kbd_ring *ring;
+	struct kbd_event ev;
+	unsigned int code, nr = 0;
+	u64 start = ktime_get_ns();
+	bool pressed;
+
+	while ((ring = kbd_oldest())) {
+		ev = ring->events[ring->tail & (KBD_RING_SIZE - 1)];
+		/* The slot may be reused once the tail moves on */
+		smp_store_release(&ring->tail, ring->tail + 1);
+
+		code = kbd_translate(ev.scancode, &pressed);
+		if (code == KEY_RESERVED)
+			continue;
+
+		kbd_report(code, pressed, ev.ts);
+		nr++;
+	}
+
+	kbd_frame_end();
+	this_cpu_add(kbd_stats.reported, nr);
+	this_cpu_add(kbd_stats.thread_ns, ktime_get_ns() - start);
+}
+
+static irqreturn_t kbd_irq_thread(int irq, void *dev)
+{
+	kbd_drain();
 	return IRQ_HANDLED;
 }
 
+static int kbd_drain_fn(void *arg)
+{
+	while (!kthread_should_stop()) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		/* kthread_stop() may have come since the loop's check, and
+		 * nothing would wake us up after it */
+		if (!kbd_oldest() && !kthread_should_stop())
+			schedule();
+		__set_current_state(TASK_RUNNING);
+		kbd_drain();
+	}
+	return 0;
+}
+
+/* Run the consumer, as an IRQ would */
+static void kbd_kick(void)
+{
+	if (inject_only)
+		wake_up_process(kbd_drain_task);
+	else
+		irq_wake_thread(irq, kbd_dev);
+}
+
+/*
+ * Hard IRQ context as well. Scancodes pushed so far follow the rate since the
+ * start, thus a late timer makes up for it in the next burst.
+ */
+static enum hrtimer_restart kbd_inject_timer_fn(struct hrtimer *timer)
+{
+	static const u8 keys[] = { 0x2a, 0x36 };	/* left and right shift */
+	struct kbd_ring *ring = this_cpu_ptr(kbd_rings);
+	u64 now = ktime_get_ns(), due, done = kbd_inject.done;
+	u8 sc;
+
+	due = min(kbd_inject.nr, mul_u64_u64_div_u64(now - kbd_inject.start,
+						     kbd_inject.rate,
+						     NSEC_PER_SEC));
+	for (; done < due && !kbd_ring_full(ring); done++) {
+		/* Press and release each key in turn */
+		sc = keys[(done >> 1) % ARRAY_SIZE(keys)];
+		kbd_push(done & 1 ? sc | KBD_SC_BREAK : sc, now);
+	}
+
+	__this_cpu_add(kbd_stats.injected, done - kbd_inject.done);
+	WRITE_ONCE(kbd_inject.done, done);
+	kbd_kick();
+
+	if (done == kbd_inject.nr) {
+		WRITE_ONCE(kbd_inject.end, now);
+		return HRTIMER_NORESTART;
+	}
+	hrtimer_forward_now(timer, ns_to_ktime(KBD_INJECT_PERIOD_NS));
+	return HRTIMER_RESTART;
+}
+
+static void kbd_inject_stop(void)
+{
+	hrtimer_cancel(&kbd_inject.timer);
+	if (kbd_inject.start && !kbd_inject.end)
+		kbd_inject.end = ktime_get_ns();
+}
+
+/*
+ * Writing N injects N events at inject_rate, stopping a run in progress, 0
+ * only stops it.
+ * Example: echo 1000000 > /sys/kernel/debug/my-kbd/inject
+ */
+static ssize_t kbd_inject_write(struct file *file, const char __user *ubuf,
+				size_t count, loff_t *ppos)
+{
+	u64 nr, rate = READ_ONCE(inject_rate);
+	int err;
+
+	err = kstrtoull_from_user(ubuf, count, 0, &nr);
+	if (err)
+		return err;
+	if (nr && !rate)
+		return -EINVAL;
+
+	mutex_lock(&kbd_inject_lock);
+	kbd_inject_stop();
+	if (nr) {
+		kbd_inject.nr = nr;
+		kbd_inject.rate = rate;
+		kbd_inject.done = 0;
+		kbd_inject.end = 0;
+		kbd_inject.start = ktime_get_ns();
+		hrtimer_start(&kbd_inject.timer, 0, HRTIMER_MODE_REL_HARD);
+	}
+	mutex_unlock(&kbd_inject_lock);
+
+	return count;
+}
+
+static int kbd_inject_show(struct seq_file *m, void *v)
+{
+	const char *state = "idle";
+	u64 done, end, rate = 0;
+
+	mutex_lock(&kbd_inject_lock);
+	done = READ_ONCE(kbd_inject.done);
+	end = READ_ONCE(kbd_inject.end);
+	if (kbd_inject.start) {
+		state = end ? "stopped" : "running";
+		rate = div64_u64(done * NSEC_PER_SEC,
+				 ((end ?: ktime_get_ns()) - kbd_inject.start) | 1);
+	}
+	seq_printf(m, "%s: %llu/%llu events, asked %llu/s, achieved %llu/s\n",
+		   state, done, kbd_inject.nr, kbd_inject.rate, rate);
+	mutex_unlock(&kbd_inject_lock);
+	return 0;
+}
+
+static int kbd_inject_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, kbd_inject_show, NULL);
+}
+
+static const struct file_operations kbd_inject_fops = {
+	.owner = THIS_MODULE,
+	.open = kbd_inject_open,
+	.read = seq_read,
+	.write = kbd_inject_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static irqreturn_t kbd_irq_handler(int irq, void *dev)
+{
+	u64 ts = ktime_get_ns();
+	irqreturn_t ret = IRQ_NONE;
+	u8 status;
+
+	__this_cpu_inc(kbd_stats.irqs);
+	pak_stat_inc(kbd_pak_irqs);
+	/* Mouse bytes are left in the port for the AUX port's driver. Nothing
+	 * read, nothing handled: the line is shared, and an IRQ no handler
+	 * owns up to must still be noticed by the spurious IRQ detection */
+	if (own_port) {
+		status = inb(KBD_STATUS_PORT);
+		if ((status & KBD_STATUS_OBF) &&
+		    !(status & KBD_STATUS_AUXDATA)) {
+			/* Even with a full ring the thread has to run, to
+			 * drain it */
+			kbd_push(inb(KBD_DATA_PORT), ts);
+			ret = IRQ_WAKE_THREAD;
+		}
+	}
+
+	__this_cpu_inc(kbd_stats.handler_hist[kbd_bucket(ktime_get_ns() - ts)]);
+	return ret;
+}
+
+static int kbd_stats_show(struct seq_file *m, void *v)
+{
+	static u64 last_ts;
+	static unsigned long last_irqs;
+	unsigned long handler_hist[KBD_HIST_BUCKETS] = { 0 };
+	unsigned long latency_hist[KBD_HIST_BUCKETS] = { 0 };
+	unsigned long irqs = 0, dropped = 0, reported = 0, syncs = 0;
+	unsigned long injected = 0;
+	u64 now = ktime_get_ns(), since, thread_ns = 0;
+	struct kbd_stats *st;
+	unsigned int i;
+	int cpu;
+
+	/* Counters are read while being updated, a sample may be off by one */
+	seq_puts(m, "cpu irqs\n");
+	for_each_possible_cpu(cpu) {
+		st = per_cpu_ptr(&kbd_stats, cpu);
+		if (READ_ONCE(st->irqs))
+			seq_printf(m, "%3d %lu\n", cpu, READ_ONCE(st->irqs));
+
+		irqs += READ_ONCE(st->irqs);
+		dropped += READ_ONCE(st->dropped);
+		injected += READ_ONCE(st->injected);
+		reported += READ_ONCE(st->reported);
+		syncs += READ_ONCE(st->syncs);
+		thread_ns += READ_ONCE(st->thread_ns);
+		for (i = 0; i < KBD_HIST_BUCKETS; i++) {
+			handler_hist[i] += READ_ONCE(st->handler_hist[i]);
+			latency_hist[i] += READ_ONCE(st->latency_hist[i]);
+		}
+	}
+
+	/* Concurrent readers share the last sample, only the rate suffers */
+	since = now - (last_ts ?: kbd_load_ts);
+	seq_printf(m, "irqs: %lu (%llu/s since the last read)\n", irqs,
+		   div64_u64((u64)(irqs - last_irqs) * NSEC_PER_SEC, since | 1));
+	seq_printf(m, "injected: %lu\n", injected);
+	seq_printf(m, "keys reported: %lu, input_sync: %lu, dropped: %lu\n",
+		   reported, syncs, dropped);
+	seq_printf(m, "keys per sync: %lu, thread ns per key: %llu\n",
+		   reported / (syncs ?: 1), div64_u64(thread_ns, reported ?: 1));
+	seq_puts(m, "hard handler, ns:\n");
+	pak_hist_show(m, handler_hist, KBD_HIST_BUCKETS);
+	seq_puts(m, "irq to input core per sync, ns:\n");
+	pak_hist_show(m, latency_hist, KBD_HIST_BUCKETS);
+
+	last_ts = now;
+	last_irqs = irqs;
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(kbd_stats);
+
 static int __init kbd_init(void)
 {
+	unsigned int code;
 	int err;
 
+	kbd_rings = alloc_percpu(struct kbd_ring);
+	if (!kbd_rings) {
+		PR_ERROR("not enough memory available\n");
+		return -ENOMEM;
+	}
+
+	kbd_pak_stats = pak_stats_create(KBUILD_MODNAME);
+	kbd_pak_irqs = pak_stat_create(kbd_pak_stats, "irqs", PAK_STAT_COUNTER);
+
 	kbd_dev = input_allocate_device();
 	if (!kbd_dev) {
 		PR_ERROR("not enough memory available\n");
-		return -ENOMEM;
+		err = -ENOMEM;
+		goto err_free_rings;
 	}
 
+	hrtimer_init(&kbd_frame.timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS_SOFT);
+	kbd_frame.timer.function = kbd_frame_timer_fn;
+	hrtimer_init(&kbd_inject.timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL_HARD);
+	kbd_inject.timer.function = kbd_inject_timer_fn;
+
 	kbd_dev->name = "Bmeneg's Keyboard";
 	set_bit(EV_KEY, kbd_dev->evbit);
+	for (code = KEY_ESC; code <= KEY_F12; code++)
+		set_bit(code, kbd_dev->keybit);
+	for (code = 0; code < ARRAY_SIZE(kbd_extended_keymap); code++)
+		if (kbd_extended_keymap[code])
+			set_bit(kbd_extended_keymap[code], kbd_dev->keybit);
+	/* evdev sizes its per-reader buffers after it, make room for bursts */
+	input_set_events_per_packet(kbd_dev, 256);
 
 	err = input_register_device(kbd_dev);
 	if (err) {
@@ -43,30 +632,69 @@ static int __init kbd_init(void)
 		goto err_free_dev;
 	}
 
-	/* Keyboard IRQ number conflicts with i8042 interrupt controller,
-	 * because of that the interrupt handler is over a shared line. */
-	err = request_irq(KBD_IRQN, &kbd_irq_handler, IRQF_SHARED,
-			  kbd_dev->name, kbd_dev);
-	if (err) {
-		PR_ERROR("failed to register IRQ %d\n", KBD_IRQN);
-		goto err_unregister_dev;
+	if (inject_only) {
+		kbd_drain_task = kthread_run(kbd_drain_fn, NULL, "my-kbd-drain");
+		if (IS_ERR(kbd_drain_task)) {
+			err = PTR_ERR(kbd_drain_task);
+			PR_ERROR("failed to start the drain thread\n");
+			goto err_unregister_dev;
+		}
+		/* As IRQ threads are, to compare with them */
+		sched_set_fifo(kbd_drain_task);
+	} else {
+		/* Keyboard IRQ number conflicts with i8042 interrupt
+		 * controller, because of that the interrupt handler is over a
+		 * shared line. No IRQF_ONESHOT: every handler sharing the
+		 * line must agree on it. */
+		err = request_threaded_irq(irq, &kbd_irq_handler,
+					   &kbd_irq_thread, IRQF_SHARED,
+					   kbd_dev->name, kbd_dev);
+		if (err) {
+			PR_ERROR("failed to register IRQ %d\n", irq);
+			goto err_unregister_dev;
+		}
 	}
 
+	kbd_load_ts = ktime_get_ns();
+	kbd_debugfs = debugfs_create_dir("my-kbd", NULL);
+	debugfs_create_file("stats", 0444, kbd_debugfs, NULL, &kbd_stats_fops);
+	debugfs_create_file("inject", 0600, kbd_debugfs, NULL,
+			    &kbd_inject_fops);
 	return 0;
 
 err_unregister_dev:
+	/* Drops the last reference: the device is gone, not to be freed */
 	input_unregister_device(kbd_dev);
+	goto err_free_rings;
 err_free_dev:
 	input_free_device(kbd_dev);
+err_free_rings:
+	pak_stats_destroy(kbd_pak_stats);
+	free_percpu(kbd_rings);
 	return err;
-
 }
 
 static void __exit kbd_exit(void)
 {
-	free_irq(KBD_IRQN, kbd_dev);
+	unsigned long irqs = 0;
+	int cpu;
+
+	debugfs_remove_recursive(kbd_debugfs);
+	hrtimer_cancel(&kbd_inject.timer);
+	if (inject_only)
+		kthread_stop(kbd_drain_task);
+	else
+		/* Waits for the IRQ thread as well */
+		free_irq(irq, kbd_dev);
+	/* Keys still pending die with the device */
+	hrtimer_cancel(&kbd_frame.timer);
 	input_unregister_device(kbd_dev);
-	PR_DEBUG("irq reference counter: %d\n", irq_ref_count);
+	pak_stats_destroy(kbd_pak_stats);
+	free_percpu(kbd_rings);
+
+	for_each_possible_cpu(cpu)
+		irqs += per_cpu(kbd_stats.irqs, cpu);
+	PR_INFO("irq reference counter: %lu\n", irqs);
 }
 
 module_init(kbd_init);
@@ -0,0 +1,37 @@
+#!/bin/bash
+
+MOD_NAME="my-kbd.ko"
+DEBUGFS=/sys/kernel/debug/my-kbd
+# Events injected per run and their rate, when asked with './run.sh bench'
+EVENTS=${EVENTS:-1000000}
+RATE=${RATE:-1000000}
+RESULTS_DIR=${RESULTS_DIR:-results}
+
+sudo rmmod $MOD_NAME 2>/dev/null
+make || exit 1
+
+[ "$1" = "bench" ] || { sudo insmod $MOD_NAME; dmesg | tail; exit 0; }
+
+# No keyboard needed: the injector is the only source of events, thus this
+# runs the same in a headless VM
+gcc -O2 -o userspace/kbd-latency userspace/kbd-latency.c || exit 1
+mkdir -p $RESULTS_DIR
+
+# Per-event delivery first, then coalesced by count and by time. Reloaded each
+# time, for the stats to cover a single mode.
+for mode in "1 0" "0 0" "64 0" "0 1000"; do
+	set -- $mode
+	out=$RESULTS_DIR/my-kbd-max$1-us$2.txt
+
+	sudo insmod $MOD_NAME inject_only=1 inject_rate=$RATE \
+		coalesce_max=$1 coalesce_us=$2 || exit 1
+	sudo ./userspace/kbd-latency $EVENTS > $out &
+	reader=$!
+	sleep 1
+	echo $EVENTS | sudo tee $DEBUGFS/inject >/dev/null || exit 1
+	wait $reader
+
+	sudo cat $DEBUGFS/inject $DEBUGFS/stats >> $out
+	sudo rmmod $MOD_NAME
+	echo "results saved to $out"
+done
@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2017 Bruno E. O. Meneguele <bmeneguele@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ */
+
+/*
+ * Read key events from the my-kbd evdev node and report how fast they arrive
+ * and how late: the event time is the one taken when the IRQ fired (or the
+ * injector pushed it), compared against the clock right after read() returns.
+ * It also counts the read() calls, a reader woken once per frame shows the
+ * effect of coalescing. Build and run it as:
+ *
+ *	$ gcc -O2 -o kbd-latency kbd-latency.c
+ *	# ./kbd-latency <events> [/dev/input/eventN]
+ *
+ * It stops after the given number of key events, or after 2s with none.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+
+#define KBD_NAME "Bmeneg's Keyboard"
+#define MAX_EVENT_NODES 64
+#define READ_BATCH 256
+#define IDLE_TIMEOUT_MS 2000
+
+static int find_device(void)
+{
+	char path[32], name[64];
+	int i, fd;
+
+	for (i = 0; i < MAX_EVENT_NODES; i++) {
+		snprintf(path, sizeof(path), "/dev/input/event%d", i);
+		fd = open(path, O_RDONLY);
+		if (fd < 0)
+			continue;
+
+		if (ioctl(fd, EVIOCGNAME(sizeof(name)), name) > 0 &&
+		    !strcmp(name, KBD_NAME)) {
+			printf("reading from %s\n", path);
+			return fd;
+		}
+		close(fd);
+	}
+
+	fprintf(stderr, "no \"%s\" input device, is my-kbd loaded?\n",
+		KBD_NAME);
+	return -1;
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+int main(int argc, char *argv[])
+{
+	struct input_event evs[READ_BATCH];
+	uint64_t nr_expected, nr = 0, reads = 0, dropped = 0;
+	uint64_t *lat, first = 0, last = 0, now, ts;
+	int clk = CLOCK_MONOTONIC, fd, i, n;
+	struct pollfd pfd;
+	ssize_t len;
+
+	if (argc < 2 || !(nr_expected = strtoull(argv[1], NULL, 0))) {
+		fprintf(stderr, "usage: %s <events> [/dev/input/eventN]\n",
+			argv[0]);
+		return 1;
+	}
+
+	fd = argc > 2 ? open(argv[2], O_RDONLY) : find_device();
+	if (fd < 0) {
+		if (argc > 2)
+			perror("failed to open the input device");
+		return 1;
+	}
+
+	/* Event times in the clock the kernel stamps them with */
+	if (ioctl(fd, EVIOCSCLOCKID, &clk)) {
+		perror("failed to set the event clock");
+		return 1;
+	}
+
+	lat = malloc(nr_expected * sizeof(*lat));
+	if (!lat) {
+		perror("malloc");
+		return 1;
+	}
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while (nr < nr_expected) {
+		n = poll(&pfd, 1, IDLE_TIMEOUT_MS);
+		if (n <= 0)
+			break;
+
+		len = read(fd, evs, sizeof(evs));
+		now = now_ns();
+		if (len < 0) {
+			perror("read");
+			break;
+		}
+		reads++;
+
+		for (i = 0; i < len / (ssize_t)sizeof(evs[0]); i++) {
+			if (evs[i].type == EV_SYN && evs[i].code == SYN_DROPPED)
+				dropped++;
+			if (evs[i].type != EV_KEY || nr == nr_expected)
+				continue;
+
+			ts = evs[i].input_event_sec * 1000000000ULL +
+			     evs[i].input_event_usec * 1000ULL;
+			lat[nr++] = now > ts ? now - ts : 0;
+			if (!first)
+				first = now;
+			last = now;
+		}
+	}
+
+	if (!nr) {
+		fprintf(stderr, "no key events\n");
+		return 1;
+	}
+
+	qsort(lat, nr, sizeof(*lat), cmp_u64);
+	printf("events: %llu/%llu, reads: %llu (%.1f events per read), "
+	       "SYN_DROPPED: %llu\n", (unsigned long long)nr,
+	       (unsigned long long)nr_expected, (unsigned long long)reads,
+	       (double)nr / reads, (unsigned long long)dropped);
+	printf("throughput: %.0f events/s\n",
+	       last > first ? nr * 1e9 / (last - first) : 0.0);
+	printf("latency: p50 %llu ns, p99 %llu ns, max %llu ns\n",
+	       (unsigned long long)lat[nr / 2],
+	       (unsigned long long)lat[nr * 99 / 100],
+	       (unsigned long long)lat[nr - 1]);
+
+	free(lat);
+	close(fd);
+	return 0;
+}
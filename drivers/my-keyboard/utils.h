@@ -9,14 +9,57 @@
 #ifndef __UTILS_H
 #define __UTILS_H
 
+#include <linux/kernel.h>
+#include <linux/dynamic_debug.h>
+
 #define __PR_FMT(log_lvl, fmt, ...) \
 	printk(log_lvl "[%s] %s:%d:: " fmt, \
 	       KBUILD_MODNAME, __func__, __LINE__, ##__VA_ARGS__)
 
-#define PR_DEBUG(fmt, ...) \
+/*
+ * Built with 'make PAK_COMMON=1', debug messages go to the binary log of
+ * pak-common.ko rather than through printk(), see common/pak-common.h. Errors
+ * always reach the console.
+ */
+#ifdef PAK_COMMON
+#include "pak-common.h"
+
+#define __PR_DEBUG(fmt, ...) \
+	PAK_LOG(fmt, ##__VA_ARGS__)
+#else
+#define __PR_DEBUG(fmt, ...) \
 	__PR_FMT(KERN_NOTICE, fmt, ##__VA_ARGS__)
+#endif
+
+/*
+ * Debug messages are off unless asked for, wherever they go. With dynamic
+ * debug each PR_DEBUG() site sits behind its own static key, a disabled one
+ * costs a NOP, and sites are turned on at runtime per module, function or
+ * line:
+ *
+ *	# echo 'module rcu_linked_list +p' > /proc/dynamic_debug/control
+ *
+ * or at load time, with 'insmod <module>.ko dyndbg=+p'. That is the only
+ * switch, the binary log has none of its own. Without dynamic debug they're
+ * only built with 'make DEBUG=1'.
+ */
+#if defined(CONFIG_DYNAMIC_DEBUG) || \
+	(defined(CONFIG_DYNAMIC_DEBUG_CORE) && defined(DYNAMIC_DEBUG_MODULE))
+#define PR_DEBUG(fmt, ...) \
+	_dynamic_func_call_no_desc(fmt, __PR_DEBUG, fmt, ##__VA_ARGS__)
+#elif defined(DEBUG)
+#define PR_DEBUG(fmt, ...) \
+	__PR_DEBUG(fmt, ##__VA_ARGS__)
+#else
+#define PR_DEBUG(fmt, ...) \
+	no_printk(fmt, ##__VA_ARGS__)
+#endif
+
+/* Meant to be read in the kernel log, always: benchmark results and alike */
+#define PR_INFO(fmt, ...) \
+	__PR_FMT(KERN_INFO, fmt, ##__VA_ARGS__)
 
 #define PR_ERROR(fmt, ...) \
 	__PR_FMT(KERN_ERR, fmt, ##__VA_ARGS__)
 
-#endif
+#endif /* __UTILS_H */
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2018 Bruno E. O. Meneguele <bmeneguele@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ */
+
+/*
+ * myfs tracepoints: every mount attempt, with its result, and every inode
+ * created. Enabled with:
+ *
+ *	# echo 1 > /sys/kernel/tracing/events/myfs/enable
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM myfs
+
+#if !defined(__MYFS_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define __MYFS_TRACE_H
+
+#include <linux/tracepoint.h>
+#include <linux/string.h>
+
+/* Longer device names are truncated in the trace */
+#define MYFS_TRACE_DEV_NBYTES 64
+
+TRACE_EVENT(myfs_mount,
+	TP_PROTO(const char *dev_name, int flags, int err),
+	TP_ARGS(dev_name, flags, err),
+
+	TP_STRUCT__entry(
+		__array(char, dev_name, MYFS_TRACE_DEV_NBYTES)
+		__field(int, flags)
+		__field(int, err)
+	),
+
+	TP_fast_assign(
+		strscpy(__entry->dev_name, dev_name ? : "none",
+			MYFS_TRACE_DEV_NBYTES);
+		__entry->flags = flags;
+		__entry->err = err;
+	),
+
+	TP_printk("dev=%s flags=0x%x err=%d", __entry->dev_name,
+		  __entry->flags, __entry->err)
+);
+
+TRACE_EVENT(myfs_inode_create,
+	TP_PROTO(unsigned long ino, umode_t mode),
+	TP_ARGS(ino, mode),
+
+	TP_STRUCT__entry(
+		__field(unsigned long, ino)
+		__field(umode_t, mode)
+	),
+
+	TP_fast_assign(
+		__entry->ino = ino;
+		__entry->mode = mode;
+	),
+
+	TP_printk("ino=%lu mode=0%o", __entry->ino, __entry->mode)
+);
+
+#endif /* __MYFS_TRACE_H */
+
+/* Out of the kernel tree: the header is found through -I$(src) */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE myfs-trace
+#include <trace/define_trace.h>
@@ -12,8 +12,18 @@
 
 #include "utils.h"
 
+#define CREATE_TRACE_POINTS
+#include "myfs-trace.h"
+/* Runtime stats, exported by pak-common.ko when built with PAK_COMMON=1 */
+#include "pak-common.h"
+
 #define MYFS_MAGIC 0x4D594653
 
+/* Under /sys/kernel/debug/playing-around/myfs/ */
+static struct pak_stats *myfs_stats;
+static struct pak_stat *myfs_stat_inodes;
+static struct pak_stat *myfs_stat_mounts;
+
 struct inode * myfs_create_inode(struct super_block *sb, umode_t mode)
 {
 	struct inode *inode;
@@ -24,6 +34,8 @@ struct inode * myfs_create_inode(struct super_block *sb, umode_t mode)
 		inode_init_owner(inode, NULL, mode);
 		inode->i_atime = inode->i_mtime = inode->i_ctime =
 			current_time(inode);
+		trace_myfs_inode_create(inode->i_ino, mode);
+		pak_stat_inc(myfs_stat_inodes);
 	} else {
 		PR_ERROR("failed to create inode");
 	}
@@ -51,11 +63,14 @@ struct dentry * myfs_mount(struct file_system_type *fs_type, int flags, const
 
 	root_dentry = mount_bdev(fs_type, flags, dev_name, data,
 				 myfs_fill_super);
-	if (IS_ERR(root_dentry))
+	trace_myfs_mount(dev_name, flags, PTR_ERR_OR_ZERO(root_dentry));
+	if (IS_ERR(root_dentry)) {
 		PR_ERROR("failed to mount myfs. error %ld\n",
 			 PTR_ERR(root_dentry));
-	else
+	} else {
 		PR_DEBUG("sucessfully mounted myfs\n");
+		pak_stat_inc(myfs_stat_mounts);
+	}
 
 	return root_dentry;
 }
@@ -74,11 +89,20 @@ static int __init myfs_init(void)
 
 	PR_DEBUG("myfs init\n");
 
+	/* Stats aren't essential, myfs works without them */
+	myfs_stats = pak_stats_create(KBUILD_MODNAME);
+	myfs_stat_inodes = pak_stat_create(myfs_stats, "inodes",
+					   PAK_STAT_COUNTER);
+	myfs_stat_mounts = pak_stat_create(myfs_stats, "mounts",
+					   PAK_STAT_COUNTER);
+
 	err = register_filesystem(&myfs_type);
-	if (err)
+	if (err) {
 		PR_ERROR("failed to register myfs. error %d\n", err);
-	else
+		pak_stats_destroy(myfs_stats);
+	} else {
 		PR_DEBUG("sucessfully registered myfs\n");
+	}
 
 	return err;
 }
@@ -92,6 +116,7 @@ static void __exit myfs_exit(void)
 		PR_ERROR("failed to unregister myfs. error %d\n", err);
 	else
 		PR_DEBUG("sucessfully unregistered myfs\n");
+	pak_stats_destroy(myfs_stats);
 
 	PR_DEBUG("myfs exit\n");
 }
@@ -0,0 +1,79 @@
+#!/bin/bash
+#
+# Build every module of the repo against a kernel tree, with one of the build
+# profiles of common/profile.mk, and gather them under an output directory, laid
+# out as the repo is. Userspace programs the benchmarks need are built too,
+# static, to run in the harness' initramfs. One line per module directory, 'ok'
+# or 'failed', is written to <output dir>/build-status; the whole build log to
+# <output dir>/build.log.
+#
+# Modules are built against pak-common.ko, unless PAK_COMMON is set empty in
+# the environment.
+#
+# Usage: ./build.sh <kernel tree> <profile> <output dir> [module dir...]
+#
+# Only the module directories given are built, when any, e.g. common
+# crashes/oops for crash.sh.
+
+KDIR=$1
+PROFILE=$2
+OUT=$3
+TOP=$(cd "$(dirname "$0")/.." && pwd)
+
+# pak-common.ko first: the others are built against its Module.symvers
+MODULE_DIRS="common
+	drivers/hello-world
+	drivers/my-keyboard
+	mm
+	data/linked-list
+	data/container-bench
+	sync/rcu
+	crypto/kernelspace
+	fs
+	crashes/oops"
+
+shift 3
+[ $# -gt 0 ] && MODULE_DIRS="$*"
+
+USER_PROGS="drivers/my-keyboard/userspace/kbd-latency
+	mm/userspace/zcring-bench
+	harness/guest/modload"
+
+if [ ! -d "$KDIR" ] || [ -z "$PROFILE" ] || [ -z "$OUT" ]; then
+	echo "usage: $0 <kernel tree> <profile> <output dir> [module dir...]" >&2
+	exit 1
+fi
+
+rm -rf "$OUT/modules" "$OUT/bin"
+mkdir -p "$OUT/modules" "$OUT/bin"
+: > "$OUT/build-status"
+: > "$OUT/build.log"
+
+for dir in $MODULE_DIRS; do
+	# Objects of another profile must not be reused
+	make -C "$KDIR" M="$TOP/$dir" clean >> "$OUT/build.log" 2>&1
+	if make -C "$KDIR" M="$TOP/$dir" PROFILE="$PROFILE" \
+		PAK_COMMON="${PAK_COMMON-1}" modules >> "$OUT/build.log" 2>&1; then
+		mkdir -p "$OUT/modules/$dir"
+		cp "$TOP/$dir"/*.ko "$OUT/modules/$dir/"
+		echo "$dir ok" >> "$OUT/build-status"
+	else
+		echo "$dir failed" >> "$OUT/build-status"
+		echo "$dir: build failed, see $OUT/build.log" >&2
+	fi
+done
+
+for prog in $USER_PROGS; do
+	if gcc -O2 -static -o "$OUT/bin/$(basename "$prog")" "$TOP/$prog.c" \
+		>> "$OUT/build.log" 2>&1; then
+		echo "$prog ok" >> "$OUT/build-status"
+	else
+		echo "$prog failed" >> "$OUT/build-status"
+		echo "$prog: build failed, see $OUT/build.log" >&2
+	fi
+done
+
+# The torture driver runs as it is, from the directory of its modules
+cp "$TOP/sync/rcu/torture.sh" "$OUT/modules/sync/rcu/" 2>/dev/null
+
+! grep -q failed "$OUT/build-status"
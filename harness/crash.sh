@@ -0,0 +1,241 @@
+#!/bin/bash
+#
+# Crash a QEMU guest with crashes/oops in every way asked for, capture it with
+# pstore/ramoops or kdump, and measure how long the capture takes and how big
+# the dump is. Each fault, context and method is a run of its own, in a fresh
+# guest, under <output dir>/crash/<method>-<fault>-<context>/. Their results
+# are gathered into <output dir>/crash-report.json.
+#
+# Usage: ./crash.sh -k <kernel tree> [options]
+#
+#  -k <dir>	kernel tree oops.ko is built against, already built
+#  -i <file>	kernel image to boot (default: the tree's bzImage)
+#  -p <profile>	release, debug or size (default: release), see
+#		common/profile.mk
+#  -o <dir>	output directory (default: results/<kernel release>-crash)
+#  -b <file>	static busybox binary (default: the one in PATH)
+#  -K <file>	static kexec binary, from kexec-tools (default: the one in PATH)
+#  -D <file>	static makedumpfile binary (default: the one in PATH)
+#  -c <cpus>	guest CPUs (default: 2)
+#  -m <MB>	guest memory (default: 2048)
+#  -t <secs>	give up on a run after that long (default: 300)
+#  -f <list>	comma separated faults (default: oops,panic,bug,softlockup,
+#		hung_task)
+#  -x <list>	comma separated contexts (default: process,softirq,hardirq)
+#  -M <list>	comma separated methods (default: pstore,kdump)
+#  -w <secs>	watchdog_thresh, soft lockups are reported after twice that
+#		(default: 5)
+#  -H <secs>	hung_task_timeout_secs (default: 10)
+#  -d <level>	makedumpfile dump level (default: 31, everything but kernel
+#		pages filtered out)
+#
+# Every fault is made to panic: oops=panic, softlockup_panic=1,
+# hung_task_panic=1 and nmi_watchdog=panic. Time to capture thus includes the
+# time the kernel takes to notice lockups and hung tasks, as on real machines.
+#
+# The kernel needs, on top of what run.sh asks for: pstore and ramoops
+# (CONFIG_PSTORE_RAM) for pstore; kexec, crash dumps, /proc/vmcore and
+# virtio-blk for kdump. Hard lockups, softlockup from hardirq context, are only
+# caught when the guest has a PMU for the NMI watchdog, i.e. with KVM.
+
+HARNESS=$(cd "$(dirname "$0")" && pwd)
+PROFILE=release
+CPUS=2
+MEM=2048
+TIMEOUT=300
+BUSYBOX=$(command -v busybox)
+KEXEC=$(command -v kexec)
+MAKEDUMPFILE=$(command -v makedumpfile)
+FAULTS=oops,panic,bug,softlockup,hung_task
+CONTEXTS=process,softirq,hardirq
+METHODS=pstore,kdump
+THRESH=5
+HUNG=10
+DUMPLEVEL=31
+
+# ramoops' RAM, reserved with memmap= and kept across the guest's reboot
+RAMOOPS_ADDR=0x20000000
+RAMOOPS_SIZE=0x200000
+CRASHKERNEL=256M
+
+while getopts "k:i:p:o:b:K:D:c:m:t:f:x:M:w:H:d:" opt; do
+	case $opt in
+	k) KDIR=$OPTARG ;;
+	i) IMAGE=$OPTARG ;;
+	p) PROFILE=$OPTARG ;;
+	o) OUT=$OPTARG ;;
+	b) BUSYBOX=$OPTARG ;;
+	K) KEXEC=$OPTARG ;;
+	D) MAKEDUMPFILE=$OPTARG ;;
+	c) CPUS=$OPTARG ;;
+	m) MEM=$OPTARG ;;
+	t) TIMEOUT=$OPTARG ;;
+	f) FAULTS=$OPTARG ;;
+	x) CONTEXTS=$OPTARG ;;
+	M) METHODS=$OPTARG ;;
+	w) THRESH=$OPTARG ;;
+	H) HUNG=$OPTARG ;;
+	d) DUMPLEVEL=$OPTARG ;;
+	*) exit 1 ;;
+	esac
+done
+
+if [ -z "$KDIR" ]; then
+	echo "usage: $0 -k <kernel tree> [options], see the script's header" >&2
+	exit 1
+fi
+KDIR=$(cd "$KDIR" && pwd) || exit 1
+IMAGE=${IMAGE:-$KDIR/arch/x86/boot/bzImage}
+KREL=$(make -s -C "$KDIR" kernelrelease 2>/dev/null)
+OUT=${OUT:-results/$KREL-crash}
+
+is_static()
+{
+	[ -n "$1" ] && file -L "$1" | grep -q "statically linked"
+}
+
+if [ ! -f "$IMAGE" ]; then
+	echo "no kernel image at $IMAGE, see -i" >&2
+	exit 1
+fi
+if ! is_static "$BUSYBOX"; then
+	echo "a statically linked busybox is needed, see -b" >&2
+	exit 1
+fi
+if [[ ",$METHODS," == *,kdump,* ]] &&
+	! { is_static "$KEXEC" && is_static "$MAKEDUMPFILE"; }; then
+	echo "kdump needs static kexec and makedumpfile, see -K and -D" >&2
+	exit 1
+fi
+
+# Lockups and hung tasks have to outlive their detection, twice its period
+LOCKUP=$(( (THRESH * 2 > HUNG ? THRESH * 2 : HUNG) * 2 + 5 ))
+
+mkdir -p "$OUT"
+OUT=$(cd "$OUT" && pwd)
+
+echo "building oops.ko against $KDIR ($KREL), $PROFILE profile"
+"$HARNESS/build.sh" "$KDIR" "$PROFILE" "$OUT" common crashes/oops || exit 1
+
+# The capture kernel's initramfs is the same, minus the kernel and itself
+ROOTFS=$OUT/rootfs
+rm -rf "$ROOTFS"
+mkdir -p "$ROOTFS"/{bin,dev,proc,sys,tmp,harness}
+cp "$BUSYBOX" "$ROOTFS/bin/busybox"
+for applet in $("$BUSYBOX" --list); do
+	ln -sf busybox "$ROOTFS/bin/$applet"
+done
+[ -n "$KEXEC" ] && cp "$KEXEC" "$ROOTFS/bin/kexec"
+[ -n "$MAKEDUMPFILE" ] && cp "$MAKEDUMPFILE" "$ROOTFS/bin/makedumpfile"
+cp -r "$OUT/modules" "$ROOTFS/modules"
+cp "$HARNESS/guest/benchmarks.sh" "$ROOTFS/harness/"
+cp "$HARNESS/guest/crash-init" "$ROOTFS/init"
+chmod +x "$ROOTFS/init"
+mkdir -p "$ROOTFS/boot"
+(cd "$ROOTFS" && find . | cpio -o -H newc --quiet | gzip -1) \
+	> "$OUT/capture.cpio.gz" || exit 1
+cp "$IMAGE" "$ROOTFS/boot/bzImage"
+cp "$OUT/capture.cpio.gz" "$ROOTFS/boot/"
+(cd "$ROOTFS" && find . | cpio -o -H newc --quiet | gzip -1) \
+	> "$OUT/initramfs.cpio.gz" || exit 1
+
+ACCEL="-accel tcg"
+if [ -w /dev/kvm ]; then
+	ACCEL="-enable-kvm -cpu host"
+else
+	echo "no access to /dev/kvm, emulating: don't trust the numbers" >&2
+fi
+
+# Host time of each line of the guest's output, in ms, as it comes. A second
+# trigger means the capture kernel never took over: the guest was rebooted
+# into a plain one, crashing it all over again.
+timestamp()
+{
+	local line triggers=0
+
+	while IFS= read -r line; do
+		line=${line%$'\r'}
+		printf '%s %s\n' "$(date +%s%3N)" "$line"
+		case $line in
+		"@@@ trigger "*)
+			triggers=$(( triggers + 1 ))
+			[ $triggers -gt 1 ] && kill "$(cat "$1/qemu.pid")"
+			;;
+		esac
+	done
+}
+
+# run <method> <fault> <context>
+run()
+{
+	local dir=$OUT/crash/$1-$2-$3
+	local cmdline extra status bytes
+
+	rm -rf "$dir"
+	mkdir -p "$dir"
+	cmdline="console=ttyS0 loglevel=4 panic=1 oops=panic softlockup_panic=1"
+	cmdline="$cmdline hung_task_panic=1 nmi_watchdog=panic"
+	cmdline="$cmdline watchdog_thresh=$THRESH harness.crash=$1,$2,$3"
+	cmdline="$cmdline harness.lockup=$LOCKUP harness.hung=$HUNG"
+	cmdline="$cmdline harness.dumplevel=$DUMPLEVEL"
+
+	case $1 in
+	pstore)
+		# The guest has to reboot for the records to be read
+		cmdline="$cmdline memmap=$RAMOOPS_SIZE\$$RAMOOPS_ADDR"
+		cmdline="$cmdline ramoops.mem_address=$RAMOOPS_ADDR"
+		cmdline="$cmdline ramoops.mem_size=$RAMOOPS_SIZE"
+		cmdline="$cmdline ramoops.record_size=0x40000"
+		cmdline="$cmdline ramoops.console_size=0x40000"
+		extra=""
+		;;
+	kdump)
+		cmdline="$cmdline crashkernel=$CRASHKERNEL"
+		truncate -s "${MEM}M" "$dir/dump.img"
+		extra="-no-reboot -drive file=$dir/dump.img,format=raw,if=virtio"
+		;;
+	esac
+
+	echo "$1: $2 from $3 context"
+	timeout "$TIMEOUT" qemu-system-x86_64 $ACCEL -smp "$CPUS" -m "$MEM" \
+		-display none -monitor none $extra -pidfile "$dir/qemu.pid" \
+		-kernel "$IMAGE" -initrd "$OUT/initramfs.cpio.gz" \
+		-append "$cmdline" \
+		-serial file:"$dir/console.log" -serial stdio < /dev/null |
+		timestamp "$dir" > "$dir/results.log"
+	status=${PIPESTATUS[0]}
+	echo "$status" > "$dir/qemu-status"
+	[ "$status" -eq 124 ] && echo "  timed out after ${TIMEOUT}s" >&2
+
+	# Only what makedumpfile wrote, 'makedumpfile -R' reads it back
+	if [ -f "$dir/dump.img" ]; then
+		bytes=$(sed -n 's/^[0-9]* @@@ capture kdump \([0-9]*\) .*/\1/p' \
+			"$dir/results.log")
+		if [ -n "$bytes" ]; then
+			truncate -s "$bytes" "$dir/dump.img"
+			mv "$dir/dump.img" "$dir/vmcore.flat"
+		else
+			rm -f "$dir/dump.img"
+		fi
+	fi
+}
+
+runs=()
+for method in ${METHODS//,/ }; do
+	for fault in ${FAULTS//,/ }; do
+		for context in ${CONTEXTS//,/ }; do
+			# Nothing sleeps in interrupts
+			[ "$fault" = hung_task ] && [ "$context" != process ] &&
+				continue
+			run "$method" "$fault" "$context"
+			runs+=("$OUT/crash/$method-$fault-$context")
+		done
+	done
+done
+
+python3 "$HARNESS/report.py" crash "${runs[@]}" \
+	--meta kernel_tree="$KDIR" --meta kernel_release="$KREL" \
+	--meta profile="$PROFILE" --meta cpus="$CPUS" --meta mem_mb="$MEM" \
+	--meta watchdog_thresh="$THRESH" --meta hung_task_timeout="$HUNG" \
+	--meta dump_level="$DUMPLEVEL" -o "$OUT/crash-report.json" || exit 1
+echo "report in $OUT/crash-report.json"
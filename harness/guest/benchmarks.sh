@@ -0,0 +1,243 @@
+# Benchmarks run by the guest, sourced by its /init. Plain POSIX sh: busybox
+# is all there is in the initramfs.
+#
+# Everything goes to stdout, which /init points to the second serial port, the
+# report's source. report.py understands three kinds of lines:
+#
+#	@@@ module <dir>/<module> <status> <ms>		insmod of a module
+#	@@@ begin <benchmark>
+#	@@@ end <benchmark> <status> <ms>
+#
+# and takes whatever is between a begin and its end as the benchmark's output.
+# Results that modules print to the kernel log are part of it, without the
+# kernel log prefix.
+#
+# A benchmark is a sh function named bench_<benchmark>. Its modules are loaded
+# with load(), and have to be unloaded before it returns.
+
+MODS=/modules
+BIN=/bin/harness
+DEBUGFS=/sys/kernel/debug
+PAK=$DEBUGFS/playing-around
+
+# Benchmark sizes, kept small enough for a guest of a few CPUs and 2 GiB
+TORTURE_MS=${TORTURE_MS:-1000}
+KBD_EVENTS=${KBD_EVENTS:-200000}
+KBD_RATE=${KBD_RATE:-1000000}
+LIST_ENTRIES=${LIST_ENTRIES:-1000000}
+ZCRING_MB=${ZCRING_MB:-256}
+
+mark()
+{
+	echo "@@@ $*"
+}
+
+# /proc/uptime has a 10 ms resolution, enough for whole benchmarks
+now_ms()
+{
+	read -r up _ < /proc/uptime
+	echo $(( ${up%.*} * 1000 + 10 * 1${up#*.} - 1000 ))
+}
+
+# load <dir>/<module> [params]
+load()
+{
+	mod=$1
+	shift
+	start=$(now_ms)
+	insmod "$MODS/$mod.ko" "$@"
+	status=$?
+	mark "module $mod $status $(( $(now_ms) - start ))"
+	return $status
+}
+
+unload()
+{
+	rmmod "$@"
+}
+
+# Stats of a module in pak-common.ko, as 'name: value' lines
+pak_stats()
+{
+	for f in "$PAK/$1"/*; do
+		[ -f "$f" ] && echo "${f##*/}: $(cat "$f")"
+	done
+}
+
+# run_bench <benchmark>
+run_bench()
+{
+	dmesg -c > /dev/null
+	start=$(now_ms)
+	mark "begin $1"
+	"bench_$1" 2>&1
+	status=$?
+	dmesg -c | sed -n 's/^.*:[0-9]*:: //p'
+	mark "end $1 $status $(( $(now_ms) - start ))"
+}
+
+bench_pak_common()
+{
+	echo 1 > "$PAK/log_bench" && cat "$PAK/log_bench" &&
+		echo 1 > "$PAK/stats_bench" && cat "$PAK/stats_bench"
+}
+
+bench_hello_world()
+{
+	load drivers/hello-world/hello-world && unload hello-world
+}
+
+# The allocators' benchmark runs at load time
+bench_my_alloc()
+{
+	load mm/my-alloc bench=1 || return
+	unload my-alloc
+}
+
+bench_alloc_bench()
+{
+	load mm/my-alloc bench=0 || return
+	if load mm/alloc-bench; then
+		echo 1 > "$DEBUGFS/alloc-bench/run" &&
+			cat "$DEBUGFS/alloc-bench/results"
+		status=$?
+		unload alloc-bench
+	fi
+	unload my-alloc
+	return $status
+}
+
+bench_hugebuf()
+{
+	load mm/hugebuf || return
+	echo 1 > "$DEBUGFS/hugebuf/bench" && cat "$DEBUGFS/hugebuf/bench"
+	status=$?
+	unload hugebuf
+	return $status
+}
+
+bench_zcring()
+{
+	load mm/zcring || return
+	"$BIN/zcring-bench" "$ZCRING_MB"
+	status=$?
+	unload zcring
+	return $status
+}
+
+# Both print their results at load time
+bench_list_bench()
+{
+	load data/linked-list/list-bench nr_entries="$LIST_ENTRIES" || return
+	unload list-bench
+}
+
+bench_dog_queue()
+{
+	load data/linked-list/dog-queue || return
+	unload dog-queue
+}
+
+bench_container_bench()
+{
+	load data/container-bench/container-bench || return
+	echo 1 > "$DEBUGFS/container-bench/run" &&
+		cat "$DEBUGFS/container-bench/results"
+	status=$?
+	unload container-bench
+	return $status
+}
+
+# torture.sh loads the modules by itself, from its directory
+bench_dog_torture()
+{
+	(cd "$MODS/sync/rcu" && sh ./torture.sh "$TORTURE_MS" 10000)
+	status=$?
+	pak_stats rcu_linked_list
+	unload dog-torture rcu-linked-list
+	return $status
+}
+
+# kbd_inject <coalesce_max> <coalesce_us>, as drivers/my-keyboard/run.sh does
+kbd_inject()
+{
+	load drivers/my-keyboard/my-kbd inject_only=1 inject_rate="$KBD_RATE" \
+		coalesce_max="$1" coalesce_us="$2" || return
+	"$BIN/kbd-latency" "$KBD_EVENTS" &
+	reader=$!
+	sleep 1
+	echo "$KBD_EVENTS" > "$DEBUGFS/my-kbd/inject"
+	wait $reader
+	status=$?
+	cat "$DEBUGFS/my-kbd/inject" "$DEBUGFS/my-kbd/stats"
+	unload my-kbd
+	return $status
+}
+
+bench_my_kbd_max1_us0()
+{
+	kbd_inject 1 0
+}
+
+bench_my_kbd_max64_us0()
+{
+	kbd_inject 64 0
+}
+
+bench_my_kbd_max0_us1000()
+{
+	kbd_inject 0 1000
+}
+
+# Each run encrypts and decrypts once at load time, timed by the stats
+bench_crypto_sync()
+{
+	load crypto/kernelspace/sync || return
+	pak_stats sync
+	unload sync
+}
+
+bench_crypto_async()
+{
+	load crypto/kernelspace/async || return
+	pak_stats async
+	unload async
+}
+
+# Loading only: mounting needs a block device
+bench_myfs()
+{
+	load fs/myfs || return
+	unload myfs
+}
+
+# crashes/oops crashes the guest on purpose, it is crash.sh's
+BENCHMARKS="pak_common
+	hello_world
+	my_alloc
+	alloc_bench
+	hugebuf
+	zcring
+	list_bench
+	dog_queue
+	container_bench
+	dog_torture
+	my_kbd_max1_us0
+	my_kbd_max64_us0
+	my_kbd_max0_us1000
+	crypto_sync
+	crypto_async
+	myfs"
+
+run_all()
+{
+	mark "kernel $(uname -r)"
+	mark "cpus $(grep -c ^processor /proc/cpuinfo)"
+	# Everything else is built against it
+	load common/pak-common || return
+
+	for b in ${1:-$BENCHMARKS}; do
+		run_bench "$b"
+	done
+	mark "done"
+}
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2017 Bruno E. O. Meneguele <bmeneguele@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ */
+
+/*
+ * Load and unload a module over and over, timing each finit_module() call:
+ * reading the file, decompressing it, laying it out, relocating it, and
+ * running its init function. Compressed modules, .ko.zst or .ko.xz, are
+ * decompressed by the kernel (CONFIG_MODULE_DECOMPRESS), as kmod does. Build
+ * and run it as:
+ *
+ *	$ gcc -O2 -static -o modload modload.c
+ *	# ./modload <repetitions> <module file> [parameters]
+ *	# ./modload -k <module file> [parameters]
+ *
+ * -k only loads the module, and keeps it: dependencies of the module timed
+ * next are loaded that way, compressed or not. Otherwise it prints a single
+ * line:
+ *
+ *	<module> <status> <loads> <min ns> <median ns> <max ns> <coresize>
+ *
+ * status being 0 or the errno of the first load that failed, loads the number
+ * of loads timed and coresize what /sys/module/<module>/coresize reads after
+ * the first one. A module that can't be unloaded is only loaded once.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/syscall.h>
+
+#ifndef MODULE_INIT_COMPRESSED_FILE
+#define MODULE_INIT_COMPRESSED_FILE 4
+#endif
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* KBUILD_MODNAME: the file name without its extensions, '-' turned to '_' */
+static void module_name(const char *path, char *name, size_t size)
+{
+	const char *base = strrchr(path, '/');
+	char *p;
+
+	snprintf(name, size, "%s", base ? base + 1 : path);
+	p = strstr(name, ".ko");
+	if (p)
+		*p = '\0';
+	for (p = name; *p; p++)
+		if (*p == '-')
+			*p = '_';
+}
+
+static int is_compressed(const char *path)
+{
+	size_t len = strlen(path);
+
+	return (len > 4 && !strcmp(path + len - 4, ".zst")) ||
+	       (len > 3 && !strcmp(path + len - 3, ".xz"));
+}
+
+static long read_coresize(const char *name)
+{
+	char path[128];
+	long size = -1;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/sys/module/%s/coresize", name);
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	if (fscanf(f, "%ld", &size) != 1)
+		size = -1;
+	fclose(f);
+	return size;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *path, *params = "";
+	char name[64], buf[1024];
+	uint64_t *ns, start;
+	int reps, keep, flags, loads = 0, status = 0, fd, i;
+	long coresize = -1;
+
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s <repetitions>|-k <module> [params]\n",
+			argv[0]);
+		return 1;
+	}
+	keep = !strcmp(argv[1], "-k");
+	reps = keep ? 1 : atoi(argv[1]);
+	if (reps <= 0) {
+		fprintf(stderr, "invalid number of repetitions '%s'\n",
+			argv[1]);
+		return 1;
+	}
+	path = argv[2];
+	if (argc > 3) {
+		buf[0] = '\0';
+		for (i = 3; i < argc; i++) {
+			strncat(buf, argv[i], sizeof(buf) - strlen(buf) - 2);
+			strcat(buf, " ");
+		}
+		params = buf;
+	}
+	module_name(path, name, sizeof(name));
+	flags = is_compressed(path) ? MODULE_INIT_COMPRESSED_FILE : 0;
+
+	ns = calloc(reps, sizeof(*ns));
+	if (!ns) {
+		perror("calloc");
+		return 1;
+	}
+
+	while (loads < reps) {
+		fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (fd < 0) {
+			status = errno;
+			break;
+		}
+		start = now_ns();
+		if (syscall(SYS_finit_module, fd, params, flags)) {
+			status = errno;
+			close(fd);
+			break;
+		}
+		ns[loads++] = now_ns() - start;
+		close(fd);
+		if (keep)
+			return 0;
+
+		if (coresize < 0)
+			coresize = read_coresize(name);
+		if (syscall(SYS_delete_module, name, O_NONBLOCK))
+			break;
+	}
+
+	if (!loads) {
+		fprintf(stderr, "%s: %s\n", path, strerror(status));
+		printf("%s %d 0 0 0 0 %ld\n", name, status, coresize);
+		return 1;
+	}
+
+	qsort(ns, loads, sizeof(*ns), cmp_u64);
+	printf("%s %d %d %llu %llu %llu %ld\n", name, status, loads,
+	       (unsigned long long)ns[0],
+	       (unsigned long long)ns[loads / 2],
+	       (unsigned long long)ns[loads - 1], coresize);
+	free(ns);
+	return status ? 1 : 0;
+}
@@ -0,0 +1,242 @@
+#!/bin/bash
+#
+# Profile what loading each module of the repo costs: finit_module() latency,
+# with the init function's share of it, core and init section sizes, pages,
+# relocations and imported symbols. Each module is measured in several build
+# variants:
+#
+#  - release, debug, size: the profiles of common/profile.mk (-O2, -Og and
+#    -Os);
+#  - release.zst, release.xz: release compressed as modules_install does,
+#    decompressed by the kernel at load;
+#  - lto: release built with clang against a kernel tree configured with
+#    CONFIG_LTO_CLANG, which gives modules LTO too. Booted in a guest of its
+#    own, as modules only load in the kernel they were built for.
+#
+# Modules are built without pak-common.ko, only the module itself is timed.
+# Results go to <output dir>/modprof.json, and a table to stdout.
+#
+# Usage: ./modprof.sh -k <kernel tree> [options]
+#
+#  -k <dir>	kernel tree the modules are built against, already built
+#  -i <file>	its kernel image (default: the tree's bzImage)
+#  -L <dir>	kernel tree built with CONFIG_LTO_CLANG, for the lto variant
+#  -I <file>	its kernel image (default: the tree's bzImage)
+#  -o <dir>	output directory (default: results/<kernel release>-modprof)
+#  -b <file>	static busybox binary (default: the one in PATH)
+#  -c <cpus>	guest CPUs (default: 2)
+#  -m <MB>	guest memory (default: 1024)
+#  -t <secs>	give up on a guest after that long (default: 1800)
+#  -n <loads>	loads of each module (default: 20)
+#  -V <list>	comma separated variants (default: all of the above, lto only
+#		with -L)
+#
+# Kernels only decompress modules in the format they're configured to compress
+# them with (CONFIG_MODULE_DECOMPRESS and CONFIG_MODULE_COMPRESS_*): the other
+# variant fails to load, point -k to a kernel configured for it.
+
+HARNESS=$(cd "$(dirname "$0")" && pwd)
+CPUS=2
+MEM=1024
+TIMEOUT=1800
+REPS=20
+BUSYBOX=$(command -v busybox)
+VARIANTS=release,debug,size,release.zst,release.xz
+
+# Parameters keeping module's init functions from running their benchmarks
+declare -A PARAMS=(
+	[mm/my-alloc]="bench=0"
+	[data/linked-list/list-bench]="nr_entries=1 passes=1"
+	[data/linked-list/dog-queue]="nr_items=1"
+	[drivers/my-keyboard/my-kbd]="inject_only=1"
+)
+
+while getopts "k:i:L:I:o:b:c:m:t:n:V:" opt; do
+	case $opt in
+	k) KDIR=$OPTARG ;;
+	i) IMAGE=$OPTARG ;;
+	L) LTO_KDIR=$OPTARG ;;
+	I) LTO_IMAGE=$OPTARG ;;
+	o) OUT=$OPTARG ;;
+	b) BUSYBOX=$OPTARG ;;
+	c) CPUS=$OPTARG ;;
+	m) MEM=$OPTARG ;;
+	t) TIMEOUT=$OPTARG ;;
+	n) REPS=$OPTARG ;;
+	V) VARIANTS=$OPTARG; VARIANTS_GIVEN=1 ;;
+	*) exit 1 ;;
+	esac
+done
+
+if [ -z "$KDIR" ]; then
+	echo "usage: $0 -k <kernel tree> [options], see the script's header" >&2
+	exit 1
+fi
+KDIR=$(cd "$KDIR" && pwd) || exit 1
+IMAGE=${IMAGE:-$KDIR/arch/x86/boot/bzImage}
+KREL=$(make -s -C "$KDIR" kernelrelease 2>/dev/null)
+OUT=${OUT:-results/$KREL-modprof}
+if [ -n "$LTO_KDIR" ]; then
+	LTO_KDIR=$(cd "$LTO_KDIR" && pwd) || exit 1
+	LTO_IMAGE=${LTO_IMAGE:-$LTO_KDIR/arch/x86/boot/bzImage}
+	[ -z "$VARIANTS_GIVEN" ] && VARIANTS=$VARIANTS,lto
+fi
+
+if [ ! -f "$IMAGE" ] || { [ -n "$LTO_KDIR" ] && [ ! -f "$LTO_IMAGE" ]; }; then
+	echo "no kernel image at $IMAGE${LTO_IMAGE:+ or $LTO_IMAGE}" >&2
+	exit 1
+fi
+if [ -z "$BUSYBOX" ] || ! file -L "$BUSYBOX" | grep -q "statically linked"; then
+	echo "a statically linked busybox is needed, see -b" >&2
+	exit 1
+fi
+
+mkdir -p "$OUT"
+OUT=$(cd "$OUT" && pwd)
+rm -rf "$OUT/variants" "$OUT/variants-lto"
+
+# build <kernel tree> <profile> <variant> <variants dir> [LLVM]
+build()
+{
+	echo "building $3 against $1"
+	PAK_COMMON= LLVM=$5 "$HARNESS/build.sh" "$1" "$2" "$OUT/build-$3" ||
+		echo "some builds failed, their modules are left out" >&2
+	mkdir -p "$4"
+	cp -r "$OUT/build-$3/modules" "$4/$3"
+}
+
+# compress <base variant> <variant>, with modules_install's commands
+compress()
+{
+	local ko
+
+	if ! command -v "${2##*.}" > /dev/null; then
+		echo "no ${2##*.} to compress $2 with, left out" >&2
+		return
+	fi
+	cp -r "$OUT/variants/$1" "$OUT/variants/$2"
+	find "$OUT/variants/$2" -name '*.ko' | while read -r ko; do
+		case $2 in
+		*.zst) zstd -T0 --rm -f -q "$ko" ;;
+		*.xz) xz --check=crc32 --lzma2=dict=1MiB -f "$ko" ;;
+		esac
+	done
+}
+
+# Dependencies from the modules' modinfo, found in the same variant
+write_order()
+{
+	local dir=$1 ko rel dep deps file
+
+	(cd "$dir" && find . -name '*.ko*' | sed 's|^\./||' | sort) |
+	while read -r rel; do
+		ko=$dir/$rel
+		case $rel in
+		*.zst) file=$(mktemp) && zstd -dcq "$ko" > "$file" ;;
+		*.xz) file=$(mktemp) && xz -dc "$ko" > "$file" ;;
+		*) file=$ko ;;
+		esac
+		deps=
+		for dep in $(modinfo -F depends "$file" | tr , ' '); do
+			dep=$(cd "$dir" && find . -name "$(echo "$dep" |
+				tr _ -).ko*" | sed 's|^\./||' | head -n 1)
+			deps="$deps $dep"
+		done
+		[ "$file" != "$ko" ] && rm -f "$file"
+		echo "$rel|${deps# }|${PARAMS[${rel%%.ko*}]}"
+	done > "$dir/order"
+}
+
+# A profile is built once, also when only asked for compressed
+built=" "
+profile()
+{
+	[[ $built == *" $1 "* ]] && return
+	build "$KDIR" "$1" "$1" "$OUT/variants"
+	built="$built$1 "
+}
+
+for v in ${VARIANTS//,/ }; do
+	case $v in
+	release|debug|size)
+		profile "$v"
+		;;
+	release.zst|release.xz|debug.zst|debug.xz|size.zst|size.xz)
+		profile "${v%.*}"
+		compress "${v%.*}" "$v"
+		;;
+	lto)
+		[ -n "$LTO_KDIR" ] &&
+			build "$LTO_KDIR" release lto "$OUT/variants-lto" 1
+		;;
+	*)
+		echo "unknown variant $v" >&2
+		exit 1
+		;;
+	esac
+done
+for v in $built; do
+	[[ ",$VARIANTS," != *,$v,* ]] && rm -rf "${OUT:?}/variants/$v"
+done
+for dir in "$OUT"/variants*/*; do
+	write_order "$dir"
+done
+
+ACCEL="-accel tcg"
+if [ -w /dev/kvm ]; then
+	ACCEL="-enable-kvm -cpu host"
+else
+	echo "no access to /dev/kvm, emulating: don't trust the numbers" >&2
+fi
+
+# boot <image> <variants dir> <name>
+boot()
+{
+	local rootfs=$OUT/rootfs-$3 cmdline status
+
+	rm -rf "$rootfs"
+	mkdir -p "$rootfs"/{bin,dev,proc,sys,tmp,harness}
+	cp "$BUSYBOX" "$rootfs/bin/busybox"
+	for applet in $("$BUSYBOX" --list); do
+		ln -sf busybox "$rootfs/bin/$applet"
+	done
+	cp -r "$(ls -d "$OUT"/build-*/bin | head -n 1)" "$rootfs/bin/harness"
+	cp -r "$2" "$rootfs/variants"
+	cp "$HARNESS/guest/benchmarks.sh" "$rootfs/harness/"
+	cp "$HARNESS/guest/modprof-init" "$rootfs/init"
+	chmod +x "$rootfs/init"
+	(cd "$rootfs" && find . | cpio -o -H newc --quiet | gzip -1) \
+		> "$OUT/initramfs-$3.cpio.gz" || return
+
+	# initcall_debug messages are KERN_DEBUG: logged, not printed
+	cmdline="console=ttyS0 panic=-1 loglevel=4 log_buf_len=4M"
+	cmdline="$cmdline initcall_debug harness.reps=$REPS"
+
+	echo "booting $1, console in $OUT/console-$3.log"
+	timeout "$TIMEOUT" qemu-system-x86_64 $ACCEL -smp "$CPUS" -m "$MEM" \
+		-display none -monitor none -no-reboot \
+		-kernel "$1" -initrd "$OUT/initramfs-$3.cpio.gz" \
+		-append "$cmdline" \
+		-serial file:"$OUT/console-$3.log" \
+		-serial file:"$OUT/results-$3.log"
+	status=$?
+	[ $status -eq 124 ] && echo "guest timed out after ${TIMEOUT}s" >&2
+	return $status
+}
+
+logs=()
+if [ -d "$OUT/variants" ]; then
+	boot "$IMAGE" "$OUT/variants" main
+	logs+=("$OUT/results-main.log")
+fi
+if [ -d "$OUT/variants-lto" ]; then
+	boot "$LTO_IMAGE" "$OUT/variants-lto" lto
+	logs+=("$OUT/results-lto.log")
+fi
+
+python3 "$HARNESS/report.py" modprof "${logs[@]}" \
+	--variants "$OUT/variants" --variants "$OUT/variants-lto" \
+	--meta kernel_tree="$KDIR" --meta kernel_release="$KREL" \
+	--meta lto_kernel_tree="$LTO_KDIR" --meta loads="$REPS" \
+	--meta cpus="$CPUS" -o "$OUT/modprof.json" || exit 1
+echo "report in $OUT/modprof.json"
@@ -0,0 +1,517 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2017 Bruno E. O. Meneguele <bmeneguele@gmail.com>
+#
+# This program is free software; you can redistribute it and/or modify it under
+# the terms of the GNU General Public License version 2 as published by the
+# Free Software Foundation.
+
+"""
+Turn the results of a harness run into a JSON report, and compare two reports.
+
+    report.py parse <results.log> [--build-status F] [--modules DIR]
+                                  [--meta key=value ...] -o <report.json>
+    report.py compare <base.json> <new.json> [--threshold PCT]
+    report.py crash <run dir>... [--meta key=value ...] -o <report.json>
+    report.py modprof <results.log>... --variants DIR [--meta key=value ...]
+                      -o <report.json>
+
+Benchmarks print whatever they print, the way their modules do. Metrics are
+taken from their output by a few rules matching how this repo prints results:
+
+ - tables: a header line of names, then rows of the same number of columns or
+   more. The first KEY_COLUMNS columns name the row (extra leading words are
+   part of the name), the others are metrics named after their header;
+ - 'name: value' lines;
+ - any other line: '<number> <unit>' and '<name> <number>' pairs, prefixed by
+   what comes before a ':' if there's one.
+
+compare flags metrics that got worse by more than the threshold, when their
+name tells which way is better, as well as benchmarks or module loads that
+stopped working. It exits with 1 if anything was flagged.
+
+crash gathers the runs of crash.sh, whose results.log lines are prefixed by
+the host time they came at, in ms.
+
+modprof joins the load times modprof.sh's guests measured with what the
+modules' ELF files tell about their layout once loaded, and prints a table.
+"""
+
+import argparse
+import json
+import os
+import re
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+# Columns naming a table row, per benchmark, when not 1
+KEY_COLUMNS = {
+    "alloc_bench": 2,       # allocator, size
+    "container_bench": 3,   # container, ids, entries
+    "zcring": 2,            # record size, mode
+}
+
+NUMBER = re.compile(r"^[<>~(]?(-?\d+(?:\.\d+)?)[%),]*$")
+HIGHER_IS_BETTER = re.compile(r"per_sec|/sec|/s\b|mbps|MB/s|throughput",
+                              re.IGNORECASE)
+LOWER_IS_BETTER = re.compile(r"ns\b|_ns|ns/|latency|p\d+\b|_p\d+|miss|fails|"
+                             r"lost|dropped|SYN_DROPPED|\bms\b", re.IGNORECASE)
+
+
+def number(tok):
+    m = NUMBER.match(tok)
+    if not m:
+        return None
+    val = float(m.group(1))
+    return int(val) if val.is_integer() else val
+
+
+def is_word(tok):
+    return number(tok) is None and re.search(r"[A-Za-z]", tok) is not None
+
+
+class Metrics(dict):
+    def add(self, key, val):
+        key = " ".join(key.split())
+        if not key:
+            return
+        name, n = key, 2
+        while name in self:
+            name = "%s#%d" % (key, n)
+            n += 1
+        self[name] = val
+
+
+def parse_pairs(metrics, prefix, text):
+    toks = [t.strip(",;") for t in text.split()]
+    toks = [t for t in toks if t]
+    i = 0
+    while i < len(toks) - 1:
+        a, b = toks[i], toks[i + 1]
+        if number(a) is not None and is_word(b):
+            metrics.add("%s %s" % (prefix, b.strip("()")), number(a))
+            i += 2
+        elif is_word(a) and number(b) is not None:
+            metrics.add("%s %s" % (prefix, a.strip("()")), number(b))
+            i += 2
+        else:
+            i += 1
+
+
+def is_header(toks):
+    return (len(toks) >= 2 and all(is_word(t) for t in toks) and
+            not any(t.endswith(":") for t in toks))
+
+
+def parse_metrics(name, lines):
+    metrics = Metrics()
+    keys = KEY_COLUMNS.get(name, 1)
+    header = None
+
+    for line in lines:
+        toks = line.split()
+        if not toks or line.startswith("#"):
+            header = None
+            continue
+
+        if header and len(toks) >= len(header) and ":" not in line:
+            extra = len(toks) - len(header)
+            row = " ".join(toks[:keys + extra])
+            for col, tok in zip(header[keys:], toks[keys + extra:]):
+                val = number(tok)
+                if val is not None:
+                    metrics.add("%s.%s" % (row, col), val)
+            continue
+        header = None
+
+        if is_header(toks):
+            header = toks
+            continue
+
+        m = re.match(r"^\s*([^:]+):\s*(\S+)\s*$", line)
+        if m and number(m.group(2)) is not None:
+            metrics.add(m.group(1), number(m.group(2)))
+            continue
+
+        label, sep, rest = line.partition(":")
+        if sep and not re.search(r"\d", label):
+            parse_pairs(metrics, label, rest)
+        else:
+            parse_pairs(metrics, "", line)
+
+    return metrics
+
+
+def parse(args):
+    report = {
+        "date": time.strftime("%Y-%m-%dT%H:%M:%S%z"),
+        "meta": dict(kv.split("=", 1) for kv in args.meta),
+        "complete": False,
+        "modules": {},
+        "benchmarks": {},
+    }
+
+    if args.build_status and os.path.exists(args.build_status):
+        with open(args.build_status) as f:
+            report["build"] = dict(line.split() for line in f
+                                   if line.strip())
+
+    if args.modules:
+        for root, _, files in os.walk(args.modules):
+            for ko in sorted(files):
+                if ko.endswith(".ko"):
+                    path = os.path.join(root, ko)
+                    mod = os.path.relpath(path, args.modules)[:-3]
+                    report["modules"][mod] = {
+                        "size": os.path.getsize(path),
+                    }
+
+    bench, output = None, []
+    with open(args.results, errors="replace") as f:
+        for line in f:
+            line = line.rstrip("\r\n")
+            if not line.startswith("@@@ "):
+                if bench:
+                    output.append(line)
+                continue
+
+            toks = line.split()[1:]
+            if toks[0] in ("kernel", "cpus") and len(toks) > 1:
+                report["meta"]["guest_" + toks[0]] = toks[1]
+            elif toks[0] == "module" and len(toks) == 4:
+                mod = report["modules"].setdefault(toks[1], {})
+                mod.setdefault("loads", []).append({
+                    "status": int(toks[2]),
+                    "ms": int(toks[3]),
+                })
+            elif toks[0] == "begin":
+                bench, output = toks[1], []
+            elif toks[0] == "end" and bench == toks[1]:
+                report["benchmarks"][bench] = {
+                    "status": int(toks[2]),
+                    "ms": int(toks[3]),
+                    "metrics": parse_metrics(bench, output),
+                    "output": output,
+                }
+                bench = None
+            elif toks[0] == "done":
+                report["complete"] = True
+
+    # Cut short, by a crash or the timeout
+    if bench:
+        report["benchmarks"][bench] = {
+            "status": None,
+            "metrics": parse_metrics(bench, output),
+            "output": output,
+        }
+
+    with open(args.output, "w") as f:
+        json.dump(report, f, indent=1, sort_keys=True)
+        f.write("\n")
+    return 0 if report["complete"] else 1
+
+
+def direction(metric):
+    if HIGHER_IS_BETTER.search(metric):
+        return 1
+    if LOWER_IS_BETTER.search(metric):
+        return -1
+    return 0
+
+
+def compare(args):
+    with open(args.base) as f:
+        base = json.load(f)
+    with open(args.new) as f:
+        new = json.load(f)
+
+    flagged = []
+    for name, b in sorted(base["benchmarks"].items()):
+        n = new["benchmarks"].get(name)
+        if b.get("status") != 0:
+            continue
+        if not n or n.get("status") != 0:
+            flagged.append("%s: stopped working (status %s)" %
+                           (name, n.get("status") if n else "missing"))
+            continue
+
+        for metric, old in sorted(b["metrics"].items()):
+            cur = n["metrics"].get(metric)
+            sign = direction(metric)
+            if cur is None or not sign or not old:
+                continue
+            change = (cur - old) * 100.0 / abs(old)
+            if change * sign < -args.threshold:
+                flagged.append("%s: %s %s -> %s (%+.1f%%)" %
+                               (name, metric, old, cur, change))
+
+    for mod, b in sorted(base["modules"].items()):
+        n = new["modules"].get(mod, {})
+        if (any(l["status"] == 0 for l in b.get("loads", [])) and
+                any(l["status"] != 0 for l in n.get("loads", []))):
+            flagged.append("%s: fails to load" % mod)
+
+    for line in flagged:
+        print(line)
+    if not flagged:
+        print("nothing got worse by more than %g%%" % args.threshold)
+    return 1 if flagged else 0
+
+
+def crash_run(path):
+    name = os.path.basename(path.rstrip("/"))
+    run = {"method": name.split("-")[0], "status": "no output"}
+    events = []
+    log = os.path.join(path, "results.log")
+    with open(log if os.path.exists(log) else os.devnull,
+              errors="replace") as f:
+        for line in f:
+            stamp, _, text = line.rstrip("\n").partition(" ")
+            if text.startswith("@@@ ") and stamp.isdigit():
+                events.append((int(stamp), text.split()[1:]))
+
+    trigger = None
+    for stamp, toks in events:
+        if toks[0] == "trigger" and trigger is None:
+            trigger = stamp
+            run.update(fault=toks[1], context=toks[2], status="triggered")
+        elif toks[0] == "boot" and trigger is not None:
+            run.setdefault("trigger_to_boot_ms", stamp - trigger)
+        elif toks[0] == "capture":
+            run.update(method=toks[1], status="captured",
+                       dump_bytes=int(toks[2]))
+            if trigger is not None:
+                run["trigger_to_capture_ms"] = stamp - trigger
+            if toks[1] == "pstore":
+                run["records"] = int(toks[3])
+            else:
+                run.update(vmcore_bytes=int(toks[3]), dump_ms=int(toks[4]))
+        elif toks[0] == "survived":
+            run["status"] = "survived"
+        elif toks[0] == "nocapture":
+            run.update(method=toks[1], status="nocapture: " + toks[2])
+
+    status = os.path.join(path, "qemu-status")
+    if os.path.exists(status):
+        with open(status) as f:
+            run["qemu_status"] = int(f.read())
+    return run
+
+
+def crash(args):
+    report = {
+        "date": time.strftime("%Y-%m-%dT%H:%M:%S%z"),
+        "meta": dict(kv.split("=", 1) for kv in args.meta),
+        "runs": {},
+    }
+    for path in args.runs:
+        report["runs"][os.path.basename(path.rstrip("/"))] = crash_run(path)
+
+    with open(args.output, "w") as f:
+        json.dump(report, f, indent=1, sort_keys=True)
+        f.write("\n")
+    return 0
+
+
+PAGE_SIZE = 4096
+# Sections the module loader makes read-only once init is done
+RO_AFTER_INIT = (".data..ro_after_init", "__jump_table")
+# readelf -S -W: name, size, flags and alignment
+SECTION = re.compile(r"^\s*\[\s*\d+\]\s+(\S+)\s+\S+\s+[0-9a-f]+\s+"
+                     r"[0-9a-f]+\s+([0-9a-f]+)\s+[0-9a-f]+\s+([A-Za-z]*)\s+"
+                     r"\d+\s+\d+\s+(\d+)")
+RELOCS = re.compile(r"^Relocation section '\.rela?(\S+)' .* "
+                    r"contains (\d+) entr")
+
+
+def mem_type(name, flags):
+    """The struct module_memory an allocated section goes to, as the loader
+    lays them out; None for the others."""
+    if "A" not in flags:
+        return None
+    if "X" in flags:
+        t = "text"
+    elif name in RO_AFTER_INIT:
+        return "ro_after_init"
+    elif "W" in flags:
+        t = "data"
+    else:
+        t = "rodata"
+    return ("init_" if name.startswith(".init") else "") + t
+
+
+def elf_layout(path):
+    """Sizes and pages, core and init, relocations and imports of a module.
+    The core copy of the symbol table kallsyms keeps isn't accounted, the
+    coresize the guest read is."""
+    tmp = None
+    if path.endswith((".zst", ".xz")):
+        tool = ["zstd", "-dcq"] if path.endswith(".zst") else ["xz", "-dc"]
+        tmp = tempfile.NamedTemporaryFile(suffix=".ko")
+        subprocess.run(tool + [path], stdout=tmp, check=True)
+        tmp.flush()
+        elf = tmp.name
+    else:
+        elf = path
+
+    def tool(*args):
+        return subprocess.run(list(args) + [elf], capture_output=True,
+                              text=True, check=True).stdout.splitlines()
+
+    types, sections = {}, {}
+    for line in tool("readelf", "-S", "-W"):
+        m = SECTION.match(line)
+        if not m:
+            continue
+        name, size, flags, align = (m.group(1), int(m.group(2), 16),
+                                    m.group(3), max(int(m.group(4)), 1))
+        t = mem_type(name, flags)
+        sections[name] = t
+        if t:
+            cur = types.get(t, 0)
+            types[t] = (cur + align - 1) // align * align + size
+
+    relocs = {"core": 0, "init": 0}
+    for line in tool("readelf", "-r", "-W"):
+        m = RELOCS.match(line)
+        # Only relocations of allocated sections are applied
+        if m and sections.get(m.group(1)):
+            init = sections[m.group(1)].startswith("init_")
+            relocs["init" if init else "core"] += int(m.group(2))
+
+    layout = {
+        "file_bytes": os.path.getsize(path),
+        "sections": types,
+        "relocs_core": relocs["core"],
+        "relocs_init": relocs["init"],
+        "imports": len(tool("nm", "-u")),
+    }
+    for part in ("core", "init"):
+        sizes = [s for t, s in types.items()
+                 if t.startswith("init_") == (part == "init")]
+        layout[part + "_bytes"] = sum(sizes)
+        layout[part + "_pages"] = sum((s + PAGE_SIZE - 1) // PAGE_SIZE
+                                      for s in sizes)
+    if tmp:
+        tmp.close()
+    return layout
+
+
+def modprof(args):
+    report = {
+        "date": time.strftime("%Y-%m-%dT%H:%M:%S%z"),
+        "meta": dict(kv.split("=", 1) for kv in args.meta),
+        "variants": {},
+    }
+
+    roots = [d for d in args.variants if os.path.isdir(d)]
+    for root in roots:
+        for variant in sorted(os.listdir(root)):
+            vdir = os.path.join(root, variant)
+            mods = report["variants"].setdefault(variant, {})
+            for dirpath, _, files in os.walk(vdir):
+                for f in sorted(files):
+                    if ".ko" not in f:
+                        continue
+                    path = os.path.join(dirpath, f)
+                    mod = os.path.relpath(path, vdir).split(".ko")[0]
+                    mods[mod] = elf_layout(path)
+
+    # Init function times, of the module last loaded in each variant
+    last = {}
+    for log in args.logs:
+        with open(log, errors="replace") as f:
+            for line in f:
+                toks = line.split()
+                if len(toks) < 2 or toks[0] != "@@@":
+                    continue
+                if toks[1] == "modload" and len(toks) == 11:
+                    variant, mod = toks[2], toks[3].split(".ko")[0]
+                    entry = report["variants"].setdefault(variant, {})
+                    entry = entry.setdefault(mod, {})
+                    entry.update({
+                        "status": int(toks[5]),
+                        "loads": int(toks[6]),
+                        "load_min_us": int(toks[7]) / 1000.0,
+                        "load_us": int(toks[8]) / 1000.0,
+                        "load_max_us": int(toks[9]) / 1000.0,
+                        "coresize": int(toks[10]),
+                        "initcalls": [],
+                    })
+                    last[variant] = (toks[4], entry)
+                elif toks[1] == "initcall" and len(toks) == 5:
+                    name, entry = last.get(toks[2], (None, None))
+                    if name == toks[3]:
+                        entry["initcalls"].append(int(toks[4]))
+
+    rows = []
+    for variant, mods in sorted(report["variants"].items()):
+        for mod, entry in sorted(mods.items()):
+            calls = entry.pop("initcalls", None)
+            if calls:
+                entry["init_us"] = statistics.median(calls)
+                if entry.get("loads"):
+                    entry["loader_us"] = round(entry["load_us"] -
+                                               entry["init_us"], 1)
+            rows.append((mod, variant, entry))
+
+    with open(args.output, "w") as f:
+        json.dump(report, f, indent=1, sort_keys=True)
+        f.write("\n")
+
+    fmt = "%-34s %-12s %8s %5s %5s %7s %7s %9s %9s"
+    print(fmt % ("module", "variant", "file_kb", "core", "init", "relocs",
+                 "imports", "load_us", "init_us"))
+    for mod, variant, e in sorted(rows):
+        print(fmt % (mod, variant, "%.1f" % (e.get("file_bytes", 0) / 1024.0),
+                     e.get("core_pages", "-"), e.get("init_pages", "-"),
+                     e.get("relocs_core", 0) + e.get("relocs_init", 0),
+                     e.get("imports", "-"),
+                     e["load_us"] if e.get("loads") else
+                     "failed" if "status" in e else "-",
+                     e.get("init_us", "-")))
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[1])
+    sub = parser.add_subparsers(dest="cmd", required=True)
+
+    p = sub.add_parser("parse", help="results.log to a JSON report")
+    p.add_argument("results")
+    p.add_argument("-o", "--output", required=True)
+    p.add_argument("--build-status")
+    p.add_argument("--modules", help="directory of the built modules")
+    p.add_argument("--meta", action="append", default=[],
+                   help="key=value stored as it is in the report")
+
+    c = sub.add_parser("compare", help="flag what got worse between reports")
+    c.add_argument("base")
+    c.add_argument("new")
+    c.add_argument("--threshold", type=float, default=10.0,
+                   help="percent of change tolerated (default: 10)")
+
+    r = sub.add_parser("crash", help="crash.sh runs to a JSON report")
+    r.add_argument("runs", nargs="+")
+    r.add_argument("-o", "--output", required=True)
+    r.add_argument("--meta", action="append", default=[],
+                   help="key=value stored as it is in the report")
+
+    m = sub.add_parser("modprof", help="modprof.sh results to a JSON report")
+    m.add_argument("logs", nargs="*")
+    m.add_argument("-o", "--output", required=True)
+    m.add_argument("--variants", action="append", default=[],
+                   help="directory of variants' module directories")
+    m.add_argument("--meta", action="append", default=[],
+                   help="key=value stored as it is in the report")
+
+    args = parser.parse_args()
+    return {"parse": parse, "compare": compare, "crash": crash,
+            "modprof": modprof}[args.cmd](args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,116 @@
+#!/bin/bash
+#
+# Build every module against a kernel tree, boot that kernel in QEMU with a
+# minimal initramfs, load the modules and run their benchmarks, and turn it all
+# into a single JSON report. Nothing is loaded on the host, no root needed.
+#
+# Usage: ./run.sh -k <kernel tree> [options]
+#
+#  -k <dir>	kernel tree the modules are built against, already built
+#  -i <file>	kernel image to boot (default: the tree's bzImage). It must
+#		be the one of the tree: modules are only loaded by the kernel
+#		they were built for
+#  -p <profile>	release, debug or size (default: release), see
+#		common/profile.mk
+#  -o <dir>	output directory (default: results/<kernel release>-<profile>)
+#  -b <file>	static busybox binary (default: the one in PATH)
+#  -c <cpus>	guest CPUs (default: 4)
+#  -m <MB>	guest memory (default: 2048)
+#  -t <secs>	give up on the guest after that long (default: 1800)
+#  -B <list>	comma separated benchmarks to run, see guest/benchmarks.sh
+#
+# The kernel needs, built in: devtmpfs, debugfs, the 8250 serial console and
+# initramfs support; evdev for the my-kbd benchmarks and dynamic debug as the
+# modules expect it. Compare two reports with report.py compare.
+
+HARNESS=$(cd "$(dirname "$0")" && pwd)
+PROFILE=release
+CPUS=4
+MEM=2048
+TIMEOUT=1800
+BUSYBOX=$(command -v busybox)
+
+while getopts "k:i:p:o:b:c:m:t:B:" opt; do
+	case $opt in
+	k) KDIR=$OPTARG ;;
+	i) IMAGE=$OPTARG ;;
+	p) PROFILE=$OPTARG ;;
+	o) OUT=$OPTARG ;;
+	b) BUSYBOX=$OPTARG ;;
+	c) CPUS=$OPTARG ;;
+	m) MEM=$OPTARG ;;
+	t) TIMEOUT=$OPTARG ;;
+	B) BENCH=$OPTARG ;;
+	*) exit 1 ;;
+	esac
+done
+
+if [ -z "$KDIR" ]; then
+	echo "usage: $0 -k <kernel tree> [options], see the script's header" >&2
+	exit 1
+fi
+KDIR=$(cd "$KDIR" && pwd) || exit 1
+IMAGE=${IMAGE:-$KDIR/arch/x86/boot/bzImage}
+KREL=$(make -s -C "$KDIR" kernelrelease 2>/dev/null)
+OUT=${OUT:-results/$KREL-$PROFILE}
+
+if [ ! -f "$IMAGE" ]; then
+	echo "no kernel image at $IMAGE, see -i" >&2
+	exit 1
+fi
+if [ -z "$BUSYBOX" ] || ! file -L "$BUSYBOX" | grep -q "statically linked"; then
+	echo "a statically linked busybox is needed, see -b" >&2
+	exit 1
+fi
+
+mkdir -p "$OUT"
+OUT=$(cd "$OUT" && pwd)
+
+echo "building against $KDIR ($KREL), $PROFILE profile"
+"$HARNESS/build.sh" "$KDIR" "$PROFILE" "$OUT" ||
+	echo "some builds failed, their benchmarks will too" >&2
+
+# Initramfs: busybox, the modules, the userspace programs and the benchmarks
+ROOTFS=$OUT/rootfs
+rm -rf "$ROOTFS"
+mkdir -p "$ROOTFS"/{bin,dev,proc,sys,tmp,harness}
+cp "$BUSYBOX" "$ROOTFS/bin/busybox"
+for applet in $("$BUSYBOX" --list); do
+	ln -sf busybox "$ROOTFS/bin/$applet"
+done
+cp -r "$OUT/modules" "$ROOTFS/modules"
+cp -r "$OUT/bin" "$ROOTFS/bin/harness"
+cp "$HARNESS/guest/benchmarks.sh" "$ROOTFS/harness/"
+cp "$HARNESS/guest/init" "$ROOTFS/init"
+chmod +x "$ROOTFS/init"
+(cd "$ROOTFS" && find . | cpio -o -H newc --quiet | gzip -1) \
+	> "$OUT/initramfs.cpio.gz" || exit 1
+
+# Without KVM the numbers are meaningless, but at least it all runs
+ACCEL="-accel tcg"
+if [ -w /dev/kvm ]; then
+	ACCEL="-enable-kvm -cpu host"
+else
+	echo "no access to /dev/kvm, emulating: don't trust the numbers" >&2
+fi
+
+# First serial port for the console, second for the results
+echo "booting $IMAGE, console in $OUT/console.log"
+: > "$OUT/results.log"
+CMDLINE="console=ttyS0 panic=-1 loglevel=4 ${BENCH:+harness.bench=$BENCH}"
+timeout "$TIMEOUT" qemu-system-x86_64 $ACCEL -smp "$CPUS" -m "$MEM" \
+	-display none -monitor none -no-reboot \
+	-kernel "$IMAGE" -initrd "$OUT/initramfs.cpio.gz" \
+	-append "$CMDLINE" \
+	-serial file:"$OUT/console.log" -serial file:"$OUT/results.log"
+status=$?
+if [ $status -eq 124 ]; then
+	echo "guest timed out after ${TIMEOUT}s" >&2
+fi
+
+python3 "$HARNESS/report.py" parse "$OUT/results.log" \
+	--build-status "$OUT/build-status" --modules "$OUT/modules" \
+	--meta kernel_tree="$KDIR" --meta kernel_release="$KREL" \
+	--meta profile="$PROFILE" --meta cpus="$CPUS" --meta mem_mb="$MEM" \
+	--meta qemu_status="$status" -o "$OUT/report.json" || exit 1
+echo "report in $OUT/report.json"
@@ -0,0 +1,532 @@
+/*
+ * Copyright (c) 2017 Bruno E. O. Meneguele <bmeneguele@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ */
+
+/*
+ * Allocation benchmark: kmalloc, vmalloc, kvmalloc, alloc_pages and
+ * kmem_cache_alloc, for every power of two size from 8 B to 64 MiB.
+ *
+ * Each allocator and size runs on 'threads' kernel threads (0 meaning one per
+ * online CPU), each one allocating and freeing a buffer in a loop. Latencies
+ * of both calls go into log2 histograms, from which percentiles are taken.
+ * Allocations are then accessed one byte per page to show the TLB cost of each
+ * kind of mapping: kmalloc and alloc_pages memory lives in the kernel's linear
+ * mapping, usually backed by huge pages, while vmalloc maps every 4 KiB page
+ * on its own.
+ *
+ * With 'fragment' set, memory is fragmented before the run (order-0 pages are
+ * allocated and every other one freed) and allocations don't retry hard, so
+ * the failure rate of large physically contiguous allocations shows up.
+ *
+ *	# echo 0 > /sys/module/alloc_bench/parameters/threads
+ *	# echo 1 > /sys/kernel/debug/alloc-bench/run
+ *	# cat /sys/kernel/debug/alloc-bench/results
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/gfp.h>
+#include <linux/vmalloc.h>
+#include <linux/kthread.h>
+#include <linux/cpu.h>
+#include <linux/completion.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/mutex.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/perf_event.h>
+
+#include "utils.h"
+#include "pak-common.h"
+
+static unsigned int threads = 1;
+module_param(threads, uint, 0644);
+MODULE_PARM_DESC(threads, "Threads per run, 0 for one per online CPU");
+
+static unsigned int max_iters = 1024;
+module_param(max_iters, uint, 0644);
+MODULE_PARM_DESC(max_iters, "Allocations per thread for the smallest sizes");
+
+static unsigned int budget_mb = 64;
+module_param(budget_mb, uint, 0644);
+MODULE_PARM_DESC(budget_mb, "Bytes allocated per thread and size, at most");
+
+static bool fragment;
+module_param(fragment, bool, 0644);
+MODULE_PARM_DESC(fragment, "Fragment memory before the run");
+
+static unsigned int fragment_mb = 512;
+module_param(fragment_mb, uint, 0644);
+MODULE_PARM_DESC(fragment_mb, "Memory taken to fragment it, half is kept");
+
+#define BENCH_MIN_SHIFT 3	/* 8 B */
+#define BENCH_MAX_SHIFT 26	/* 64 MiB */
+#define BENCH_NR_SIZES (BENCH_MAX_SHIFT - BENCH_MIN_SHIFT + 1)
+#define BENCH_MIN_ITERS 8
+
+/* Latency histograms, in log2 buckets of nanoseconds */
+#define BENCH_HIST_BUCKETS 40
+
+enum bench_alloc {
+	BENCH_KMALLOC,
+	BENCH_VMALLOC,
+	BENCH_KVMALLOC,
+	BENCH_PAGES,
+	BENCH_KMEM_CACHE,
+	BENCH_NR_ALLOCS,
+};
+
+static const char * const bench_alloc_names[] = {
+	[BENCH_KMALLOC] = "kmalloc",
+	[BENCH_VMALLOC] = "vmalloc",
+	[BENCH_KVMALLOC] = "kvmalloc",
+	[BENCH_PAGES] = "alloc_pages",
+	[BENCH_KMEM_CACHE] = "kmem_cache",
+};
+
+/* What a thread measures: one allocator and size */
+struct bench_job {
+	enum bench_alloc type;
+	size_t size;
+	unsigned int iters;
+	gfp_t gfp;
+	struct kmem_cache *cache;
+};
+
+struct bench_thread {
+	struct task_struct *task;
+	struct bench_job *job;
+	/* Its iterations are over, results may be read */
+	struct completion done;
+	u64 fails;
+	unsigned long alloc_hist[BENCH_HIST_BUCKETS];
+	unsigned long free_hist[BENCH_HIST_BUCKETS];
+};
+
+struct bench_result {
+	enum bench_alloc type;
+	size_t size;
+	unsigned int nthreads;
+	u64 ops;
+	u64 fails;
+	unsigned long alloc_hist[BENCH_HIST_BUCKETS];
+	unsigned long free_hist[BENCH_HIST_BUCKETS];
+	u64 touch_ns;		/* per page, 0 if not measured */
+	s64 dtlb_misses;	/* per 1000 pages, -1 if not available */
+};
+
+/* Serializes runs and results reading */
+static DEFINE_MUTEX(bench_mutex);
+static struct bench_result bench_results[BENCH_NR_ALLOCS * BENCH_NR_SIZES];
+static unsigned int bench_nr_results;
+static bool bench_fragmented;
+static DECLARE_COMPLETION(bench_start);
+
+/* Where the bytes read by bench_touch() go, so that reading isn't optimized
+ * out */
+static u64 bench_sink;
+
+/* Pages kept by the memory fragmentation, chained through page->lru */
+static LIST_HEAD(bench_frag_pages);
+
+/* Directory holding the module's debugfs files */
+static struct dentry *bench_debugfs;
+
+/* Sizes some allocators can't do at all */
+static bool bench_supported(enum bench_alloc type, size_t size)
+{
+	switch (type) {
+	case BENCH_KMALLOC:
+	case BENCH_KMEM_CACHE:
+	case BENCH_PAGES:
+		return size <= KMALLOC_MAX_SIZE;
+	default:
+		return true;
+	}
+}
+
+static void *bench_alloc_one(struct bench_job *job)
+{
+	struct page *page;
+
+	switch (job->type) {
+	case BENCH_KMALLOC:
+		return kmalloc(job->size, job->gfp);
+	case BENCH_VMALLOC:
+		return __vmalloc(job->size, job->gfp);
+	case BENCH_KVMALLOC:
+		return kvmalloc(job->size, job->gfp);
+	case BENCH_PAGES:
+		page = alloc_pages(job->gfp, get_order(job->size));
+		return page ? page_address(page) : NULL;
+	case BENCH_KMEM_CACHE:
+		return kmem_cache_alloc(job->cache, job->gfp);
+	default:
+		return NULL;
+	}
+}
+
+static void bench_free_one(struct bench_job *job, void *buf)
+{
+	switch (job->type) {
+	case BENCH_KMALLOC:
+		kfree(buf);
+		break;
+	case BENCH_VMALLOC:
+		vfree(buf);
+		break;
+	case BENCH_KVMALLOC:
+		kvfree(buf);
+		break;
+	case BENCH_PAGES:
+		free_pages((unsigned long)buf, get_order(job->size));
+		break;
+	case BENCH_KMEM_CACHE:
+		kmem_cache_free(job->cache, buf);
+		break;
+	default:
+		break;
+	}
+}
+
+static int bench_thread_fn(void *arg)
+{
+	struct bench_thread *t = arg;
+	struct bench_job *job = t->job;
+	unsigned int i;
+	void *buf;
+	u64 t0;
+
+	wait_for_completion(&bench_start);
+
+	for (i = 0; i < job->iters; i++) {
+		t0 = ktime_get_ns();
+		buf = bench_alloc_one(job);
+		t->alloc_hist[pak_hist_bucket(ktime_get_ns() - t0,
+					      BENCH_HIST_BUCKETS)]++;
+		if (!buf) {
+			t->fails++;
+			continue;
+		}
+
+		/* Touch the first byte, the allocation must really be used */
+		*(volatile char *)buf = 1;
+
+		t0 = ktime_get_ns();
+		bench_free_one(job, buf);
+		t->free_hist[pak_hist_bucket(ktime_get_ns() - t0,
+					     BENCH_HIST_BUCKETS)]++;
+		cond_resched();
+	}
+	complete(&t->done);
+
+	/* Wait to be collected by kthread_stop() */
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+/* Latency below which 'permille' of the samples are */
+static u64 bench_percentile(const unsigned long *hist, unsigned int permille)
+{
+	return pak_hist_percentile(hist, BENCH_HIST_BUCKETS, permille);
+}
+
+static struct perf_event *bench_dtlb_create(void)
+{
+	struct perf_event_attr attr = {
+		.type = PERF_TYPE_HW_CACHE,
+		.size = sizeof(attr),
+		.config = PERF_COUNT_HW_CACHE_DTLB |
+			(PERF_COUNT_HW_CACHE_OP_READ << 8) |
+			(PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+		.disabled = 1,
+		.exclude_hv = 1,
+	};
+	struct perf_event *event;
+
+	event = perf_event_create_kernel_counter(&attr, -1, current, NULL, NULL);
+	return IS_ERR(event) ? NULL : event;
+}
+
+/*
+ * Access cost of the buffer's mapping: one byte of each page is read, first to
+ * warm the caches up and then measured, both in time and in dTLB load misses.
+ */
+static void bench_touch(struct bench_job *job, struct bench_result *res)
+{
+	unsigned long npages = job->size >> PAGE_SHIFT, i;
+	u64 enabled, running, misses = 0, start, sum = 0;
+	struct perf_event *dtlb;
+	char *buf;
+
+	res->dtlb_misses = -1;
+	if (!npages)
+		return;
+
+	buf = bench_alloc_one(job);
+	if (!buf)
+		return;
+
+	for (i = 0; i < npages; i++)
+		sum += READ_ONCE(buf[i << PAGE_SHIFT]);
+
+	dtlb = bench_dtlb_create();
+	if (dtlb) {
+		misses = perf_event_read_value(dtlb, &enabled, &running);
+		perf_event_enable(dtlb);
+	}
+	start = ktime_get_ns();
+	for (i = 0; i < npages; i++)
+		sum += READ_ONCE(buf[i << PAGE_SHIFT]);
+	res->touch_ns = div64_u64(ktime_get_ns() - start, npages);
+	if (dtlb) {
+		perf_event_disable(dtlb);
+		misses = perf_event_read_value(dtlb, &enabled, &running) -
+			 misses;
+		res->dtlb_misses = div64_u64(misses * 1000, npages);
+		perf_event_release_kernel(dtlb);
+	}
+
+	bench_free_one(job, buf);
+	bench_sink = sum;
+}
+
+static int bench_run_job(struct bench_job *job, struct bench_result *res)
+{
+	struct bench_thread *bthreads;
+	unsigned int n = 0, i, b, cpu, nthreads;
+	int err = 0;
+
+	nthreads = threads ? min(threads, num_online_cpus()) :
+			     num_online_cpus();
+	bthreads = kcalloc(nthreads, sizeof(*bthreads), GFP_KERNEL);
+	if (!bthreads)
+		return -ENOMEM;
+
+	reinit_completion(&bench_start);
+	/* CPUs only have to stay online while threads are bound to them: a
+	 * thread whose CPU goes away later is just moved elsewhere */
+	cpus_read_lock();
+	for_each_online_cpu(cpu) {
+		struct bench_thread *t = &bthreads[n];
+
+		if (n == nthreads)
+			break;
+		t->job = job;
+		init_completion(&t->done);
+		t->task = kthread_create_on_node(bench_thread_fn, t,
+						 cpu_to_node(cpu),
+						 "alloc_bench/%u", cpu);
+		if (IS_ERR(t->task)) {
+			err = PTR_ERR(t->task);
+			break;
+		}
+		kthread_bind(t->task, cpu);
+		wake_up_process(t->task);
+		n++;
+	}
+	cpus_read_unlock();
+	complete_all(&bench_start);
+
+	memset(res, 0, sizeof(*res));
+	res->type = job->type;
+	res->size = job->size;
+	res->nthreads = n;
+	for (i = 0; i < n; i++) {
+		struct bench_thread *t = &bthreads[i];
+
+		/* A thread stopped before it first ran would never run its
+		 * function: wait for its iterations to be done first */
+		wait_for_completion(&t->done);
+		kthread_stop(t->task);
+		res->fails += t->fails;
+		for (b = 0; b < BENCH_HIST_BUCKETS; b++) {
+			res->alloc_hist[b] += t->alloc_hist[b];
+			res->free_hist[b] += t->free_hist[b];
+		}
+	}
+	res->ops = (u64)n * job->iters;
+
+	kfree(bthreads);
+	if (!err)
+		bench_touch(job, res);
+	return err;
+}
+
+/*
+ * Take 'fragment_mb' of order-0 pages and give every other one back, leaving
+ * free memory full of holes no larger than a page.
+ */
+static void bench_fragment(void)
+{
+	unsigned long i, n = ((unsigned long)fragment_mb << 20) >> PAGE_SHIFT;
+	struct page *page;
+
+	for (i = 0; i < n; i++) {
+		page = alloc_page(GFP_KERNEL | __GFP_NORETRY | __GFP_NOWARN);
+		if (!page)
+			break;
+		if (i & 1)
+			__free_page(page);
+		else
+			list_add(&page->lru, &bench_frag_pages);
+		cond_resched();
+	}
+	PR_DEBUG("%lu pages kept to fragment memory\n", (i + 1) / 2);
+}
+
+static void bench_unfragment(void)
+{
+	struct page *page, *tmp;
+
+	list_for_each_entry_safe(page, tmp, &bench_frag_pages, lru)
+		__free_page(page);
+	INIT_LIST_HEAD(&bench_frag_pages);
+}
+
+static int bench_run(void)
+{
+	struct bench_result *res = bench_results;
+	struct bench_job job;
+	unsigned int shift;
+	char name[32];
+	int err = 0;
+
+	bench_nr_results = 0;
+	bench_fragmented = fragment;
+	if (fragment)
+		bench_fragment();
+
+	for (job.type = 0; job.type < BENCH_NR_ALLOCS; job.type++) {
+		for (shift = BENCH_MIN_SHIFT; shift <= BENCH_MAX_SHIFT; shift++) {
+			job.size = 1UL << shift;
+			if (!bench_supported(job.type, job.size))
+				continue;
+
+			job.iters = clamp_t(u64, ((u64)budget_mb << 20) >> shift,
+					    BENCH_MIN_ITERS, max_iters);
+			/* Failures are counted, not warned about, and under
+			 * fragmentation they must not be hidden by reclaim and
+			 * compaction retrying hard */
+			job.gfp = GFP_KERNEL | __GFP_NOWARN;
+			if (fragment)
+				job.gfp |= __GFP_NORETRY;
+
+			job.cache = NULL;
+			if (job.type == BENCH_KMEM_CACHE) {
+				snprintf(name, sizeof(name), "alloc_bench_%zu",
+					 job.size);
+				job.cache = kmem_cache_create(name, job.size, 0,
+							      0, NULL);
+				/* Too large objects for the slab allocator */
+				if (!job.cache)
+					continue;
+			}
+
+			err = bench_run_job(&job, res);
+			kmem_cache_destroy(job.cache);
+			if (err)
+				goto out;
+			res++;
+			bench_nr_results++;
+		}
+	}
+
+out:
+	bench_unfragment();
+	return err;
+}
+
+/*
+ * Function called everytime the run debugfs file is written, it returns only
+ * once every allocator and size was measured.
+ * Example: echo 1 > /sys/kernel/debug/alloc-bench/run
+ */
+static ssize_t bench_run_write(struct file *file, const char __user *buf,
+			       size_t count, loff_t *ppos)
+{
+	int err;
+
+	mutex_lock(&bench_mutex);
+	err = bench_run();
+	mutex_unlock(&bench_mutex);
+
+	return err ? err : count;
+}
+
+static const struct file_operations bench_run_fops = {
+	.owner = THIS_MODULE,
+	.write = bench_run_write,
+	.llseek = noop_llseek,
+};
+
+static int bench_results_show(struct seq_file *m, void *v)
+{
+	struct bench_result *res;
+	unsigned int i;
+
+	mutex_lock(&bench_mutex);
+	if (!bench_nr_results)
+		goto out;
+
+	seq_printf(m, "# fragmented: %s\n", bench_fragmented ? "yes" : "no");
+	seq_printf(m, "%-12s %10s %7s %8s %8s %9s %9s %9s %9s %9s %9s %8s %10s\n",
+		   "allocator", "size", "threads", "ops", "fails",
+		   "alloc_p50", "alloc_p90", "alloc_p99",
+		   "free_p50", "free_p90", "free_p99",
+		   "touch_ns", "dtlb_miss");
+	for (i = 0; i < bench_nr_results; i++) {
+		res = &bench_results[i];
+		seq_printf(m, "%-12s %10zu %7u %8llu %8llu %9llu %9llu %9llu %9llu %9llu %9llu %8llu %10lld\n",
+			   bench_alloc_names[res->type], res->size,
+			   res->nthreads, res->ops, res->fails,
+			   bench_percentile(res->alloc_hist, 500),
+			   bench_percentile(res->alloc_hist, 900),
+			   bench_percentile(res->alloc_hist, 990),
+			   bench_percentile(res->free_hist, 500),
+			   bench_percentile(res->free_hist, 900),
+			   bench_percentile(res->free_hist, 990),
+			   res->touch_ns, res->dtlb_misses);
+	}
+out:
+	mutex_unlock(&bench_mutex);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(bench_results);
+
+static int __init alloc_bench_init(void)
+{
+	bench_debugfs = debugfs_create_dir("alloc-bench", NULL);
+	debugfs_create_file("run", 0200, bench_debugfs, NULL, &bench_run_fops);
+	debugfs_create_file("results", 0444, bench_debugfs, NULL,
+			    &bench_results_fops);
+
+	PR_DEBUG("hello world!\n");
+	return 0;
+}
+
+static void __exit alloc_bench_exit(void)
+{
+	debugfs_remove_recursive(bench_debugfs);
+	PR_DEBUG("bye world!\n");
+}
+
+module_init(alloc_bench_init);
+module_exit(alloc_bench_exit);
+
+MODULE_AUTHOR("Bruno E. O. Meneguele <bmeneguele@gmail.com>");
+MODULE_DESCRIPTION("kmalloc/vmalloc/kvmalloc/alloc_pages/kmem_cache benchmark");
+MODULE_LICENSE("GPL");
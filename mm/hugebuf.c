@@ -0,0 +1,538 @@
+/*
+ * Copyright (c) 2017 Bruno E. O. Meneguele <bmeneguele@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ */
+
+/*
+ * Huge page backed buffer provider (see hugebuf.h).
+ *
+ * Besides the in-kernel API, buffers are handed to user space by mmap()ing
+ * /dev/hugebuf: every mmap() call gets a buffer of its own, as large as the
+ * mapping, released when the mapping goes away. Pages are inserted in the
+ * process page tables as regular (refcounted) pages, so user space may pin
+ * them, e.g. for O_DIRECT, and that shows up in the page counters.
+ *
+ * debugfs files, under /sys/kernel/debug/hugebuf/:
+ *
+ *  - buffers: every live buffer, with its kernel references, user mappings
+ *    and, for each chunk, the page refcount and whether it is pinned;
+ *  - bench: write to run the access benchmark, read for its results. The
+ *    same amount of memory is read sequentially and at random, once from a
+ *    huge page buffer and once from a buffer forced to fall back to 4 KiB
+ *    pages, showing the cost of the TLB misses the latter takes.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/gfp.h>
+#include <linux/vmalloc.h>
+#include <linux/page_ref.h>
+#include <linux/miscdevice.h>
+#include <linux/fs.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/mutex.h>
+#include <linux/random.h>
+#include <linux/prandom.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/perf_event.h>
+
+#include "hugebuf.h"
+#include "utils.h"
+
+static unsigned int max_huge;
+module_param(max_huge, uint, 0644);
+MODULE_PARM_DESC(max_huge, "Huge chunks in use at most, 0 for no limit");
+
+static unsigned int bench_mb = 256;
+module_param(bench_mb, uint, 0644);
+MODULE_PARM_DESC(bench_mb, "Size of the benchmark buffers");
+
+static unsigned int bench_accesses = 10000000;
+module_param(bench_accesses, uint, 0644);
+MODULE_PARM_DESC(bench_accesses, "Random accesses of the benchmark");
+
+/* Live buffers, for debugfs */
+static DEFINE_MUTEX(hugebuf_lock);
+static LIST_HEAD(hugebuf_list);
+static unsigned int hugebuf_next_id;
+static atomic_t hugebuf_huge_in_use = ATOMIC_INIT(0);
+static atomic_long_t hugebuf_fallbacks = ATOMIC_LONG_INIT(0);
+
+/* Set by the benchmark to get a buffer of 4 KiB pages only */
+static bool hugebuf_force_fallback;
+
+/* Directory holding the module's debugfs files */
+static struct dentry *hugebuf_debugfs;
+
+/* Account a huge chunk about to be allocated, if still allowed to */
+static bool hugebuf_take_huge(void)
+{
+	unsigned int limit = READ_ONCE(max_huge);
+
+	if (READ_ONCE(hugebuf_force_fallback))
+		return false;
+	if (atomic_inc_return(&hugebuf_huge_in_use) > limit && limit) {
+		atomic_dec(&hugebuf_huge_in_use);
+		return false;
+	}
+	return true;
+}
+
+static int hugebuf_chunk_alloc(struct hugebuf_chunk *chunk, gfp_t gfp)
+{
+	unsigned int i;
+
+	if (hugebuf_take_huge()) {
+		/* Don't try hard: falling back is cheaper than waiting for
+		 * compaction */
+		chunk->head = alloc_pages(gfp | __GFP_COMP | __GFP_NORETRY |
+					  __GFP_NOWARN, HUGEBUF_CHUNK_ORDER);
+		if (chunk->head) {
+			chunk->vaddr = page_address(chunk->head);
+			return 0;
+		}
+		atomic_dec(&hugebuf_huge_in_use);
+	}
+
+	/* No huge page, fall back to order-0 pages mapped together */
+	atomic_long_inc(&hugebuf_fallbacks);
+	chunk->pages = kvcalloc(HUGEBUF_CHUNK_PAGES, sizeof(struct page *),
+				GFP_KERNEL);
+	if (!chunk->pages)
+		return -ENOMEM;
+
+	for (i = 0; i < HUGEBUF_CHUNK_PAGES; i++) {
+		chunk->pages[i] = alloc_page(gfp);
+		if (!chunk->pages[i])
+			goto free_pages;
+	}
+
+	chunk->vaddr = vmap(chunk->pages, HUGEBUF_CHUNK_PAGES, VM_MAP,
+			    PAGE_KERNEL);
+	if (!chunk->vaddr)
+		goto free_pages;
+	return 0;
+
+free_pages:
+	while (i--)
+		__free_page(chunk->pages[i]);
+	kvfree(chunk->pages);
+	chunk->pages = NULL;
+	return -ENOMEM;
+}
+
+static void hugebuf_chunk_free(struct hugebuf_chunk *chunk)
+{
+	unsigned int i;
+
+	if (chunk->head) {
+		/* Pages still mapped or pinned by someone else keep their
+		 * own references, they are only freed once those go away */
+		__free_pages(chunk->head, HUGEBUF_CHUNK_ORDER);
+		atomic_dec(&hugebuf_huge_in_use);
+		return;
+	}
+
+	if (!chunk->pages)
+		return;
+	vunmap(chunk->vaddr);
+	for (i = 0; i < HUGEBUF_CHUNK_PAGES; i++)
+		__free_page(chunk->pages[i]);
+	kvfree(chunk->pages);
+}
+
+static void hugebuf_free(struct hugebuf *buf)
+{
+	unsigned int i;
+
+	for (i = 0; i < buf->nr_chunks; i++)
+		hugebuf_chunk_free(&buf->chunks[i]);
+	kfree(buf);
+}
+
+struct hugebuf *hugebuf_alloc(size_t size, gfp_t gfp)
+{
+	unsigned int i, nr_chunks = DIV_ROUND_UP(size, HUGEBUF_CHUNK_SIZE);
+	struct hugebuf *buf;
+
+	if (!nr_chunks)
+		return ERR_PTR(-EINVAL);
+
+	buf = kzalloc(struct_size(buf, chunks, nr_chunks), GFP_KERNEL);
+	if (!buf)
+		return ERR_PTR(-ENOMEM);
+
+	kref_init(&buf->ref);
+	atomic_set(&buf->nr_maps, 0);
+	buf->size = (size_t)nr_chunks << HUGEBUF_CHUNK_SHIFT;
+	for (i = 0; i < nr_chunks; i++) {
+		if (hugebuf_chunk_alloc(&buf->chunks[i], gfp)) {
+			buf->nr_chunks = i;
+			hugebuf_free(buf);
+			return ERR_PTR(-ENOMEM);
+		}
+		if (buf->chunks[i].head)
+			buf->nr_huge++;
+	}
+	buf->nr_chunks = nr_chunks;
+
+	mutex_lock(&hugebuf_lock);
+	buf->id = hugebuf_next_id++;
+	list_add_tail(&buf->list, &hugebuf_list);
+	mutex_unlock(&hugebuf_lock);
+	return buf;
+}
+EXPORT_SYMBOL_GPL(hugebuf_alloc);
+
+void hugebuf_get(struct hugebuf *buf)
+{
+	kref_get(&buf->ref);
+}
+EXPORT_SYMBOL_GPL(hugebuf_get);
+
+static void hugebuf_release(struct kref *ref)
+{
+	struct hugebuf *buf = container_of(ref, struct hugebuf, ref);
+
+	mutex_lock(&hugebuf_lock);
+	list_del(&buf->list);
+	mutex_unlock(&hugebuf_lock);
+	hugebuf_free(buf);
+}
+
+void hugebuf_put(struct hugebuf *buf)
+{
+	kref_put(&buf->ref, hugebuf_release);
+}
+EXPORT_SYMBOL_GPL(hugebuf_put);
+
+/* User space mappings: each one holds a reference to its buffer, shared by
+ * the VMAs it may be split into */
+static void hugebuf_vm_open(struct vm_area_struct *vma)
+{
+	struct hugebuf *buf = vma->vm_private_data;
+
+	atomic_inc(&buf->nr_maps);
+	hugebuf_get(buf);
+}
+
+static void hugebuf_vm_close(struct vm_area_struct *vma)
+{
+	struct hugebuf *buf = vma->vm_private_data;
+
+	atomic_dec(&buf->nr_maps);
+	hugebuf_put(buf);
+}
+
+static const struct vm_operations_struct hugebuf_vm_ops = {
+	.open = hugebuf_vm_open,
+	.close = hugebuf_vm_close,
+};
+
+/*
+ * Insert every page of the buffer right away, nothing is left to be faulted
+ * in. Each chunk is inserted with 4 KiB entries, huge ones included: mapping
+ * them with a PMD would need a PFN mapping, losing the page refcounting
+ * pinning relies on.
+ */
+static int hugebuf_dev_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	unsigned long size = vma->vm_end - vma->vm_start, addr, num;
+	struct page **pages;
+	struct hugebuf *buf;
+	unsigned int i, j;
+	int err;
+
+	if (vma->vm_pgoff)
+		return -EINVAL;
+
+	buf = hugebuf_alloc(size, GFP_KERNEL | __GFP_ZERO);
+	if (IS_ERR(buf))
+		return PTR_ERR(buf);
+
+	pages = kvmalloc_array(HUGEBUF_CHUNK_PAGES, sizeof(*pages), GFP_KERNEL);
+	if (!pages) {
+		err = -ENOMEM;
+		goto err_put;
+	}
+
+	vm_flags_set(vma, VM_DONTEXPAND | VM_DONTDUMP);
+	addr = vma->vm_start;
+	for (i = 0; i < buf->nr_chunks && addr < vma->vm_end; i++) {
+		for (j = 0; j < HUGEBUF_CHUNK_PAGES; j++)
+			pages[j] = hugebuf_chunk_page(&buf->chunks[i], j);
+
+		num = min_t(unsigned long, HUGEBUF_CHUNK_PAGES,
+			    (vma->vm_end - addr) >> PAGE_SHIFT);
+		err = vm_insert_pages(vma, addr, pages, &num);
+		if (err)
+			goto err_free;
+		addr += HUGEBUF_CHUNK_SIZE;
+	}
+	kvfree(pages);
+
+	/* The allocation reference is now the mapping's one */
+	vma->vm_private_data = buf;
+	vma->vm_ops = &hugebuf_vm_ops;
+	atomic_inc(&buf->nr_maps);
+	return 0;
+
+err_free:
+	kvfree(pages);
+err_put:
+	hugebuf_put(buf);
+	return err;
+}
+
+static const struct file_operations hugebuf_dev_fops = {
+	.owner = THIS_MODULE,
+	.mmap = hugebuf_dev_mmap,
+};
+
+static struct miscdevice hugebuf_dev = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = "hugebuf",
+	.fops = &hugebuf_dev_fops,
+	.mode = 0666,
+};
+
+static void hugebuf_show_chunk(struct seq_file *m, struct hugebuf_chunk *chunk)
+{
+	struct page *page = hugebuf_chunk_page(chunk, 0);
+
+	/* Huge chunks share a single refcount, held by the head page. For
+	 * the fallback ones only the first page is shown */
+	seq_printf(m, " %s:%d%s", chunk->head ? "huge" : "4k",
+		   page_ref_count(page),
+		   page_maybe_dma_pinned(page) ? ":pinned" : "");
+}
+
+static int hugebuf_buffers_show(struct seq_file *m, void *v)
+{
+	struct hugebuf *buf;
+	unsigned int i;
+
+	mutex_lock(&hugebuf_lock);
+	seq_printf(m, "huge chunks in use: %d\n",
+		   atomic_read(&hugebuf_huge_in_use));
+	seq_printf(m, "fallback chunks allocated: %ld\n",
+		   atomic_long_read(&hugebuf_fallbacks));
+	list_for_each_entry(buf, &hugebuf_list, list) {
+		seq_printf(m, "buffer %u: size %zu huge %u/%u refs %u maps %d\n",
+			   buf->id, buf->size, buf->nr_huge, buf->nr_chunks,
+			   kref_read(&buf->ref), atomic_read(&buf->nr_maps));
+		seq_puts(m, "  chunks:");
+		for (i = 0; i < buf->nr_chunks; i++)
+			hugebuf_show_chunk(m, &buf->chunks[i]);
+		seq_putc(m, '\n');
+	}
+	mutex_unlock(&hugebuf_lock);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(hugebuf_buffers);
+
+/* Access benchmark results, for each kind of buffer */
+struct hugebuf_bench_result {
+	bool valid;
+	unsigned int nr_huge;
+	unsigned int nr_chunks;
+	u64 seq_ns;		/* per 4 KiB page read sequentially */
+	u64 rand_ns;		/* per random access */
+	s64 seq_dtlb;		/* dTLB misses per 1000 accesses, -1 if n/a */
+	s64 rand_dtlb;
+};
+
+static DEFINE_MUTEX(hugebuf_bench_lock);
+static struct hugebuf_bench_result hugebuf_bench_results[2];
+static u64 hugebuf_bench_sink;
+
+static struct perf_event *hugebuf_dtlb_create(void)
+{
+	struct perf_event_attr attr = {
+		.type = PERF_TYPE_HW_CACHE,
+		.size = sizeof(attr),
+		.config = PERF_COUNT_HW_CACHE_DTLB |
+			(PERF_COUNT_HW_CACHE_OP_READ << 8) |
+			(PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+		.disabled = 1,
+		.exclude_hv = 1,
+	};
+	struct perf_event *event;
+
+	event = perf_event_create_kernel_counter(&attr, -1, current, NULL, NULL);
+	return IS_ERR(event) ? NULL : event;
+}
+
+static u64 hugebuf_dtlb_read(struct perf_event *event)
+{
+	u64 enabled, running;
+
+	return event ? perf_event_read_value(event, &enabled, &running) : 0;
+}
+
+/*
+ * Sequential pass: a word of every cache line. Random pass: one word at a
+ * random offset of the whole buffer, the address computation being the same
+ * for both kinds of buffer.
+ */
+static void hugebuf_bench_one(struct hugebuf *buf,
+			      struct hugebuf_bench_result *res)
+{
+	struct perf_event *dtlb = hugebuf_dtlb_create();
+	unsigned long off, npages = buf->size >> PAGE_SHIFT;
+	struct rnd_state rnd;
+	u64 start, misses, sum = 0;
+	unsigned int i;
+	char *vaddr;
+
+	if (dtlb)
+		perf_event_enable(dtlb);
+
+	misses = hugebuf_dtlb_read(dtlb);
+	start = ktime_get_ns();
+	for (i = 0; i < buf->nr_chunks; i++) {
+		vaddr = hugebuf_chunk(buf, i);
+		for (off = 0; off < HUGEBUF_CHUNK_SIZE; off += 64)
+			sum += READ_ONCE(*(u64 *)(vaddr + off));
+		cond_resched();
+	}
+	res->seq_ns = div64_u64(ktime_get_ns() - start, npages);
+	res->seq_dtlb = div64_u64((hugebuf_dtlb_read(dtlb) - misses) * 1000,
+				  buf->size / 64);
+
+	prandom_seed_state(&rnd, 42);
+	misses = hugebuf_dtlb_read(dtlb);
+	start = ktime_get_ns();
+	for (i = 0; i < bench_accesses; i++) {
+		off = ((u64)prandom_u32_state(&rnd) << 6) % buf->size;
+		vaddr = hugebuf_chunk(buf, off >> HUGEBUF_CHUNK_SHIFT);
+		sum += READ_ONCE(*(u64 *)(vaddr +
+					  (off & (HUGEBUF_CHUNK_SIZE - 1))));
+	}
+	res->rand_ns = div64_u64(ktime_get_ns() - start, bench_accesses);
+	res->rand_dtlb = div64_u64((hugebuf_dtlb_read(dtlb) - misses) * 1000,
+				   bench_accesses);
+
+	if (dtlb) {
+		perf_event_disable(dtlb);
+		perf_event_release_kernel(dtlb);
+	} else {
+		res->seq_dtlb = res->rand_dtlb = -1;
+	}
+
+	res->nr_huge = buf->nr_huge;
+	res->nr_chunks = buf->nr_chunks;
+	res->valid = true;
+	hugebuf_bench_sink = sum;
+}
+
+static int hugebuf_bench_run(void)
+{
+	struct hugebuf *buf;
+	int i;
+
+	if (!bench_mb || !bench_accesses)
+		return -EINVAL;
+
+	/* Huge pages first, then 4 KiB pages only */
+	for (i = 0; i < 2; i++) {
+		WRITE_ONCE(hugebuf_force_fallback, i);
+		buf = hugebuf_alloc((size_t)bench_mb << 20, GFP_KERNEL);
+		WRITE_ONCE(hugebuf_force_fallback, false);
+		if (IS_ERR(buf))
+			return PTR_ERR(buf);
+
+		hugebuf_bench_one(buf, &hugebuf_bench_results[i]);
+		hugebuf_put(buf);
+	}
+	return 0;
+}
+
+static ssize_t hugebuf_bench_write(struct file *file, const char __user *ubuf,
+				   size_t count, loff_t *ppos)
+{
+	int err;
+
+	mutex_lock(&hugebuf_bench_lock);
+	err = hugebuf_bench_run();
+	mutex_unlock(&hugebuf_bench_lock);
+
+	return err ? err : count;
+}
+
+static int hugebuf_bench_show(struct seq_file *m, void *v)
+{
+	static const char * const names[] = { "huge", "4k" };
+	struct hugebuf_bench_result *res;
+	int i;
+
+	mutex_lock(&hugebuf_bench_lock);
+	seq_printf(m, "%-6s %12s %10s %10s %10s %10s\n", "buffer", "huge",
+		   "seq_ns", "seq_dtlb", "rand_ns", "rand_dtlb");
+	for (i = 0; i < 2; i++) {
+		res = &hugebuf_bench_results[i];
+		if (!res->valid)
+			continue;
+		seq_printf(m, "%-6s %7u/%-4u %10llu %10lld %10llu %10lld\n",
+			   names[i], res->nr_huge, res->nr_chunks, res->seq_ns,
+			   res->seq_dtlb, res->rand_ns, res->rand_dtlb);
+	}
+	mutex_unlock(&hugebuf_bench_lock);
+	return 0;
+}
+
+static int hugebuf_bench_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, hugebuf_bench_show, NULL);
+}
+
+static const struct file_operations hugebuf_bench_fops = {
+	.owner = THIS_MODULE,
+	.open = hugebuf_bench_open,
+	.read = seq_read,
+	.write = hugebuf_bench_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int __init hugebuf_init(void)
+{
+	int err;
+
+	err = misc_register(&hugebuf_dev);
+	if (err) {
+		PR_ERROR("failed to register /dev/hugebuf: %d\n", err);
+		return err;
+	}
+
+	hugebuf_debugfs = debugfs_create_dir("hugebuf", NULL);
+	debugfs_create_file("buffers", 0444, hugebuf_debugfs, NULL,
+			    &hugebuf_buffers_fops);
+	debugfs_create_file("bench", 0600, hugebuf_debugfs, NULL,
+			    &hugebuf_bench_fops);
+
+	PR_DEBUG("hello world!\n");
+	return 0;
+}
+
+static void __exit hugebuf_exit(void)
+{
+	debugfs_remove_recursive(hugebuf_debugfs);
+	misc_deregister(&hugebuf_dev);
+	PR_DEBUG("bye world!\n");
+}
+
+module_init(hugebuf_init);
+module_exit(hugebuf_exit);
+
+MODULE_AUTHOR("Bruno E. O. Meneguele <bmeneguele@gmail.com>");
+MODULE_DESCRIPTION("Huge page backed buffer provider");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2017 Bruno E. O. Meneguele <bmeneguele@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ */
+
+/*
+ * Huge page backed buffers, provided by hugebuf.ko.
+ *
+ * A buffer is made of 2 MiB chunks. Each chunk is a compound page of the PMD
+ * order whenever the page allocator has one, being then reached through the
+ * kernel's linear mapping, where a single TLB entry covers it whole. When huge
+ * pages are exhausted the chunk falls back to order-0 pages, mapped together
+ * with vmap(). Users must not assume a buffer is virtually contiguous across
+ * chunks: each chunk's address is taken with hugebuf_chunk().
+ *
+ * Buffers are reference counted, the last hugebuf_put() frees them.
+ */
+
+#ifndef __HUGEBUF_H
+#define __HUGEBUF_H
+
+#include <linux/types.h>
+#include <linux/kref.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+
+#define HUGEBUF_CHUNK_SHIFT 21
+#define HUGEBUF_CHUNK_SIZE (1UL << HUGEBUF_CHUNK_SHIFT)
+#define HUGEBUF_CHUNK_ORDER (HUGEBUF_CHUNK_SHIFT - PAGE_SHIFT)
+#define HUGEBUF_CHUNK_PAGES (1U << HUGEBUF_CHUNK_ORDER)
+
+struct hugebuf_chunk {
+	void *vaddr;
+	struct page *head;	/* compound page, NULL when falling back */
+	struct page **pages;	/* fallback order-0 pages, vmap'ed */
+};
+
+struct hugebuf {
+	struct kref ref;
+	struct list_head list;	/* in the provider's list of buffers */
+	unsigned int id;
+	size_t size;
+	unsigned int nr_chunks;
+	unsigned int nr_huge;
+	atomic_t nr_maps;	/* user space mappings */
+	struct hugebuf_chunk chunks[];
+};
+
+/* 'size' is rounded up to whole chunks */
+struct hugebuf *hugebuf_alloc(size_t size, gfp_t gfp);
+void hugebuf_get(struct hugebuf *buf);
+void hugebuf_put(struct hugebuf *buf);
+
+static inline void *hugebuf_chunk(struct hugebuf *buf, unsigned int idx)
+{
+	return buf->chunks[idx].vaddr;
+}
+
+/* Page backing the 'idx'-th 4 KiB of a chunk */
+static inline struct page *hugebuf_chunk_page(struct hugebuf_chunk *chunk,
+					      unsigned int idx)
+{
+	return chunk->head ? nth_page(chunk->head, idx) : chunk->pages[idx];
+}
+
+#endif /* __HUGEBUF_H */
@@ -4,17 +4,21 @@
 #include <linux/slab.h>
 #include <linux/mm.h>
 #include <linux/page_ref.h>
+#include <linux/gfp.h>
+#include <linux/percpu.h>
+#include <linux/irqflags.h>
+#include <linux/mempool.h>
+#include <linux/vmalloc.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/nodemask.h>
+#include <linux/topology.h>
+#include <linux/workqueue.h>
+#include <linux/random.h>
+#include <linux/prandom.h>
 
-#define __PR_FMT(log_level, fmt, ...) \
-	printk(log_level "[%s] %s:%d:: " fmt, \
-	       KBUILD_MODNAME , __func__, __LINE__, ##__VA_ARGS__)
-
-#define PR_DEBUG(fmt, ...) \
-	__PR_FMT(KERN_NOTICE, fmt, ##__VA_ARGS__)
-
-#define PR_ERROR(fmt, ...) \
-	__PR_FMT(KERN_ERR, fmt, ##__VA_ARGS__)
-
+#include "my-alloc.h"
+#include "utils.h"
 
 struct test {
 	/* Kernel has its own defined types, for example these used in this
@@ -25,6 +29,751 @@ struct test {
 	u32 second;
 };
 
+static bool bench = true;
+module_param(bench, bool, 0444);
+MODULE_PARM_DESC(bench, "Benchmark the allocators at load time");
+
+static unsigned int bench_objs = 100000;
+module_param(bench_objs, uint, 0444);
+MODULE_PARM_DESC(bench_objs, "Objects allocated in each benchmark round");
+
+/*
+ * Arena regions are carved from their own pages, this header lives at the very
+ * beginning of each of them.
+ */
+struct my_arena_region {
+	struct list_head list;
+	unsigned int order;
+	size_t off;	/* first free byte, from the region's start */
+};
+
+#define MY_ARENA_HDR ALIGN(sizeof(struct my_arena_region), 64)
+
+void my_arena_init(struct my_arena *arena, unsigned int order, gfp_t gfp)
+{
+	INIT_LIST_HEAD(&arena->regions);
+	INIT_LIST_HEAD(&arena->spare);
+	arena->order = order;
+	arena->gfp = gfp;
+	arena->used = 0;
+	arena->reserved = 0;
+}
+EXPORT_SYMBOL_GPL(my_arena_init);
+
+/* 'need' counts from the start of the region, its header included */
+static struct my_arena_region *my_arena_grow(struct my_arena *arena,
+					     size_t need)
+{
+	struct my_arena_region *region;
+	unsigned int order = max_t(unsigned int, arena->order,
+				   get_order(need));
+	struct page *page;
+
+	/* Regions kept by the last reset are all of the arena's order */
+	region = list_first_entry_or_null(&arena->spare,
+					  struct my_arena_region, list);
+	if (region && order == arena->order) {
+		list_move_tail(&region->list, &arena->regions);
+	} else {
+		page = alloc_pages(arena->gfp, order);
+		if (!page)
+			return NULL;
+		region = page_address(page);
+		region->order = order;
+		list_add_tail(&region->list, &arena->regions);
+		arena->reserved += PAGE_SIZE << order;
+	}
+
+	region->off = MY_ARENA_HDR;
+	return region;
+}
+
+/*
+ * Bump allocation: align the current region's offset and move it past the
+ * object. Only when the object doesn't fit a new region is taken, the room
+ * left in the previous one is simply wasted. 'align' must be a power of two no
+ * larger than a page, 0 meaning the natural alignment of a u64.
+ */
+void *my_arena_alloc(struct my_arena *arena, size_t size, size_t align)
+{
+	struct my_arena_region *region;
+	size_t off;
+
+	if (!align)
+		align = __alignof__(u64);
+
+	region = list_last_entry_or_null(&arena->regions,
+					 struct my_arena_region, list);
+	if (region) {
+		off = ALIGN(region->off, align);
+		if (off + size <= (PAGE_SIZE << region->order))
+			goto out;
+	}
+
+	/* Regions are page aligned: the object lands at the same offset in
+	 * any of them, past the header rounded up to 'align' */
+	region = my_arena_grow(arena, ALIGN(MY_ARENA_HDR, align) + size);
+	if (!region)
+		return NULL;
+	off = ALIGN(region->off, align);
+	if (WARN_ON_ONCE(off + size > (PAGE_SIZE << region->order)))
+		return NULL;
+out:
+	region->off = off + size;
+	arena->used += size;
+	return (char *)region + off;
+}
+EXPORT_SYMBOL_GPL(my_arena_alloc);
+
+static void my_arena_region_free(struct my_arena *arena,
+				 struct my_arena_region *region)
+{
+	list_del(&region->list);
+	arena->reserved -= PAGE_SIZE << region->order;
+	free_pages((unsigned long)region, region->order);
+}
+
+/*
+ * Free every object at once. Regions are kept for the next round of
+ * allocations, except the oversized ones taken for large objects.
+ */
+void my_arena_reset(struct my_arena *arena)
+{
+	struct my_arena_region *region, *tmp;
+
+	list_for_each_entry_safe(region, tmp, &arena->regions, list) {
+		if (region->order == arena->order)
+			list_move_tail(&region->list, &arena->spare);
+		else
+			my_arena_region_free(arena, region);
+	}
+	arena->used = 0;
+}
+EXPORT_SYMBOL_GPL(my_arena_reset);
+
+void my_arena_destroy(struct my_arena *arena)
+{
+	struct my_arena_region *region, *tmp;
+
+	my_arena_reset(arena);
+	list_for_each_entry_safe(region, tmp, &arena->spare, list)
+		my_arena_region_free(arena, region);
+}
+EXPORT_SYMBOL_GPL(my_arena_destroy);
+
+/* Free objects are chained through their first word */
+#define MY_POOL_NEXT(obj) (*(void **)(obj))
+
+int my_pool_init_node(struct my_pool *pool, size_t obj_size, gfp_t gfp,
+		      int nid)
+{
+	obj_size = ALIGN(max(obj_size, sizeof(void *)), sizeof(void *));
+	if (obj_size > PAGE_SIZE)
+		return -EINVAL;
+
+	pool->cpu = alloc_percpu(struct my_pool_cpu);
+	if (!pool->cpu)
+		return -ENOMEM;
+
+	pool->obj_size = obj_size;
+	pool->gfp = gfp;
+	pool->nid = nid;
+	spin_lock_init(&pool->lock);
+	pool->free = NULL;
+	pool->nr_free = 0;
+	INIT_LIST_HEAD(&pool->pages);
+	pool->nr_pages = 0;
+	return 0;
+}
+EXPORT_SYMBOL_GPL(my_pool_init_node);
+
+/* Carve a new page into objects and hand them to the shared freelist */
+static int my_pool_grow(struct my_pool *pool)
+{
+	unsigned int i, n = PAGE_SIZE / pool->obj_size;
+	unsigned long flags;
+	struct page *page;
+	char *base;
+
+	/* NUMA_NO_NODE means the node of the CPU running this */
+	page = alloc_pages_node(pool->nid, pool->gfp, 0);
+	if (!page)
+		return -ENOMEM;
+
+	base = page_address(page);
+	for (i = 0; i < n - 1; i++)
+		MY_POOL_NEXT(base + i * pool->obj_size) =
+			base + (i + 1) * pool->obj_size;
+
+	spin_lock_irqsave(&pool->lock, flags);
+	MY_POOL_NEXT(base + i * pool->obj_size) = pool->free;
+	pool->free = base;
+	pool->nr_free += n;
+	list_add(&page->lru, &pool->pages);
+	pool->nr_pages++;
+	spin_unlock_irqrestore(&pool->lock, flags);
+	return 0;
+}
+
+/* Move up to a batch of objects from the shared freelist, IRQs disabled */
+static void my_pool_refill(struct my_pool *pool, struct my_pool_cpu *pc)
+{
+	void *obj;
+
+	spin_lock(&pool->lock);
+	while (pool->free && pc->nr < MY_POOL_BATCH) {
+		obj = pool->free;
+		pool->free = MY_POOL_NEXT(obj);
+		pool->nr_free--;
+		MY_POOL_NEXT(obj) = pc->free;
+		pc->free = obj;
+		pc->nr++;
+	}
+	spin_unlock(&pool->lock);
+}
+
+/* Give a batch of objects back to the shared freelist, IRQs disabled */
+static void my_pool_drain(struct my_pool *pool, struct my_pool_cpu *pc)
+{
+	unsigned int i;
+	void *obj;
+
+	spin_lock(&pool->lock);
+	for (i = 0; i < MY_POOL_BATCH; i++) {
+		obj = pc->free;
+		pc->free = MY_POOL_NEXT(obj);
+		pc->nr--;
+		MY_POOL_NEXT(obj) = pool->free;
+		pool->free = obj;
+		pool->nr_free++;
+	}
+	spin_unlock(&pool->lock);
+}
+
+void *my_pool_alloc(struct my_pool *pool)
+{
+	struct my_pool_cpu *pc;
+	unsigned long flags;
+	void *obj;
+
+	/* Interrupts are disabled instead of only preemption since IRQ
+	 * handlers may use the pool too, on this very CPU */
+	for (;;) {
+		local_irq_save(flags);
+		pc = this_cpu_ptr(pool->cpu);
+		if (!pc->free)
+			my_pool_refill(pool, pc);
+		obj = pc->free;
+		if (obj) {
+			pc->free = MY_POOL_NEXT(obj);
+			pc->nr--;
+		}
+		local_irq_restore(flags);
+
+		if (obj || my_pool_grow(pool))
+			return obj;
+	}
+}
+EXPORT_SYMBOL_GPL(my_pool_alloc);
+
+void my_pool_free(struct my_pool *pool, void *obj)
+{
+	struct my_pool_cpu *pc;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	pc = this_cpu_ptr(pool->cpu);
+	MY_POOL_NEXT(obj) = pc->free;
+	pc->free = obj;
+	/* Don't let a CPU that only frees hoard the objects allocated by
+	 * others */
+	if (++pc->nr >= 2 * MY_POOL_BATCH)
+		my_pool_drain(pool, pc);
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL_GPL(my_pool_free);
+
+/* Every object must have been freed already */
+void my_pool_destroy(struct my_pool *pool)
+{
+	struct page *page, *tmp;
+
+	free_percpu(pool->cpu);
+	list_for_each_entry_safe(page, tmp, &pool->pages, lru)
+		__free_page(page);
+	INIT_LIST_HEAD(&pool->pages);
+	pool->nr_pages = 0;
+}
+EXPORT_SYMBOL_GPL(my_pool_destroy);
+
+/*
+ * Interleaving goes through the online nodes in turn, shared by every user of
+ * the policy.
+ */
+static atomic_t my_interleave_seq = ATOMIC_INIT(0);
+
+static int my_interleave_next(void)
+{
+	unsigned int n = atomic_inc_return(&my_interleave_seq) %
+			 num_online_nodes();
+	int nid;
+
+	for_each_online_node(nid) {
+		if (!n--)
+			return nid;
+	}
+	return first_online_node;
+}
+
+int my_alloc_pick_node(enum my_alloc_policy policy, int nid)
+{
+	switch (policy) {
+	case MY_ALLOC_NODE:
+		return nid;
+	case MY_ALLOC_INTERLEAVE:
+		return my_interleave_next();
+	default:
+		return numa_node_id();
+	}
+}
+EXPORT_SYMBOL_GPL(my_alloc_pick_node);
+
+/* Unless __GFP_THISNODE is given, memory may still come from another node
+ * when the chosen one is out of it */
+void *my_kmalloc_policy(size_t size, gfp_t gfp, enum my_alloc_policy policy,
+			int nid)
+{
+	return kmalloc_node(size, gfp, my_alloc_pick_node(policy, nid));
+}
+EXPORT_SYMBOL_GPL(my_kmalloc_policy);
+
+struct page *my_alloc_pages_policy(gfp_t gfp, unsigned int order,
+				   enum my_alloc_policy policy, int nid)
+{
+	return alloc_pages_node(my_alloc_pick_node(policy, nid), gfp, order);
+}
+EXPORT_SYMBOL_GPL(my_alloc_pages_policy);
+
+int my_node_pool_init(struct my_node_pool *np, size_t obj_size, gfp_t gfp)
+{
+	int nid, err;
+
+	np->pools = kcalloc(nr_node_ids, sizeof(*np->pools), GFP_KERNEL);
+	if (!np->pools)
+		return -ENOMEM;
+
+	for_each_node(nid) {
+		err = my_pool_init_node(&np->pools[nid], obj_size, gfp, nid);
+		if (err)
+			goto err_destroy;
+	}
+	return 0;
+
+err_destroy:
+	while (--nid >= 0) {
+		if (node_possible(nid))
+			my_pool_destroy(&np->pools[nid]);
+	}
+	kfree(np->pools);
+	return err;
+}
+EXPORT_SYMBOL_GPL(my_node_pool_init);
+
+/* NUMA_NO_NODE for the local node */
+void *my_node_pool_alloc(struct my_node_pool *np, int nid)
+{
+	if (nid == NUMA_NO_NODE)
+		nid = numa_node_id();
+	return my_pool_alloc(&np->pools[nid]);
+}
+EXPORT_SYMBOL_GPL(my_node_pool_alloc);
+
+/*
+ * Objects go back to the pool of the node their memory is on. That may not be
+ * the pool they came from, when the page allocator had to fall back to
+ * another node, but pages are only released when all pools are destroyed
+ * together, so that doesn't matter.
+ */
+void my_node_pool_free(struct my_node_pool *np, void *obj)
+{
+	my_pool_free(&np->pools[page_to_nid(virt_to_page(obj))], obj);
+}
+EXPORT_SYMBOL_GPL(my_node_pool_free);
+
+void my_node_pool_destroy(struct my_node_pool *np)
+{
+	int nid;
+
+	for_each_node(nid)
+		my_pool_destroy(&np->pools[nid]);
+	kfree(np->pools);
+}
+EXPORT_SYMBOL_GPL(my_node_pool_destroy);
+
+/*
+ * Benchmark: 'bench_objs' struct test objects are allocated and then freed
+ * with each allocator, twice. Only the second round is reported, the first
+ * one warms up slab caches and pools. Footprint is the memory each allocator
+ * took per object, i.e. the object size plus its internal fragmentation.
+ */
+enum bench_alloc {
+	BENCH_KMALLOC,
+	BENCH_KMEM_CACHE,
+	BENCH_MEMPOOL,
+	BENCH_POOL,
+	BENCH_ARENA,
+	BENCH_NR_ALLOCS,
+};
+
+static const char * const bench_alloc_names[] = {
+	[BENCH_KMALLOC] = "kmalloc",
+	[BENCH_KMEM_CACHE] = "kmem_cache",
+	[BENCH_MEMPOOL] = "mempool",
+	[BENCH_POOL] = "my_pool",
+	[BENCH_ARENA] = "my_arena",
+};
+
+struct bench_ctx {
+	struct kmem_cache *cache;
+	mempool_t *mempool;
+	struct my_pool pool;
+	struct my_arena arena;
+	void **objs;
+};
+
+static void *bench_alloc_one(struct bench_ctx *ctx, enum bench_alloc type)
+{
+	switch (type) {
+	case BENCH_KMALLOC:
+		return kmalloc(sizeof(struct test), GFP_KERNEL);
+	case BENCH_KMEM_CACHE:
+		return kmem_cache_alloc(ctx->cache, GFP_KERNEL);
+	case BENCH_MEMPOOL:
+		return mempool_alloc(ctx->mempool, GFP_KERNEL);
+	case BENCH_POOL:
+		return my_pool_alloc(&ctx->pool);
+	case BENCH_ARENA:
+		return my_arena_alloc(&ctx->arena, sizeof(struct test),
+				      __alignof__(struct test));
+	default:
+		return NULL;
+	}
+}
+
+static void bench_free(struct bench_ctx *ctx, enum bench_alloc type,
+		       unsigned int n)
+{
+	unsigned int i;
+
+	/* Arena objects can't be released one by one, that's the point */
+	if (type == BENCH_ARENA) {
+		my_arena_reset(&ctx->arena);
+		return;
+	}
+
+	for (i = 0; i < n; i++) {
+		switch (type) {
+		case BENCH_KMALLOC:
+			kfree(ctx->objs[i]);
+			break;
+		case BENCH_KMEM_CACHE:
+			kmem_cache_free(ctx->cache, ctx->objs[i]);
+			break;
+		case BENCH_MEMPOOL:
+			mempool_free(ctx->objs[i], ctx->mempool);
+			break;
+		case BENCH_POOL:
+			my_pool_free(&ctx->pool, ctx->objs[i]);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/* Bytes taken per object, measured while all of them are allocated */
+static size_t bench_footprint(struct bench_ctx *ctx, enum bench_alloc type)
+{
+	unsigned long total = 0;
+	unsigned int i;
+
+	switch (type) {
+	case BENCH_KMALLOC:
+		for (i = 0; i < bench_objs; i++)
+			total += ksize(ctx->objs[i]);
+		break;
+	case BENCH_KMEM_CACHE:
+	case BENCH_MEMPOOL:
+		total = (unsigned long)kmem_cache_size(ctx->cache) * bench_objs;
+		break;
+	case BENCH_POOL:
+		total = ctx->pool.nr_pages * PAGE_SIZE;
+		break;
+	case BENCH_ARENA:
+		total = ctx->arena.reserved;
+		break;
+	default:
+		break;
+	}
+	return total / bench_objs;
+}
+
+static int bench_round(struct bench_ctx *ctx, enum bench_alloc type,
+		       u64 *alloc_ns, u64 *free_ns, size_t *footprint)
+{
+	unsigned int i;
+	u64 start;
+
+	start = ktime_get_ns();
+	for (i = 0; i < bench_objs; i++) {
+		ctx->objs[i] = bench_alloc_one(ctx, type);
+		if (!ctx->objs[i])
+			break;
+	}
+	*alloc_ns = ktime_get_ns() - start;
+
+	if (i < bench_objs) {
+		/* Release the ones that made it */
+		bench_free(ctx, type, i);
+		return -ENOMEM;
+	}
+
+	*footprint = bench_footprint(ctx, type);
+
+	start = ktime_get_ns();
+	bench_free(ctx, type, bench_objs);
+	*free_ns = ktime_get_ns() - start;
+	return 0;
+}
+
+static int my_alloc_bench(void)
+{
+	struct bench_ctx ctx = { };
+	enum bench_alloc type;
+	u64 alloc_ns, free_ns;
+	size_t footprint;
+	int err, round;
+
+	ctx.objs = vmalloc(array_size(bench_objs, sizeof(void *)));
+	ctx.cache = kmem_cache_create("my_alloc_test", sizeof(struct test), 0,
+				      0, NULL);
+	if (!ctx.objs || !ctx.cache) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	ctx.mempool = mempool_create_slab_pool(MY_POOL_BATCH, ctx.cache);
+	if (!ctx.mempool) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	err = my_pool_init(&ctx.pool, sizeof(struct test), GFP_KERNEL);
+	if (err)
+		goto out;
+	my_arena_init(&ctx.arena, 4, GFP_KERNEL);
+
+	PR_INFO("%-12s %10s %10s %12s\n", "allocator", "alloc_ns", "free_ns",
+		"bytes/obj");
+	for (type = 0; type < BENCH_NR_ALLOCS; type++) {
+		for (round = 0; round < 2; round++) {
+			err = bench_round(&ctx, type, &alloc_ns, &free_ns,
+					  &footprint);
+			if (err)
+				break;
+			cond_resched();
+		}
+		if (err) {
+			PR_ERROR("%s: allocation failed\n",
+				 bench_alloc_names[type]);
+			break;
+		}
+		PR_INFO("%-12s %10llu %10llu %12zu\n", bench_alloc_names[type],
+			div64_u64(alloc_ns, bench_objs),
+			div64_u64(free_ns, bench_objs), footprint);
+	}
+
+	my_arena_destroy(&ctx.arena);
+	my_pool_destroy(&ctx.pool);
+out:
+	if (ctx.mempool)
+		mempool_destroy(ctx.mempool);
+	kmem_cache_destroy(ctx.cache);
+	vfree(ctx.objs);
+	return err;
+}
+
+/*
+ * NUMA locality benchmark, run at load time on machines with more than one
+ * online node. From a CPU of the first node, buffers of 'numa_bench_mb' are
+ * read sequentially (bandwidth) and through a random pointer chase over their
+ * cache lines (latency), being allocated with each policy: local, bound to
+ * each of the other nodes, and interleaved. To try it out without a NUMA box,
+ * boot QEMU with two nodes, e.g.:
+ *
+ *	-smp 4 -m 2G \
+ *	-object memory-backend-ram,id=m0,size=1G \
+ *	-object memory-backend-ram,id=m1,size=1G \
+ *	-numa node,nodeid=0,cpus=0-1,memdev=m0 \
+ *	-numa node,nodeid=1,cpus=2-3,memdev=m1 \
+ *	-numa dist,src=0,dst=1,val=20
+ */
+static unsigned int numa_bench_mb = 64;
+module_param(numa_bench_mb, uint, 0444);
+MODULE_PARM_DESC(numa_bench_mb, "NUMA benchmark buffer size, 0 disables it");
+
+/* Buffers are made of chunks of this order, each from the policy's node */
+#define NUMA_BENCH_ORDER 9
+#define NUMA_BENCH_CHUNK (PAGE_SIZE << NUMA_BENCH_ORDER)
+#define NUMA_BENCH_LINE 64
+
+struct numa_bench {
+	enum my_alloc_policy policy;
+	int nid;
+	struct page **chunks;
+	unsigned long nr_chunks;
+	u64 seq_mbps;
+	u64 chase_ns;
+};
+
+static void *numa_bench_line(struct numa_bench *nb, unsigned long line)
+{
+	unsigned long off = line * NUMA_BENCH_LINE;
+
+	return page_address(nb->chunks[off / NUMA_BENCH_CHUNK]) +
+		off % NUMA_BENCH_CHUNK;
+}
+
+/* Link every cache line to the next one of a random cycle through them all */
+static int numa_bench_link(struct numa_bench *nb)
+{
+	unsigned long i, j, nr_lines = nb->nr_chunks * NUMA_BENCH_CHUNK /
+				       NUMA_BENCH_LINE;
+	struct rnd_state rnd;
+	u32 *perm;
+
+	perm = vmalloc(array_size(nr_lines, sizeof(*perm)));
+	if (!perm)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_lines; i++)
+		perm[i] = i;
+	prandom_seed_state(&rnd, 42);
+	for (i = nr_lines - 1; i > 0; i--) {
+		j = prandom_u32_state(&rnd) % (i + 1);
+		swap(perm[i], perm[j]);
+	}
+	for (i = 0; i < nr_lines; i++)
+		*(void **)numa_bench_line(nb, perm[i]) =
+			numa_bench_line(nb, perm[(i + 1) % nr_lines]);
+
+	vfree(perm);
+	return 0;
+}
+
+/* Runs on a CPU of the first node, through work_on_cpu() */
+static long numa_bench_measure(void *arg)
+{
+	struct numa_bench *nb = arg;
+	unsigned long i, off, nr_lines = nb->nr_chunks * NUMA_BENCH_CHUNK /
+				       NUMA_BENCH_LINE;
+	u64 start, ns, sum = 0;
+	void *p;
+	int pass;
+
+	/* First pass warms up, second one is measured */
+	for (pass = 0; pass < 2; pass++) {
+		start = ktime_get_ns();
+		for (i = 0; i < nb->nr_chunks; i++) {
+			p = page_address(nb->chunks[i]);
+			for (off = 0; off < NUMA_BENCH_CHUNK; off += sizeof(u64))
+				sum += READ_ONCE(*(u64 *)(p + off));
+		}
+		ns = ktime_get_ns() - start;
+	}
+	/* bytes per ns are GB/s, times 1000 for MB/s */
+	nb->seq_mbps = div64_u64(nb->nr_chunks * NUMA_BENCH_CHUNK * 1000ULL,
+				 ns ?: 1);
+
+	p = numa_bench_line(nb, 0);
+	start = ktime_get_ns();
+	for (i = 0; i < nr_lines; i++)
+		p = READ_ONCE(*(void **)p);
+	nb->chase_ns = div64_u64(ktime_get_ns() - start, nr_lines);
+
+	return sum + (p != NULL);
+}
+
+static int numa_bench_one(struct numa_bench *nb, int cpu)
+{
+	unsigned long i;
+	int err = 0;
+
+	nb->nr_chunks = DIV_ROUND_UP((unsigned long)numa_bench_mb << 20,
+				     NUMA_BENCH_CHUNK);
+	nb->chunks = kcalloc(nb->nr_chunks, sizeof(*nb->chunks), GFP_KERNEL);
+	if (!nb->chunks)
+		return -ENOMEM;
+
+	/* Memory must really come from the node picked, nothing else */
+	for (i = 0; i < nb->nr_chunks; i++) {
+		nb->chunks[i] = my_alloc_pages_policy(GFP_KERNEL |
+						      __GFP_THISNODE |
+						      __GFP_NOWARN,
+						      NUMA_BENCH_ORDER,
+						      nb->policy, nb->nid);
+		if (!nb->chunks[i]) {
+			err = -ENOMEM;
+			goto out;
+		}
+	}
+
+	err = numa_bench_link(nb);
+	if (!err)
+		work_on_cpu(cpu, numa_bench_measure, nb);
+
+out:
+	for (i = 0; i < nb->nr_chunks && nb->chunks[i]; i++)
+		__free_pages(nb->chunks[i], NUMA_BENCH_ORDER);
+	kfree(nb->chunks);
+	return err;
+}
+
+static void my_alloc_numa_bench(void)
+{
+	struct numa_bench nb = { };
+	int cpu = cpumask_first(cpu_online_mask);
+	int local = cpu_to_node(cpu), nid;
+
+	if (num_online_nodes() < 2) {
+		PR_INFO("single NUMA node, skipping the locality benchmark\n");
+		return;
+	}
+
+	PR_INFO("running on CPU %d, node %d\n", cpu, local);
+	PR_INFO("%-12s %6s %10s %10s\n", "policy", "node", "seq_MB/s",
+		"chase_ns");
+
+	nb.policy = MY_ALLOC_NODE;
+	for_each_online_node(nid) {
+		nb.nid = nid;
+		if (numa_bench_one(&nb, cpu)) {
+			PR_ERROR("no memory on node %d\n", nid);
+			continue;
+		}
+		PR_INFO("%-12s %6d %10llu %10llu\n",
+			nid == local ? "local" : "remote", nid, nb.seq_mbps,
+			nb.chase_ns);
+	}
+
+	nb.policy = MY_ALLOC_INTERLEAVE;
+	if (numa_bench_one(&nb, cpu))
+		PR_ERROR("interleaved allocation failed\n");
+	else
+		PR_INFO("%-12s %6s %10llu %10llu\n", "interleave", "all",
+			nb.seq_mbps, nb.chase_ns);
+}
+
 static int __init my_module_init(void)
 {
 	struct test *lets_go, *lets_stop;
@@ -56,6 +805,11 @@ static int __init my_module_init(void)
 	PR_DEBUG("page ref count: %d\n", page_ref_count(any_page));
 
 	kfree(lets_go);
+
+	if (bench && bench_objs && my_alloc_bench())
+		PR_ERROR("allocators benchmark failed\n");
+	if (bench && numa_bench_mb)
+		my_alloc_numa_bench();
 	return 0;
 err:
 	return 1;
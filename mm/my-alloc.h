@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2017 Bruno E. O. Meneguele <bmeneguele@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ */
+
+/*
+ * Allocators exported by my-alloc.ko to other modules.
+ *
+ * Arena: page-backed regions carved with a bump pointer. Allocating is just
+ * moving an offset forward, there is no per-object free: everything goes away
+ * at once with my_arena_reset() or my_arena_destroy(). Meant for short-lived
+ * objects that die together, e.g. the ones built while handling a request.
+ * An arena has no locking, each user must have its own or serialize itself.
+ *
+ * Pool: fixed-size objects, kept in per-CPU freelists so that the common
+ * alloc/free path touches neither a lock nor another CPU's cache lines. The
+ * freelists are refilled from, and drained to, a shared one in batches. Pages
+ * backing the objects are only released when the pool is destroyed. Safe from
+ * any context, as long as the pool is grown from process context with a
+ * sleeping gfp mask or has preallocated objects available.
+ *
+ * NUMA: a pool may be bound to a node, its pages then come from that node.
+ * A node pool is a set of pools, one per node, handing out objects from the
+ * node asked for (the local one by default). Plain allocations can follow the
+ * same policies through my_kmalloc_policy() and my_alloc_pages_policy().
+ */
+
+#ifndef __MY_ALLOC_H
+#define __MY_ALLOC_H
+
+#include <linux/types.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/percpu.h>
+#include <linux/gfp.h>
+#include <linux/numa.h>
+
+/* Node memory is taken from */
+enum my_alloc_policy {
+	MY_ALLOC_LOCAL,		/* node of the CPU allocating */
+	MY_ALLOC_NODE,		/* the node given */
+	MY_ALLOC_INTERLEAVE,	/* round-robin over the online nodes */
+};
+
+int my_alloc_pick_node(enum my_alloc_policy policy, int nid);
+void *my_kmalloc_policy(size_t size, gfp_t gfp, enum my_alloc_policy policy,
+			int nid);
+struct page *my_alloc_pages_policy(gfp_t gfp, unsigned int order,
+				   enum my_alloc_policy policy, int nid);
+
+struct my_arena {
+	struct list_head regions;	/* in use, the current one is last */
+	struct list_head spare;		/* kept by my_arena_reset() */
+	unsigned int order;		/* of each region */
+	gfp_t gfp;
+	size_t used;			/* bytes handed out */
+	size_t reserved;		/* bytes taken from the page allocator */
+};
+
+void my_arena_init(struct my_arena *arena, unsigned int order, gfp_t gfp);
+void *my_arena_alloc(struct my_arena *arena, size_t size, size_t align);
+void my_arena_reset(struct my_arena *arena);
+void my_arena_destroy(struct my_arena *arena);
+
+/* Objects moved at once between a CPU's freelist and the shared one */
+#define MY_POOL_BATCH 32
+
+struct my_pool_cpu {
+	void *free;		/* singly linked through each object's 1st word */
+	unsigned int nr;
+};
+
+struct my_pool {
+	size_t obj_size;
+	gfp_t gfp;
+	int nid;		/* pages' node, NUMA_NO_NODE for the local one */
+	struct my_pool_cpu __percpu *cpu;
+	spinlock_t lock;	/* protects everything below */
+	void *free;
+	unsigned long nr_free;
+	struct list_head pages;
+	unsigned long nr_pages;
+};
+
+int my_pool_init_node(struct my_pool *pool, size_t obj_size, gfp_t gfp,
+		      int nid);
+void *my_pool_alloc(struct my_pool *pool);
+void my_pool_free(struct my_pool *pool, void *obj);
+void my_pool_destroy(struct my_pool *pool);
+
+static inline int my_pool_init(struct my_pool *pool, size_t obj_size,
+			       gfp_t gfp)
+{
+	return my_pool_init_node(pool, obj_size, gfp, NUMA_NO_NODE);
+}
+
+struct my_node_pool {
+	struct my_pool *pools;	/* indexed by node id */
+};
+
+int my_node_pool_init(struct my_node_pool *np, size_t obj_size, gfp_t gfp);
+void *my_node_pool_alloc(struct my_node_pool *np, int nid);
+void my_node_pool_free(struct my_node_pool *np, void *obj);
+void my_node_pool_destroy(struct my_node_pool *np);
+
+#endif /* __MY_ALLOC_H */
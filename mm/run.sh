@@ -1,8 +1,33 @@
 #!/bin/bash
 
 MOD_NAME="my-alloc.ko"
+BENCH_NAME="alloc-bench.ko"
+BENCH_PARAMS=/sys/module/alloc_bench/parameters
+BENCH_DEBUGFS=/sys/kernel/debug/alloc-bench
+# Where the allocation benchmark results are collected, when asked with
+# './run.sh bench'
+RESULTS_DIR=${RESULTS_DIR:-results}
 
+sudo rmmod $BENCH_NAME 2>/dev/null
 sudo rmmod $MOD_NAME
 make
 sudo insmod $MOD_NAME
 dmesg | tail
+
+[ "$1" = "bench" ] || exit 0
+
+# Single threaded and on all CPUs, with memory as it is and fragmented
+sudo insmod $BENCH_NAME || exit 1
+mkdir -p $RESULTS_DIR
+for frag in N Y; do
+	for threads in 1 0; do
+		out=$RESULTS_DIR/alloc-bench-threads$threads-frag$frag.txt
+
+		echo $threads | sudo tee $BENCH_PARAMS/threads >/dev/null
+		echo $frag | sudo tee $BENCH_PARAMS/fragment >/dev/null
+		echo 1 | sudo tee $BENCH_DEBUGFS/run >/dev/null || exit 1
+		sudo cat $BENCH_DEBUGFS/results > $out
+		echo "results saved to $out"
+	done
+done
+sudo rmmod $BENCH_NAME
@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2017 Bruno E. O. Meneguele <bmeneguele@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ */
+
+/*
+ * Consume records from /dev/zcring through read() and straight from the
+ * mapped ring, at several record sizes, printing the throughput of each. The
+ * consumer sums the payload of every record in both cases, as a real one
+ * would look at the data, and the sum is checked against what the producer
+ * wrote: every payload byte is the record's counter, truncated to 8 bits. Build
+ * and run it as:
+ *
+ *	$ gcc -O2 -o zcring-bench zcring-bench.c
+ *	# ./zcring-bench [megabytes per run]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+
+#include "../zcring.h"
+
+#define ZCRING_DEV_FILE "/dev/" ZCRING_DEV_NAME
+#define RING_PAGES 256
+/* Records read() at once */
+#define READ_BATCH 64
+
+static const unsigned int record_sizes[] = { 64, 256, 1024, 4096, 16384 };
+
+static uint64_t consume(const struct zcring_record *rec)
+{
+	const uint8_t *p = rec->payload;
+	uint64_t sum = 0;
+	uint32_t i;
+
+	for (i = 0; i < rec->len; i++)
+		sum += p[i];
+	return sum;
+}
+
+/* Every record's payload filled with (uint8_t)counter */
+static uint64_t expected_sum(unsigned int record_size, uint64_t nr_records)
+{
+	uint64_t full = nr_records / 256, rest = nr_records % 256;
+
+	return record_size * (full * (255 * 256 / 2) + rest * (rest - 1) / 2);
+}
+
+static int ring_open(unsigned int record_size, uint64_t nr_records)
+{
+	struct zcring_setup setup = {
+		.record_size = record_size,
+		.nr_pages = RING_PAGES,
+		.nr_records = nr_records,
+	};
+	int fd;
+
+	fd = open(ZCRING_DEV_FILE, O_RDWR);
+	if (fd < 0) {
+		perror("failed to open " ZCRING_DEV_FILE);
+		return -1;
+	}
+
+	if (ioctl(fd, ZCRING_IOC_SETUP, &setup)) {
+		perror("ring setup failed");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int run_read(int fd, unsigned int slot_size, uint64_t *sum)
+{
+	size_t len = (size_t)slot_size * READ_BATCH, off;
+	char *buf;
+	ssize_t n;
+
+	buf = malloc(len);
+	if (!buf)
+		return -ENOMEM;
+
+	while ((n = read(fd, buf, len)) > 0) {
+		for (off = 0; off < (size_t)n; off += slot_size)
+			*sum += consume((struct zcring_record *)(buf + off));
+	}
+
+	free(buf);
+	return n < 0 ? -errno : 0;
+}
+
+static int run_mmap(int fd, uint64_t *sum)
+{
+	size_t len = (size_t)(RING_PAGES + 1) * getpagesize();
+	struct zcring_ctrl *ctrl;
+	uint64_t head, tail = 0;
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	char *map, *data;
+	int err;
+
+	map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		return -errno;
+
+	ctrl = (struct zcring_ctrl *)map;
+	data = map + ctrl->data_offset;
+	while (tail < ctrl->nr_records) {
+		head = __atomic_load_n(&ctrl->head, __ATOMIC_ACQUIRE);
+		if (head == tail) {
+			if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+				goto err;
+			if (pfd.revents & POLLERR) {
+				errno = EIO;
+				goto err;
+			}
+			continue;
+		}
+
+		for (; tail < head; tail++)
+			*sum += consume((struct zcring_record *)
+					(data + (tail % ctrl->nr_slots) *
+					 ctrl->slot_size));
+		/* Hand the slots back to the producer, and wake it up if it
+		 * sleeps on a full ring */
+		__atomic_store_n(&ctrl->tail, tail, __ATOMIC_RELEASE);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if ((__atomic_load_n(&ctrl->flags, __ATOMIC_RELAXED) &
+		     ZCRING_CTRL_NEED_WAKEUP) &&
+		    ioctl(fd, ZCRING_IOC_WAKEUP))
+			goto err;
+	}
+
+	munmap(map, len);
+	return 0;
+err:
+	err = -errno;
+	munmap(map, len);
+	return err;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long mbytes = 1024;
+	unsigned int i, slot_size;
+	uint64_t nr_records, sum;
+	double start, elapsed;
+	int mode, fd, err;
+
+	if (argc > 1)
+		mbytes = strtoul(argv[1], NULL, 0);
+	if (!mbytes) {
+		fprintf(stderr, "usage: %s [megabytes per run]\n", argv[0]);
+		return -EINVAL;
+	}
+
+	printf("%8s %6s %12s %12s\n", "record", "mode", "MB/s", "records/s");
+	for (i = 0; i < sizeof(record_sizes) / sizeof(record_sizes[0]); i++) {
+		nr_records = (mbytes << 20) / record_sizes[i];
+		slot_size = (sizeof(struct zcring_record) + record_sizes[i] +
+			     7) & ~7U;
+
+		for (mode = 0; mode < 2; mode++) {
+			fd = ring_open(record_sizes[i], nr_records);
+			if (fd < 0)
+				return 1;
+
+			sum = 0;
+			start = now();
+			err = mode ? run_mmap(fd, &sum) :
+				     run_read(fd, slot_size, &sum);
+			elapsed = now() - start;
+			close(fd);
+			if (err) {
+				fprintf(stderr, "run failed: %s\n",
+					strerror(-err));
+				return 1;
+			}
+			if (sum != expected_sum(record_sizes[i], nr_records)) {
+				fprintf(stderr, "%s: bad payload sum %llu\n",
+					mode ? "mmap" : "read",
+					(unsigned long long)sum);
+				return 1;
+			}
+
+			printf("%8u %6s %12.0f %12.0f\n", record_sizes[i],
+			       mode ? "mmap" : "read",
+			       nr_records * record_sizes[i] / elapsed / 1e6,
+			       nr_records / elapsed);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,455 @@
+/*
+ * Copyright (c) 2017 Bruno E. O. Meneguele <bmeneguele@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ */
+
+/*
+ * Zero-copy record ring, see zcring.h for the protocol.
+ *
+ * The ring is made of order-0 pages: the kernel reaches them through vmap(),
+ * user space through its own mapping of the very same pages, inserted with
+ * vm_insert_pages(). A kernel thread per open file produces the records,
+ * which user space consumes either in place, from its mapping, or through
+ * read() and its copy_to_user(). userspace/zcring-bench.c compares both.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/miscdevice.h>
+#include <linux/fs.h>
+#include <linux/poll.h>
+#include <linux/wait.h>
+#include <linux/mutex.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/uaccess.h>
+
+#include "zcring.h"
+#include "utils.h"
+
+#define ZCRING_DEFAULT_PAGES 256
+#define ZCRING_MAX_PAGES 65536
+
+/* Bounds of the producer's sleep on a full ring, between looks at the tail */
+#define ZCRING_BACKOFF_MIN_NS (10 * NSEC_PER_USEC)
+#define ZCRING_BACKOFF_MAX_NS (10 * NSEC_PER_MSEC)
+
+/*
+ * Per open file ring. The control page is mapped writable by user space: the
+ * ring's geometry and the producer's head are only published there, the kernel
+ * works with its own copies. The consumer's tail is the one value read back,
+ * see zcring_tail().
+ */
+struct zcring {
+	struct mutex lock;		/* setup, mmap and readers */
+	struct page **pages;		/* control page, then data pages */
+	unsigned int nr_pages;		/* data pages */
+	struct zcring_ctrl *ctrl;
+	void *data;
+	u32 record_size;
+	u32 slot_size;
+	u32 nr_slots;
+	u64 nr_records;
+	u64 head;			/* records produced */
+	struct task_struct *producer;
+	int err;			/* the producer gave up on a bad tail */
+	wait_queue_head_t wait;		/* consumers waiting for records */
+	wait_queue_head_t space_wait;	/* the producer, on a full ring */
+};
+
+static struct zcring_record *zcring_slot(struct zcring *ring, u64 counter)
+{
+	return ring->data + (u64)(counter % ring->nr_slots) * ring->slot_size;
+}
+
+static bool zcring_ended(struct zcring *ring, u64 head)
+{
+	return head == ring->nr_records;
+}
+
+/*
+ * The consumer's tail, whatever user space wrote there: anything but a tail
+ * between head - nr_slots and head is an error, reported as -EIO.
+ */
+static int zcring_tail(struct zcring *ring, u64 head, u64 *tail)
+{
+	*tail = smp_load_acquire(&ring->ctrl->tail);
+	return head - *tail <= ring->nr_slots ? 0 : -EIO;
+}
+
+static void zcring_publish_head(struct zcring *ring, u64 head)
+{
+	smp_store_release(&ring->head, head);
+	smp_store_release(&ring->ctrl->head, head);
+}
+
+/* Whether the producer may go on, with a valid tail or not */
+static bool zcring_has_space(struct zcring *ring, u64 head)
+{
+	u64 tail;
+
+	return zcring_tail(ring, head, &tail) || head - tail < ring->nr_slots;
+}
+
+/*
+ * Wait for the consumer to release a slot. Consumers going through the mapping
+ * are asked for a wakeup, see zcring.h, and in case one doesn't come the tail
+ * is looked at again after a sleep twice as long as the previous one.
+ */
+static int zcring_wait_space(struct zcring *ring, u64 head)
+{
+	u64 tail, delay = ZCRING_BACKOFF_MIN_NS;
+	int err;
+
+	for (;;) {
+		err = zcring_tail(ring, head, &tail);
+		if (err || head - tail < ring->nr_slots)
+			break;
+		if (kthread_should_stop())
+			return -EINTR;
+
+		WRITE_ONCE(ring->ctrl->flags, ZCRING_CTRL_NEED_WAKEUP);
+		/* Pairs with the consumer's barrier between its tail store and
+		 * its look at the flag */
+		smp_mb();
+		wait_event_interruptible_hrtimeout(ring->space_wait,
+				zcring_has_space(ring, head) ||
+				kthread_should_stop(),
+				ns_to_ktime(delay));
+		delay = min_t(u64, delay * 2, ZCRING_BACKOFF_MAX_NS);
+	}
+
+	WRITE_ONCE(ring->ctrl->flags, 0);
+	return err;
+}
+
+static int zcring_producer_fn(void *arg)
+{
+	struct zcring *ring = arg;
+	u32 len = ring->record_size;
+	struct zcring_record *rec;
+	u64 head;
+	int err;
+
+	for (head = 0; head < ring->nr_records; head++) {
+		err = zcring_wait_space(ring, head);
+		if (err == -EINTR)
+			goto out;
+		if (err) {
+			/* Readers find out from the error, not the tail, which
+			 * user space may have fixed meanwhile */
+			WRITE_ONCE(ring->err, err);
+			wake_up_interruptible(&ring->wait);
+			goto out;
+		}
+
+		rec = zcring_slot(ring, head);
+		rec->len = len;
+		rec->seq = (u32)head;
+		memset(rec->payload, (u8)head, len);
+
+		zcring_publish_head(ring, head + 1);
+		if (wq_has_sleeper(&ring->wait))
+			wake_up_interruptible(&ring->wait);
+		if (!(head & 0xff))
+			cond_resched();
+	}
+
+out:
+	/* Wait to be collected by kthread_stop() */
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+static void zcring_free(struct zcring *ring)
+{
+	unsigned int i;
+
+	if (ring->producer)
+		kthread_stop(ring->producer);
+	if (ring->data)
+		vunmap(ring->data);
+	if (ring->pages) {
+		for (i = 0; i <= ring->nr_pages && ring->pages[i]; i++)
+			__free_page(ring->pages[i]);
+		kvfree(ring->pages);
+	}
+}
+
+static int zcring_setup(struct zcring *ring, struct zcring_setup *setup)
+{
+	unsigned int i, nr_pages = setup->nr_pages ?: ZCRING_DEFAULT_PAGES;
+	struct zcring_ctrl *ctrl;
+	size_t slot_size;
+
+	if (ring->pages)
+		return -EBUSY;
+
+	slot_size = ALIGN(sizeof(struct zcring_record) +
+			  (size_t)setup->record_size, 8);
+	if (!setup->record_size || nr_pages > ZCRING_MAX_PAGES ||
+	    slot_size > (size_t)nr_pages * PAGE_SIZE)
+		return -EINVAL;
+
+	ring->nr_pages = nr_pages;
+	ring->pages = kvcalloc(nr_pages + 1, sizeof(*ring->pages), GFP_KERNEL);
+	if (!ring->pages)
+		return -ENOMEM;
+
+	/* Zeroed, user space must not see stale kernel data */
+	for (i = 0; i <= nr_pages; i++) {
+		ring->pages[i] = alloc_page(GFP_KERNEL | __GFP_ZERO);
+		if (!ring->pages[i])
+			goto err;
+	}
+
+	ring->data = vmap(ring->pages + 1, nr_pages, VM_MAP, PAGE_KERNEL);
+	if (!ring->data)
+		goto err;
+
+	ring->record_size = setup->record_size;
+	ring->slot_size = slot_size;
+	ring->nr_slots = (size_t)nr_pages * PAGE_SIZE / slot_size;
+	ring->nr_records = setup->nr_records;
+	ring->head = 0;
+
+	ctrl = page_address(ring->pages[0]);
+	ctrl->nr_records = ring->nr_records;
+	ctrl->slot_size = ring->slot_size;
+	ctrl->nr_slots = ring->nr_slots;
+	ctrl->data_offset = PAGE_SIZE;
+	/* poll() doesn't take the lock, the geometry has to be there first */
+	smp_store_release(&ring->ctrl, ctrl);
+
+	ring->producer = kthread_run(zcring_producer_fn, ring, "zcring");
+	if (IS_ERR(ring->producer)) {
+		ring->producer = NULL;
+		goto err;
+	}
+	return 0;
+
+err:
+	zcring_free(ring);
+	ring->ctrl = NULL;
+	ring->data = NULL;
+	ring->pages = NULL;
+	return -ENOMEM;
+}
+
+static int zcring_open(struct inode *inode, struct file *file)
+{
+	struct zcring *ring;
+
+	ring = kzalloc(sizeof(*ring), GFP_KERNEL);
+	if (!ring)
+		return -ENOMEM;
+
+	mutex_init(&ring->lock);
+	init_waitqueue_head(&ring->wait);
+	init_waitqueue_head(&ring->space_wait);
+	file->private_data = ring;
+	return 0;
+}
+
+/* Called once the file isn't mapped anymore either */
+static int zcring_release(struct inode *inode, struct file *file)
+{
+	struct zcring *ring = file->private_data;
+
+	zcring_free(ring);
+	kfree(ring);
+	return 0;
+}
+
+static long zcring_ioctl(struct file *file, unsigned int cmd,
+			 unsigned long arg)
+{
+	struct zcring *ring = file->private_data;
+	struct zcring_setup setup;
+	int err;
+
+	if (cmd == ZCRING_IOC_WAKEUP) {
+		wake_up_interruptible(&ring->space_wait);
+		return 0;
+	}
+	if (cmd != ZCRING_IOC_SETUP)
+		return -ENOTTY;
+
+	if (copy_from_user(&setup, (void __user *)arg, sizeof(setup)))
+		return -EFAULT;
+
+	mutex_lock(&ring->lock);
+	err = zcring_setup(ring, &setup);
+	mutex_unlock(&ring->lock);
+	return err;
+}
+
+/*
+ * The copying interface: as many whole records (header and payload) as fit in
+ * the user buffer, blocking until at least one is available. Returns 0 once
+ * every record was consumed.
+ */
+static ssize_t zcring_read(struct file *file, char __user *buf, size_t count,
+			   loff_t *ppos)
+{
+	struct zcring *ring = file->private_data;
+	struct zcring_record *rec;
+	size_t rec_size, copied = 0;
+	u64 head, tail;
+	int err;
+
+	mutex_lock(&ring->lock);
+	if (!ring->ctrl) {
+		err = -EINVAL;
+		goto out;
+	}
+
+	rec_size = ring->slot_size;
+	if (count < rec_size) {
+		err = -EINVAL;
+		goto out;
+	}
+
+	err = READ_ONCE(ring->err);
+	if (err)
+		goto out;
+	head = smp_load_acquire(&ring->head);
+	err = zcring_tail(ring, head, &tail);
+	if (err)
+		goto out;
+	if (head == tail && !zcring_ended(ring, tail)) {
+		if (file->f_flags & O_NONBLOCK) {
+			err = -EAGAIN;
+			goto out;
+		}
+		err = wait_event_interruptible(ring->wait,
+				smp_load_acquire(&ring->head) != tail ||
+				READ_ONCE(ring->err));
+		if (!err)
+			err = READ_ONCE(ring->err);
+		if (err)
+			goto out;
+	}
+
+	/* The tail may have moved meanwhile, through the mapping */
+	head = smp_load_acquire(&ring->head);
+	err = zcring_tail(ring, head, &tail);
+	if (err)
+		goto out;
+	while (tail != head && count - copied >= rec_size) {
+		rec = zcring_slot(ring, tail);
+		if (copy_to_user(buf + copied, rec, rec_size)) {
+			err = -EFAULT;
+			break;
+		}
+		copied += rec_size;
+		tail++;
+	}
+	smp_store_release(&ring->ctrl->tail, tail);
+	if (copied)
+		wake_up_interruptible(&ring->space_wait);
+out:
+	mutex_unlock(&ring->lock);
+	return copied ? copied : err;
+}
+
+static __poll_t zcring_poll(struct file *file, poll_table *wait)
+{
+	struct zcring *ring = file->private_data;
+	u64 head, tail;
+
+	if (!smp_load_acquire(&ring->ctrl))
+		return EPOLLERR;
+
+	poll_wait(file, &ring->wait, wait);
+	head = smp_load_acquire(&ring->head);
+	if (READ_ONCE(ring->err) || zcring_tail(ring, head, &tail))
+		return EPOLLERR;
+	if (head != tail)
+		return EPOLLIN | EPOLLRDNORM;
+	if (zcring_ended(ring, head))
+		return EPOLLHUP;
+	return 0;
+}
+
+/*
+ * Control page and data pages, mapped as they are in the kernel. Shared only:
+ * the consumer's writes to the tail of a private mapping would go to a copy of
+ * the control page, never seen by the producer.
+ */
+static int zcring_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct zcring *ring = file->private_data;
+	unsigned long num = vma_pages(vma);
+	int err = -EINVAL;
+
+	if (!(vma->vm_flags & VM_SHARED))
+		return -EINVAL;
+
+	mutex_lock(&ring->lock);
+	if (ring->pages && !vma->vm_pgoff && num <= ring->nr_pages + 1) {
+		vm_flags_set(vma, VM_DONTEXPAND | VM_DONTDUMP);
+		err = vm_insert_pages(vma, vma->vm_start, ring->pages, &num);
+	}
+	mutex_unlock(&ring->lock);
+
+	return err;
+}
+
+static const struct file_operations zcring_fops = {
+	.owner = THIS_MODULE,
+	.open = zcring_open,
+	.release = zcring_release,
+	.read = zcring_read,
+	.poll = zcring_poll,
+	.unlocked_ioctl = zcring_ioctl,
+	.mmap = zcring_mmap,
+	.llseek = noop_llseek,
+};
+
+static struct miscdevice zcring_dev = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = ZCRING_DEV_NAME,
+	.fops = &zcring_fops,
+	.mode = 0666,
+};
+
+static int __init zcring_init(void)
+{
+	int err;
+
+	err = misc_register(&zcring_dev);
+	if (err) {
+		PR_ERROR("failed to register /dev/%s: %d\n", ZCRING_DEV_NAME,
+			 err);
+		return err;
+	}
+
+	PR_DEBUG("hello world!\n");
+	return 0;
+}
+
+static void __exit zcring_exit(void)
+{
+	misc_deregister(&zcring_dev);
+	PR_DEBUG("bye world!\n");
+}
+
+module_init(zcring_init);
+module_exit(zcring_exit);
+
+MODULE_AUTHOR("Bruno E. O. Meneguele <bmeneguele@gmail.com>");
+MODULE_DESCRIPTION("Zero-copy record ring mapped to user space");
+MODULE_LICENSE("GPL");
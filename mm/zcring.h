@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2017 Bruno E. O. Meneguele <bmeneguele@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ */
+
+/*
+ * Binary interface of the zcring module, shared between the module and
+ * userspace programs: only fixed size types are used here.
+ *
+ * Each open file of /dev/zcring owns a ring of records filled by a kernel
+ * producer. Records are consumed either by read(), which copies them out, or
+ * straight from the ring mapped with mmap(), with no copy at all. The mapping
+ * starts with a control page (struct zcring_ctrl) followed by the ring data,
+ * made of 'nr_slots' slots of 'slot_size' bytes, each one holding a record
+ * (struct zcring_record) and its payload.
+ *
+ * 'head' and 'tail' are free running record counters: the record at slot
+ * (counter % nr_slots). The kernel only writes 'head', after the record it
+ * covers is complete (release semantics), and the consumer only writes 'tail',
+ * after it is done with the records it covers. The ring is empty when both are
+ * equal and full when head - tail == nr_slots. A consumer waiting for records
+ * sleeps in poll().
+ *
+ * A producer finding the ring full sets ZCRING_CTRL_NEED_WAKEUP in 'flags' and
+ * sleeps. A consumer releasing slots through its mapping must then, after
+ * writing 'tail', issue ZCRING_IOC_WAKEUP if it finds the flag set, with a
+ * full barrier between both. read() does it by itself. The producer also looks
+ * at the tail again from time to time, backing off while it doesn't move: a
+ * consumer missing a wakeup slows it down, but doesn't stall it.
+ *
+ * The kernel never reads back anything but 'tail' from the control page. A
+ * tail the consumer moved past head, or more than nr_slots behind it, stops
+ * the producer for good, and read() and poll() report an error.
+ */
+
+#ifndef __ZCRING_H
+#define __ZCRING_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+#define ZCRING_DEV_NAME "zcring"
+
+struct zcring_ctrl {
+	__u64 head;		/* written by the kernel */
+	__u64 tail;		/* written by the consumer */
+	__u64 nr_records;	/* to be produced in total */
+	__u32 slot_size;
+	__u32 nr_slots;
+	__u64 data_offset;	/* of the first slot, from the mapping start */
+	__u32 flags;		/* ZCRING_CTRL_*, written by the kernel */
+	__u32 pad;
+};
+
+/* The producer sleeps until slots are released, see ZCRING_IOC_WAKEUP */
+#define ZCRING_CTRL_NEED_WAKEUP 0x1
+
+struct zcring_record {
+	__u32 len;		/* of the payload */
+	__u32 seq;		/* lower bits of the record counter */
+	__u8 payload[];
+};
+
+struct zcring_setup {
+	__u32 record_size;	/* payload bytes of each record */
+	__u32 nr_pages;		/* ring data pages, 0 for the default */
+	__u64 nr_records;	/* to be produced before the end of the stream */
+};
+
+#define ZCRING_IOC_MAGIC 'Z'
+
+/*
+ * Allocate the ring and start producing. Only once per open file. The size to
+ * be mapped is the control page plus 'nr_pages' pages.
+ */
+#define ZCRING_IOC_SETUP _IOW(ZCRING_IOC_MAGIC, 1, struct zcring_setup)
+
+/* Slots were released through the mapping, wake the producer up */
+#define ZCRING_IOC_WAKEUP _IO(ZCRING_IOC_MAGIC, 2)
+
+#endif /* __ZCRING_H */
@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) 2017 Bruno E. O. Meneguele <bmeneguele@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ */
+
+/*
+ * In-kernel API of the rcu-linked-list dog store, exported to other modules
+ * (e.g. dog-torture) that want to drive the store directly.
+ */
+
+#ifndef __DOG_STORE_H
+#define __DOG_STORE_H
+
+#include <linux/types.h>
+#include <linux/rcupdate.h>
+
+/* Number of independent sub-lists (shards) the dog store is split into. It must
+ * be a power of two, since the shard index is taken from the lowest bits of
+ * the entry hash */
+#define DOG_NR_SHARDS 16
+
+/* Store entries are opaque outside the store itself */
+struct dog;
+
+/* Add a new entry, routed to its shard by hash */
+int dog_store_insert(const char *breed, int age, bool training_easy);
+
+/* Reader: count the entries of a shard with the given age */
+unsigned long dog_store_count_age(unsigned int shard, int age);
+
+/*
+ * Unlink the oldest entry of a shard, chaining it in 'reaped'. Unlinked
+ * entries must be handed back to dog_store_reclaim(), which releases them
+ * after a grace period. Returns false if the shard is empty.
+ */
+bool dog_store_unlink_oldest(unsigned int shard, struct dog **reaped);
+void dog_store_reclaim(struct dog *reaped, unsigned long count);
+
+/*
+ * Queue a callback for the end of a grace period of the RCU flavor the store
+ * was loaded with, and name that flavor ("rcu" or "srcu")
+ */
+void dog_store_call_rcu(struct rcu_head *rh, rcu_callback_t func);
+const char *dog_store_flavor(void);
+
+/* Memory taken by entries already unlinked, waiting for a grace period */
+unsigned long dog_store_pending_bytes(void);
+
+#endif /* __DOG_STORE_H */
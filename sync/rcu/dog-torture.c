@@ -0,0 +1,618 @@
+/*
+ * Copyright (c) 2017 Bruno E. O. Meneguele <bmeneguele@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ */
+
+/*
+ * Reader/updater scalability harness for the rcu-linked-list dog store.
+ *
+ * A kernel thread is bound to each online CPU and runs a random mix of reads
+ * (walking a shard), inserts and deletes against the store for a fixed
+ * amount of time. The very same workload can run against two baseline stores
+ * implemented here, where readers take the shard lock too: a spinlock and a
+ * rwlock one. Results are kept in debugfs:
+ *
+ *	# echo rwlock > /sys/module/dog_torture/parameters/mode
+ *	# echo 1 > /sys/kernel/debug/dog-torture/run
+ *	# cat /sys/kernel/debug/dog-torture/results
+ */
+
+/* __init/exit, macros (MODULE_*) that initializes the module itself */
+#include <linux/module.h>
+/* Printing function definitions */
+#include <linux/kernel.h>
+/* Kernel threads, one per CPU */
+#include <linux/kthread.h>
+#include <linux/cpu.h>
+/* Things related to memory allocation, e.g. kmalloc */
+#include <linux/slab.h>
+/* Baseline stores synchronization */
+#include <linux/spinlock.h>
+#include <linux/rwlock.h>
+/* Grace period counting */
+#include <linux/rcupdate.h>
+/* Run control and results */
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/completion.h>
+#include <linux/mutex.h>
+#include <linux/delay.h>
+/* Workload generation and measurement */
+#include <linux/random.h>
+#include <linux/prandom.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+
+/* Utilities file. For now there are only printing helper functions */
+#include "utils.h"
+/* Log2 histogram helpers */
+#include "pak-common.h"
+/* The dog store under test */
+#include "dog-store.h"
+
+/* Stores the harness is able to drive */
+enum torture_mode {
+	TORTURE_RCU,
+	TORTURE_SPINLOCK,
+	TORTURE_RWLOCK,
+	TORTURE_NR_MODES,
+};
+
+static const char * const torture_mode_names[] = {
+	[TORTURE_RCU] = "rcu",
+	[TORTURE_SPINLOCK] = "spinlock",
+	[TORTURE_RWLOCK] = "rwlock",
+};
+
+/*
+ * The mode is parsed when written, not when a run starts: a charp parameter
+ * may be freed by a concurrent write while being read, and a bad name is
+ * better reported to whoever writes it.
+ */
+static int torture_mode_set(const char *val, const struct kernel_param *kp)
+{
+	int i = sysfs_match_string(torture_mode_names, val);
+
+	if (i < 0)
+		return i;
+	WRITE_ONCE(*(enum torture_mode *)kp->arg, i);
+	return 0;
+}
+
+static int torture_mode_get(char *buf, const struct kernel_param *kp)
+{
+	enum torture_mode m = READ_ONCE(*(enum torture_mode *)kp->arg);
+
+	return scnprintf(buf, PAGE_SIZE, "%s\n", torture_mode_names[m]);
+}
+
+static const struct kernel_param_ops torture_mode_ops = {
+	.set = torture_mode_set,
+	.get = torture_mode_get,
+};
+
+/*
+ * Run configuration. Operations not being reads nor inserts are deletes, thus
+ * read_pct + insert_pct must not exceed 100.
+ */
+static enum torture_mode mode = TORTURE_RCU;
+module_param_cb(mode, &torture_mode_ops, &mode, 0644);
+MODULE_PARM_DESC(mode, "Store under test: rcu, spinlock or rwlock");
+
+static unsigned int read_pct = 90;
+module_param(read_pct, uint, 0644);
+MODULE_PARM_DESC(read_pct, "Percentage of read operations");
+
+static unsigned int insert_pct = 5;
+module_param(insert_pct, uint, 0644);
+MODULE_PARM_DESC(insert_pct, "Percentage of insert operations");
+
+static unsigned int duration_ms = 5000;
+module_param(duration_ms, uint, 0644);
+MODULE_PARM_DESC(duration_ms, "Duration of each run");
+
+static unsigned int initial_size = 10000;
+module_param(initial_size, uint, 0644);
+MODULE_PARM_DESC(initial_size, "Entries added to the store before the run");
+
+/* Updater latency histogram, in log2 buckets of nanoseconds */
+#define TORTURE_HIST_BUCKETS 32
+
+/* RCU deletes are released in batches of this size, the way the store's
+ * expiration does it */
+#define TORTURE_RECLAIM_BATCH 64
+
+/* Baseline store entry, same content as the RCU store's one */
+struct torture_dog {
+	struct list_head list;
+	int age;
+	bool training_easy;
+	char breed[32];
+};
+
+/* Baseline store shard. Only one of the locks is used, depending on mode */
+struct torture_shard {
+	spinlock_t slock;
+	rwlock_t rwlock;
+	struct list_head list;
+} ____cacheline_aligned_in_smp;
+
+static struct torture_shard torture_store[DOG_NR_SHARDS];
+
+/* Per thread state and counters, only touched by the thread itself until the
+ * run finishes */
+struct torture_thread {
+	struct task_struct *task;
+	unsigned int cpu;
+	struct rnd_state rnd;
+	u64 reads;
+	u64 inserts;
+	u64 deletes;
+	u64 elapsed_ns;
+	unsigned long hist[TORTURE_HIST_BUCKETS];
+	/* RCU deletes waiting to be handed back to the store */
+	struct dog *reaped;
+	unsigned long nreaped;
+} ____cacheline_aligned_in_smp;
+
+/* Results of the last run */
+struct torture_result {
+	enum torture_mode mode;
+	unsigned int nthreads;
+	unsigned int read_pct;
+	unsigned int insert_pct;
+	u64 duration_ns;
+	u64 reads;
+	u64 inserts;
+	u64 deletes;
+	unsigned long hist[TORTURE_HIST_BUCKETS];
+	unsigned long grace_periods;
+	unsigned long pending_max;
+	unsigned long pending_avg;
+	/* Reads per second of each CPU, indexed by CPU number */
+	u64 *cpu_reads;
+};
+
+/* Serializes runs and results access */
+static DEFINE_MUTEX(torture_mutex);
+static struct torture_result torture_last;
+static bool torture_has_result;
+
+/* Run state shared with the threads */
+static enum torture_mode torture_mode;
+static DECLARE_COMPLETION(torture_start);
+static bool torture_stop;
+
+/*
+ * Grace period counter: a callback re-posting itself through the store's RCU
+ * flavor (classic or SRCU) runs once per grace period, while the run is
+ * active.
+ */
+static struct rcu_head gp_probe;
+static unsigned long gp_count;
+static bool gp_probe_active;
+static DECLARE_COMPLETION(gp_probe_done);
+
+static void gp_probe_cb(struct rcu_head *rh)
+{
+	gp_count++;
+	if (READ_ONCE(gp_probe_active))
+		dog_store_call_rcu(&gp_probe, gp_probe_cb);
+	else
+		complete(&gp_probe_done);
+}
+
+/* Directory holding the module's debugfs files */
+static struct dentry *torture_debugfs;
+
+static int torture_insert(struct torture_thread *t, unsigned int shard_idx,
+			  int age)
+{
+	struct torture_shard *shard = &torture_store[shard_idx];
+	struct torture_dog *entry;
+	char breed[32];
+
+	snprintf(breed, sizeof(breed), "torture-%u-%llu", t->cpu, t->inserts);
+	if (torture_mode == TORTURE_RCU)
+		return dog_store_insert(breed, age, age & 1);
+
+	entry = kmalloc(sizeof(*entry), GFP_KERNEL);
+	if (!entry)
+		return -ENOMEM;
+	strscpy(entry->breed, breed, sizeof(entry->breed));
+	entry->age = age;
+	entry->training_easy = age & 1;
+
+	if (torture_mode == TORTURE_SPINLOCK) {
+		spin_lock(&shard->slock);
+		list_add_tail(&entry->list, &shard->list);
+		spin_unlock(&shard->slock);
+	} else {
+		write_lock(&shard->rwlock);
+		list_add_tail(&entry->list, &shard->list);
+		write_unlock(&shard->rwlock);
+	}
+	return 0;
+}
+
+static unsigned long torture_read(unsigned int shard_idx, int age)
+{
+	struct torture_shard *shard = &torture_store[shard_idx];
+	struct torture_dog *entry;
+	unsigned long n = 0;
+
+	if (torture_mode == TORTURE_RCU)
+		return dog_store_count_age(shard_idx, age);
+
+	if (torture_mode == TORTURE_SPINLOCK)
+		spin_lock(&shard->slock);
+	else
+		read_lock(&shard->rwlock);
+
+	list_for_each_entry(entry, &shard->list, list) {
+		if (entry->age == age)
+			n++;
+	}
+
+	if (torture_mode == TORTURE_SPINLOCK)
+		spin_unlock(&shard->slock);
+	else
+		read_unlock(&shard->rwlock);
+
+	return n;
+}
+
+static void torture_flush_reaped(struct torture_thread *t)
+{
+	if (!t->nreaped)
+		return;
+
+	dog_store_reclaim(t->reaped, t->nreaped);
+	t->reaped = NULL;
+	t->nreaped = 0;
+}
+
+static void torture_delete(struct torture_thread *t, unsigned int shard_idx)
+{
+	struct torture_shard *shard = &torture_store[shard_idx];
+	struct torture_dog *entry;
+
+	if (torture_mode == TORTURE_RCU) {
+		if (dog_store_unlink_oldest(shard_idx, &t->reaped) &&
+		    ++t->nreaped == TORTURE_RECLAIM_BATCH)
+			torture_flush_reaped(t);
+		return;
+	}
+
+	if (torture_mode == TORTURE_SPINLOCK)
+		spin_lock(&shard->slock);
+	else
+		write_lock(&shard->rwlock);
+
+	entry = list_first_entry_or_null(&shard->list, struct torture_dog,
+					 list);
+	if (entry)
+		list_del(&entry->list);
+
+	if (torture_mode == TORTURE_SPINLOCK)
+		spin_unlock(&shard->slock);
+	else
+		write_unlock(&shard->rwlock);
+
+	/* Readers hold the lock too, nobody can be looking at it anymore */
+	kfree(entry);
+}
+
+static int torture_thread_fn(void *arg)
+{
+	struct torture_thread *t = arg;
+	unsigned int shard, op;
+	u64 start, t0;
+	u32 rnd;
+	int age;
+
+	wait_for_completion(&torture_start);
+
+	start = ktime_get_ns();
+	while (!READ_ONCE(torture_stop)) {
+		rnd = prandom_u32_state(&t->rnd);
+		shard = rnd & (DOG_NR_SHARDS - 1);
+		op = (rnd >> 8) % 100;
+		age = (rnd >> 16) % 240;
+
+		if (op < read_pct) {
+			torture_read(shard, age);
+			t->reads++;
+		} else {
+			t0 = ktime_get_ns();
+			if (op < read_pct + insert_pct) {
+				if (!torture_insert(t, shard, age))
+					t->inserts++;
+			} else {
+				torture_delete(t, shard);
+				t->deletes++;
+			}
+			t->hist[pak_hist_bucket(ktime_get_ns() - t0,
+						TORTURE_HIST_BUCKETS)]++;
+		}
+
+		if (!((t->reads + t->inserts + t->deletes) & 0xff))
+			cond_resched();
+	}
+	t->elapsed_ns = ktime_get_ns() - start;
+	torture_flush_reaped(t);
+
+	/* Wait to be collected by kthread_stop() */
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+static void torture_populate(void)
+{
+	struct torture_thread t = { .cpu = raw_smp_processor_id() };
+	unsigned int i;
+
+	for (i = 0; i < initial_size; i++) {
+		if (torture_insert(&t, i & (DOG_NR_SHARDS - 1), i % 240))
+			break;
+		t.inserts++;
+	}
+}
+
+/*
+ * Empty the store under test, for the next run to start from initial_size
+ * entries as well: ttl_ms may well be longer than all the runs, and walking
+ * shards grown by the previous runs would slow the RCU readers down. The RCU
+ * store is emptied of all its entries, not only of the run's ones.
+ */
+static void torture_cleanup(void)
+{
+	struct torture_thread t = { };
+	struct torture_dog *entry, *tmp;
+	unsigned int i;
+
+	if (torture_mode == TORTURE_RCU) {
+		for (i = 0; i < DOG_NR_SHARDS; i++) {
+			while (dog_store_unlink_oldest(i, &t.reaped)) {
+				if (++t.nreaped == TORTURE_RECLAIM_BATCH) {
+					torture_flush_reaped(&t);
+					cond_resched();
+				}
+			}
+		}
+		torture_flush_reaped(&t);
+		return;
+	}
+
+	for (i = 0; i < DOG_NR_SHARDS; i++) {
+		list_for_each_entry_safe(entry, tmp, &torture_store[i].list,
+					 list) {
+			list_del(&entry->list);
+			kfree(entry);
+		}
+	}
+}
+
+/* Upper bound, in ns, of the bucket where the percentile 'pm' (per mille) of
+ * the histogram falls */
+static u64 torture_percentile(const unsigned long *hist, unsigned int pm)
+{
+	return pak_hist_percentile(hist, TORTURE_HIST_BUCKETS, pm);
+}
+
+static int torture_run(void)
+{
+	struct torture_result *res = &torture_last;
+	struct torture_thread *threads;
+	unsigned long pending, pending_sum = 0, samples = 0;
+	unsigned int cpu, n = 0, i;
+	u64 start;
+	int err = 0;
+
+	if (read_pct + insert_pct > 100)
+		return -EINVAL;
+	torture_mode = READ_ONCE(mode);
+
+	threads = kcalloc(nr_cpu_ids, sizeof(*threads), GFP_KERNEL);
+	if (!threads)
+		return -ENOMEM;
+
+	torture_populate();
+
+	reinit_completion(&torture_start);
+	WRITE_ONCE(torture_stop, false);
+
+	/* CPUs only have to stay online while threads are bound to them: a
+	 * thread whose CPU goes away later is just moved elsewhere */
+	cpus_read_lock();
+	for_each_online_cpu(cpu) {
+		struct torture_thread *t = &threads[n];
+
+		t->cpu = cpu;
+		prandom_seed_state(&t->rnd, get_random_u64());
+		t->task = kthread_create_on_node(torture_thread_fn, t,
+						 cpu_to_node(cpu),
+						 "dog_torture/%u", cpu);
+		if (IS_ERR(t->task)) {
+			err = PTR_ERR(t->task);
+			break;
+		}
+		kthread_bind(t->task, cpu);
+		wake_up_process(t->task);
+		n++;
+	}
+	cpus_read_unlock();
+
+	gp_count = 0;
+	reinit_completion(&gp_probe_done);
+	WRITE_ONCE(gp_probe_active, true);
+	dog_store_call_rcu(&gp_probe, gp_probe_cb);
+
+	/* Go! Memory waiting for grace periods is sampled meanwhile */
+	memset(res->hist, 0, sizeof(res->hist));
+	res->pending_max = 0;
+	start = ktime_get_ns();
+	complete_all(&torture_start);
+	while (!err && ktime_get_ns() - start < duration_ms * NSEC_PER_MSEC) {
+		msleep(10);
+		if (torture_mode != TORTURE_RCU)
+			continue;
+		pending = dog_store_pending_bytes();
+		res->pending_max = max(res->pending_max, pending);
+		pending_sum += pending;
+		samples++;
+	}
+	WRITE_ONCE(torture_stop, true);
+	res->duration_ns = ktime_get_ns() - start;
+
+	res->mode = torture_mode;
+	res->nthreads = n;
+	res->read_pct = read_pct;
+	res->insert_pct = insert_pct;
+	res->reads = res->inserts = res->deletes = 0;
+	res->pending_avg = samples ? pending_sum / samples : 0;
+	kfree(res->cpu_reads);
+	res->cpu_reads = kcalloc(nr_cpu_ids, sizeof(u64), GFP_KERNEL);
+
+	for (i = 0; i < n; i++) {
+		struct torture_thread *t = &threads[i];
+		unsigned int b;
+
+		kthread_stop(t->task);
+		res->reads += t->reads;
+		res->inserts += t->inserts;
+		res->deletes += t->deletes;
+		for (b = 0; b < TORTURE_HIST_BUCKETS; b++)
+			res->hist[b] += t->hist[b];
+		if (res->cpu_reads && t->elapsed_ns)
+			res->cpu_reads[t->cpu] = div64_u64(t->reads *
+							   NSEC_PER_SEC,
+							   t->elapsed_ns);
+	}
+
+	/* Stop the probe, it's done once it sees the flag cleared */
+	WRITE_ONCE(gp_probe_active, false);
+	wait_for_completion(&gp_probe_done);
+	res->grace_periods = gp_count;
+
+	torture_cleanup();
+	torture_has_result = !err;
+	kfree(threads);
+	return err;
+}
+
+/*
+ * Function called everytime the run debugfs file is written, it returns only
+ * once the run is finished.
+ * Example: echo 1 > /sys/kernel/debug/dog-torture/run
+ */
+static ssize_t torture_run_write(struct file *file, const char __user *buf,
+				 size_t count, loff_t *ppos)
+{
+	int err;
+
+	mutex_lock(&torture_mutex);
+	err = torture_run();
+	mutex_unlock(&torture_mutex);
+
+	return err ? err : count;
+}
+
+static const struct file_operations torture_run_fops = {
+	.owner = THIS_MODULE,
+	.write = torture_run_write,
+	.llseek = noop_llseek,
+};
+
+/* Per second rate of 'ops' over the run */
+static u64 torture_rate(u64 ops, u64 ns)
+{
+	return ns ? div64_u64(ops * NSEC_PER_SEC, ns) : 0;
+}
+
+static int torture_results_show(struct seq_file *m, void *v)
+{
+	struct torture_result *res = &torture_last;
+	unsigned int cpu;
+
+	mutex_lock(&torture_mutex);
+	if (!torture_has_result)
+		goto out;
+
+	seq_printf(m, "mode: %s\n", torture_mode_names[res->mode]);
+	seq_printf(m, "flavor: %s\n", dog_store_flavor());
+	seq_printf(m, "threads: %u\n", res->nthreads);
+	seq_printf(m, "read_pct: %u\n", res->read_pct);
+	seq_printf(m, "insert_pct: %u\n", res->insert_pct);
+	seq_printf(m, "duration_ns: %llu\n", res->duration_ns);
+	seq_printf(m, "reads_per_sec: %llu\n",
+		   torture_rate(res->reads, res->duration_ns));
+	seq_printf(m, "inserts_per_sec: %llu\n",
+		   torture_rate(res->inserts, res->duration_ns));
+	seq_printf(m, "deletes_per_sec: %llu\n",
+		   torture_rate(res->deletes, res->duration_ns));
+	seq_printf(m, "update_p50_ns: %llu\n",
+		   torture_percentile(res->hist, 500));
+	seq_printf(m, "update_p90_ns: %llu\n",
+		   torture_percentile(res->hist, 900));
+	seq_printf(m, "update_p99_ns: %llu\n",
+		   torture_percentile(res->hist, 990));
+	seq_printf(m, "update_p999_ns: %llu\n",
+		   torture_percentile(res->hist, 999));
+	seq_printf(m, "grace_periods: %lu\n", res->grace_periods);
+	seq_printf(m, "pending_bytes_max: %lu\n", res->pending_max);
+	seq_printf(m, "pending_bytes_avg: %lu\n", res->pending_avg);
+	if (res->cpu_reads) {
+		for_each_possible_cpu(cpu) {
+			if (res->cpu_reads[cpu])
+				seq_printf(m, "cpu%u_reads_per_sec: %llu\n",
+					   cpu, res->cpu_reads[cpu]);
+		}
+	}
+out:
+	mutex_unlock(&torture_mutex);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(torture_results);
+
+static int __init dog_torture_init(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < DOG_NR_SHARDS; i++) {
+		spin_lock_init(&torture_store[i].slock);
+		rwlock_init(&torture_store[i].rwlock);
+		INIT_LIST_HEAD(&torture_store[i].list);
+	}
+
+	torture_debugfs = debugfs_create_dir("dog-torture", NULL);
+	debugfs_create_file("run", 0200, torture_debugfs, NULL,
+			    &torture_run_fops);
+	debugfs_create_file("results", 0444, torture_debugfs, NULL,
+			    &torture_results_fops);
+
+	PR_DEBUG("module loaded\n");
+	return 0;
+}
+
+static void __exit dog_torture_exit(void)
+{
+	debugfs_remove_recursive(torture_debugfs);
+	kfree(torture_last.cpu_reads);
+	PR_DEBUG("module unloaded\n");
+}
+
+module_init(dog_torture_init);
+module_exit(dog_torture_exit);
+
+MODULE_AUTHOR("Bruno E. O. Meneguele <bmeneguele@gmail.com>");
+MODULE_DESCRIPTION("Scalability harness for the RCU dog store");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2017 Bruno E. O. Meneguele <bmeneguele@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ */
+
+/*
+ * Tracepoints of the dog store, hit by every entry added to or removed from a
+ * shard, whatever the path (sysfs, bulk writes, expiration or the exported
+ * API). Included by rcu-linked-list.c only, after struct dog is defined:
+ *
+ *	# echo 1 > /sys/kernel/tracing/events/dog_store/enable
+ *	# cat /sys/kernel/tracing/trace_pipe
+ *
+ * Both run with the shard lock held: a disabled tracepoint is a NOP, an
+ * enabled one copies a few fields to the trace buffer, never more.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM dog_store
+
+#if !defined(__DOG_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define __DOG_TRACE_H
+
+#include <linux/tracepoint.h>
+
+#include "rcu-dog.h"
+
+DECLARE_EVENT_CLASS(dog_entry,
+	TP_PROTO(const struct dog *entry, unsigned int shard),
+	TP_ARGS(entry, shard),
+
+	TP_STRUCT__entry(
+		__array(char, breed, DOG_BREED_NBYTES)
+		__field(int, age)
+		__field(unsigned int, shard)
+		__field(u32, id)
+	),
+
+	TP_fast_assign(
+		memcpy(__entry->breed, entry->breed, DOG_BREED_NBYTES);
+		__entry->age = entry->age;
+		__entry->shard = shard;
+		__entry->id = entry->id;
+	),
+
+	TP_printk("breed=%s age=%d shard=%u id=%u", __entry->breed,
+		  __entry->age, __entry->shard, __entry->id)
+);
+
+DEFINE_EVENT(dog_entry, dog_insert,
+	TP_PROTO(const struct dog *entry, unsigned int shard),
+	TP_ARGS(entry, shard)
+);
+
+DEFINE_EVENT(dog_entry, dog_delete,
+	TP_PROTO(const struct dog *entry, unsigned int shard),
+	TP_ARGS(entry, shard)
+);
+
+#endif /* __DOG_TRACE_H */
+
+/* Out of the kernel tree: the header is found through -I$(src) */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE dog-trace
+#include <trace/define_trace.h>
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2017 Bruno E. O. Meneguele <bmeneguele@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ */
+
+/*
+ * Binary interface of the rcu-linked-list module, shared between the module
+ * and userspace programs: only fixed size types are used here.
+ */
+
+#ifndef __RCU_DOG_H
+#define __RCU_DOG_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/* Character device handling binary (bulk) operations over the dog store */
+#define DOG_DEV_NAME "rcu-dog"
+
+/* Max breed length, including the NUL terminator */
+#define DOG_BREED_NBYTES 32
+
+/*
+ * Fixed layout record, used to insert entries in bulk: write() an array of
+ * them to /dev/rcu-dog and all of them are added to the store at once. The
+ * store keeps at most DOG_BREED_NBYTES - 1 characters of the breed, longer
+ * ones are truncated.
+ */
+struct dog_record {
+	char breed[DOG_BREED_NBYTES];
+	__s32 age; /* in months */
+	__u32 training_easy;
+};
+
+/*
+ * Binary snapshot of the whole store, as mapped by mmap() on /dev/rcu-dog
+ * after a DOG_IOC_SNAPSHOT call.
+ */
+struct dog_snapshot {
+	__u64 nr_records;
+	__u64 reserved;
+	struct dog_record recs[];
+};
+
+#define DOG_IOC_MAGIC 'D'
+
+/*
+ * Take a new snapshot of the store, replacing the previous one of this file
+ * descriptor. The size (in bytes) to be mapped is returned in the __u64
+ * pointed by the argument.
+ */
+#define DOG_IOC_SNAPSHOT _IOR(DOG_IOC_MAGIC, 1, __u64)
+
+#endif /* __RCU_DOG_H */
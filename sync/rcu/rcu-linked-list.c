@@ -14,34 +14,81 @@
 #include <linux/rculist.h>
 /* Things related to memory allocation, e.g. kmalloc */
 #include <linux/slab.h>
+/* Big buffers allocation, e.g. kvmalloc */
+#include <linux/mm.h>
 /* Kobject related stuff, here used to create sysfs interface */
 #include <linux/kobject.h>
 /* Kernel specific string manipulation library */
 #include <linux/string.h>
 /* Spinlocks related stuff for synchronization */
 #include <linux/spinlock.h>
-/* Timer related stuff for linked list node removal simulation */
-#include <linux/timer.h>
+/* Deferred work used to expire linked list nodes */
+#include <linux/workqueue.h>
+/* jiffies and time conversion helpers for entries lifetime */
+#include <linux/jiffies.h>
+/* Hash functions used to route new entries to a shard */
+#include <linux/jhash.h>
+/* Misc character device, used by the binary bulk interface */
+#include <linux/miscdevice.h>
+#include <linux/fs.h>
+/* copy_from_user() */
+#include <linux/uaccess.h>
+/* debugfs and seq_file, used to dump the whole store */
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+/* vmalloc_user(), memory holding binary snapshots */
+#include <linux/vmalloc.h>
+/* Per file lock of the binary snapshots */
+#include <linux/mutex.h>
+/* Sleepable RCU, the optional flavor used by readers and updaters */
+#include <linux/srcu.h>
+/* Time measurement of store walks */
+#include <linux/ktime.h>
+#include <linux/math64.h>
 
 /* Utilities file. For now there are only printing helper functions */
 #include "utils.h"
+/* Binary interface shared with userspace */
+#include "rcu-dog.h"
+/* In-kernel API exported to other modules, DOG_NR_SHARDS */
+#include "dog-store.h"
+/* Runtime stats, exported by pak-common.ko when built with PAK_COMMON=1 */
+#include "pak-common.h"
 
 /* A way to avoid bufferoverflow is using predefined array sizes */
 #define DOG_ENTRY_NBYTES 64
 
-/* Dummy structure to examplify the linked list and rcu behaviour */
+/*
+ * Dummy structure to examplify the linked list and rcu behaviour.
+ *
+ * Entries come from their own slab cache, aligned to cache lines, and the
+ * layout below fits exactly in 64 bytes: walking the store costs a single
+ * cache line per entry, breed included, since it's stored inline instead of
+ * being a pointer to another allocation.
+ */
 struct dog {
 	/* Field used as link point between struct dog and the linked list
-	 * itself */
+	 * itself. Once unlinked from the store, 'list.next' must be kept
+	 * intact for readers still walking through the entry, but 'list.prev'
+	 * is poisoned by list_del_rcu() and never followed by readers: it's
+	 * reused to chain expired entries while they wait for their grace
+	 * period (see dog_reap_link()) */
 	struct list_head list;
-	/* Field used by RCU mechanism to track structures awaiting grace
-	 * periods */
-	struct rcu_head rh;
-	char *breed;
+	/* Sequence number within its shard, always increasing from head to
+	 * tail (wrapping around). Used as a cursor by readers that can't keep
+	 * the RCU read-side critical section between two read() calls */
+	u32 id;
 	int age; /* in months */
+	/* Time (in jiffies, lower 32 bits) after which the entry is removed
+	 * from the store */
+	u32 expires;
 	bool training_easy;
+	char breed[DOG_BREED_NBYTES];
 };
 
+/* Slab cache every struct dog is allocated from */
+static struct kmem_cache *dog_cache;
+
 /*
  * Threads that updates the linked-list somehow (inserting/removing nodes) need
  * be controlled with locks, to avoid overruns and race conditions on the linked
@@ -54,15 +101,183 @@ struct dog {
  * used here. But as they are named, spinlocks busy-waits for the critical
  * section, so it should be used only in situations where the critical section
  * is released really fast.
+ *
+ * A single lock for the whole list turns into a bottleneck as soon as many
+ * updaters run concurrently: all of them spin on the same cache line. Thus
+ * the store is split into shards, each one being a complete linked list with
+ * its own lock and size counter. Updaters touching different shards never
+ * contend with each other, while readers simply walk all the shards within
+ * the same RCU read-side critical section.
+ *
+ * Each shard is aligned to a cache line, otherwise the locks of neighbour
+ * shards would share a line and keep bouncing it between CPUs anyway (false
+ * sharing).
  */
-DEFINE_SPINLOCK(list_update_lock);
+struct dog_shard {
+	spinlock_t lock;
+	/* The node that represents the head of this shard's linked list */
+	struct list_head list;
+	/* A simple way to maintain the number of elements in the shard. It
+	 * must be manually updated in every insertion/removal */
+	size_t size;
+	/* id of the last entry added to the shard */
+	u32 last_id;
+	/* Latest expiration time of the entries added so far, and whether
+	 * one of them expires before an entry added earlier: entries then
+	 * aren't sorted by expiration time anymore */
+	u32 last_expires;
+	bool unsorted;
+} ____cacheline_aligned_in_smp;
+
+static struct dog_shard dog_store[DOG_NR_SHARDS];
 
-/* The node that represents the head of the linked list used in this module */
-LIST_HEAD(dog_list);
+/* Walk through every shard of the store */
+#define for_each_dog_shard(shard) \
+	for (shard = dog_store; shard < &dog_store[DOG_NR_SHARDS]; shard++)
 
-/* A simple way to maintain the number of elements in the linked list. It must
- * be manually updated in every insertion/removal */
-static size_t dog_list_size;
+/* Tracepoints, they need struct dog */
+#define CREATE_TRACE_POINTS
+#include "dog-trace.h"
+
+/*
+ * Entries are always added to the tail, so as long as ttl_ms doesn't go down
+ * each shard is sorted by expiration time. Note when it isn't anymore, for
+ * dog_shard_expire(). Called with the shard's lock held, before 'entry' is
+ * accounted in the shard's size.
+ */
+static void dog_shard_track_expiry(struct dog_shard *shard, struct dog *entry)
+{
+	if (!shard->size) {
+		shard->unsorted = false;
+	} else if (time_before32(entry->expires, shard->last_expires)) {
+		shard->unsorted = true;
+		return;
+	}
+	shard->last_expires = entry->expires;
+}
+
+/*
+ * New entries are routed to a shard by hashing its content, spreading
+ * concurrent updaters evenly among the shards.
+ */
+static struct dog_shard *dog_shard_of(const char *breed, int age)
+{
+	u32 hash = jhash(breed, strlen(breed), age);
+
+	return &dog_store[hash & (DOG_NR_SHARDS - 1)];
+}
+
+/*
+ * Expiration tunables, all of them in the module's sysfs directory:
+ *
+ * - ttl_ms: lifetime of new entries;
+ * - reap_interval_ms: period between two expiration passes;
+ * - reap_batch: max number of entries removed per pass (0 means no limit).
+ *
+ * Together the last two define the maximum removal rate of the store.
+ */
+static unsigned int ttl_ms = 5000;
+/* Entries keep only the lower 32 bits of their expiration time, lifetimes must
+ * stay well below the wrap around of 32 bits jiffies */
+#define DOG_TTL_MAX_MS (24 * 60 * 60 * 1000)
+static unsigned int reap_interval_ms = 1000;
+static unsigned int reap_batch;
+
+/* Number of entries already unlinked from the store, but whose memory is still
+ * waiting for a grace period to be released */
+static atomic_long_t dog_pending = ATOMIC_LONG_INIT(0);
+
+/* Under /sys/kernel/debug/playing-around/rcu_linked_list/, for the whole
+ * store. Updaters bump them once out of their shard lock, they don't need it */
+static struct pak_stats *dog_stats;
+static struct pak_stat *dog_stat_inserts;
+static struct pak_stat *dog_stat_deletes;
+static struct pak_stat *dog_stat_size;
+
+/*
+ * Classic RCU readers must not sleep within their read-side critical
+ * sections, forcing slow per-entry work to be done only after copying
+ * everything out. Loading the module with 'srcu=1' switches the store to
+ * Sleepable RCU (SRCU): readers may block while holding a reference to the
+ * entries. Its read-side primitives only touch per-CPU counters, a bit more
+ * expensive than classic RCU ones, and grace periods are longer since they
+ * wait for sleeping readers too.
+ */
+static bool use_srcu;
+module_param_named(srcu, use_srcu, bool, 0444);
+MODULE_PARM_DESC(srcu, "Use SRCU instead of classic RCU, readers may sleep");
+
+DEFINE_STATIC_SRCU(dog_srcu);
+
+/*
+ * Updaters releasing entries either queue a callback for the end of the grace
+ * period (expedited = 0) or wait for an expedited grace period and release
+ * them right away (expedited = 1). The latter keeps less memory waiting, at
+ * the cost of latency for the updater and IPIs to all CPUs.
+ */
+static unsigned int expedited;
+
+/* Read-side critical section of the flavor in use. The returned index must
+ * be handed back to dog_read_unlock() */
+static int dog_read_lock(void)
+{
+	if (use_srcu)
+		return srcu_read_lock(&dog_srcu);
+
+	rcu_read_lock();
+	return 0;
+}
+
+static void dog_read_unlock(int idx)
+{
+	if (use_srcu)
+		srcu_read_unlock(&dog_srcu, idx);
+	else
+		rcu_read_unlock();
+}
+
+static bool dog_read_lock_held(void)
+{
+	return use_srcu ? srcu_read_lock_held(&dog_srcu) : rcu_read_lock_held();
+}
+
+/* Only SRCU readers are allowed to give the CPU up */
+static void dog_read_cond_resched(void)
+{
+	if (use_srcu)
+		cond_resched();
+}
+
+/* RCU protected walk through a shard, under any flavor */
+#define dog_for_each_entry(entry, head) \
+	list_for_each_entry_rcu(entry, head, list, dog_read_lock_held())
+
+static void dog_call_rcu(struct rcu_head *rh, rcu_callback_t func)
+{
+	if (use_srcu)
+		call_srcu(&dog_srcu, rh, func);
+	else
+		call_rcu(rh, func);
+}
+
+static void dog_synchronize(void)
+{
+	bool exp = READ_ONCE(expedited);
+
+	if (use_srcu)
+		exp ? synchronize_srcu_expedited(&dog_srcu) :
+		      synchronize_srcu(&dog_srcu);
+	else
+		exp ? synchronize_rcu_expedited() : synchronize_rcu();
+}
+
+static void dog_barrier(void)
+{
+	if (use_srcu)
+		srcu_barrier(&dog_srcu);
+	else
+		rcu_barrier();
+}
 
 /*
  * Function called everytime the sysfs attribute file is read.
@@ -71,23 +286,79 @@ static size_t dog_list_size;
 static ssize_t dog_attr_show(struct kobject *kobj, struct kobj_attribute *attr,
 			     char *buf)
 {
+	struct dog_shard *shard;
 	struct dog *entry;
 	size_t nbytes = 0;
+	int idx;
 
 	PR_DEBUG("show requested\n");
-	/* Where RCU read-side critical section starts */
-	rcu_read_lock();
-	/* Copy directly to *buf, which is the output buffer */
-	list_for_each_entry_rcu(entry, &dog_list, list) {
-		nbytes += snprintf(&buf[nbytes], DOG_ENTRY_NBYTES,
-				   "%s %d %s\n", entry->breed, entry->age,
-				   entry->training_easy ? "true" : "false");
+	/* Where RCU read-side critical section starts. A single critical
+	 * section covers all shards, there is no need to enter/leave it for
+	 * each one of them */
+	idx = dog_read_lock();
+	/* Copy directly to *buf, which is the output buffer. sysfs gives us a
+	 * single page, entries that don't fit are left out: the whole store
+	 * can be read through debugfs (see dog_seq_ops) */
+	for_each_dog_shard(shard) {
+		dog_for_each_entry(entry, &shard->list) {
+			if (PAGE_SIZE - nbytes < DOG_ENTRY_NBYTES)
+				goto out;
+			nbytes += scnprintf(&buf[nbytes], DOG_ENTRY_NBYTES,
+					    "%s %d %s\n", entry->breed,
+					    entry->age,
+					    entry->training_easy ?
+					    "true" : "false");
+		}
 	}
+out:
 	/* Where RCU read-side critical section ends */
-	rcu_read_unlock();
+	dog_read_unlock(idx);
 	return nbytes;
 }
 
+/*
+ * New dog store entry being created and assigned. It's valid for 'ttl_ms'
+ * milliseconds from now on. Breeds longer than DOG_BREED_NBYTES - 1 are
+ * truncated.
+ */
+static struct dog *dog_alloc(const char *breed, int age, int training)
+{
+	struct dog *entry;
+
+	entry = kmem_cache_alloc(dog_cache, GFP_KERNEL);
+	if (!entry)
+		return NULL;
+
+	strscpy(entry->breed, breed, DOG_BREED_NBYTES);
+	entry->age = age;
+	entry->training_easy = training ? true : false;
+	entry->expires = jiffies + msecs_to_jiffies(READ_ONCE(ttl_ms));
+	return entry;
+}
+
+/* Make a new entry visible to readers */
+static void dog_store_add(struct dog *entry)
+{
+	struct dog_shard *shard = dog_shard_of(entry->breed, entry->age);
+
+	/* Spinlock to allow only one updater thread a time per shard. The
+	 * deletion code to this same data structure runs concurrently from a
+	 * workqueue, which is process context just like this function, thus
+	 * there is no need to disable neither IRQs nor softirqs while holding
+	 * the lock: the plain spin_lock()/spin_unlock() calls are enough.
+	 */
+	spin_lock(&shard->lock);
+	entry->id = ++shard->last_id;
+	dog_shard_track_expiry(shard, entry);
+	list_add_tail_rcu(&entry->list, &shard->list);
+	shard->size++;
+	trace_dog_insert(entry, shard - dog_store);
+	spin_unlock(&shard->lock);
+
+	pak_stat_inc(dog_stat_inserts);
+	pak_stat_inc(dog_stat_size);
+}
+
 /*
  * Function called everytime the sysfs attribute file is written.
  * Example: echo Golden,3,0 > /sys/rcu-linked-list/dog
@@ -96,58 +367,296 @@ static ssize_t dog_attr_store(struct kobject *kobj, struct kobj_attribute *attr,
 			      const char *buf, size_t count)
 {
 	struct dog *entry;
-	char *str_token, *ibuf, *dog_attr[3];
+	char *str_token, *kbuf, *ibuf, *dog_attr[3];
 	unsigned int idx = 0;
 	int dog_age, dog_training;
 	int err;
-	unsigned long irq_flags;
 
 	PR_DEBUG("store requested\n");
 
-	/* User input handling code (basicaly string manipulation) */
-	ibuf = kstrndup(buf, DOG_ENTRY_NBYTES, GFP_KERNEL);
-	if (!ibuf)
+	/* User input handling code (basicaly string manipulation). strsep()
+	 * moves 'ibuf' along, 'kbuf' keeps the buffer to be freed */
+	kbuf = ibuf = kstrndup(buf, DOG_ENTRY_NBYTES, GFP_KERNEL);
+	if (!kbuf)
 		return -ENOMEM;
-	while ((str_token = strsep(&ibuf, ",")) != NULL)
+	while (idx < 3 && (str_token = strsep(&ibuf, ",")) != NULL)
 		dog_attr[idx++] = str_token;
-	if (idx < 3)
-		return -EINVAL;
 
+	err = -EINVAL;
+	if (idx < 3 || strlen(dog_attr[0]) >= DOG_BREED_NBYTES)
+		goto out;
 	err = kstrtoint(dog_attr[1], 10, &dog_age);
 	if (err)
-		return err;
+		goto out;
 	err = kstrtoint(dog_attr[2], 2, &dog_training);
 	if (err)
-		return err;
-
-	/* New dog_list entry being created and assigned */
-	entry = (struct dog *) kmalloc(sizeof(struct dog), GFP_KERNEL);
-	if (!entry)
-		return -ENOMEM;
+		goto out;
 
-	entry->breed = dog_attr[0];
-	entry->age = dog_age;
-	entry->training_easy = dog_training ? true : false;
-	/* Spinlock to allow only one updater thread a time. But pay attention,
-	 * the deletion code to this same data structure is running concurrently
-	 * in interrupt context (from a timer callback funtions), hence the
-	 * spinlock should disable IRQs in this CPU specifically, avoiding a
-	 * deadlock. Locks, in general, acts in a per-CPU manner, since there is
-	 * no problem a task (IRQ or not) to be locked in a different CPU
-	 * waiting a lock to be released, it doesn't feature a _deadlock_.
-	 * All that said, a call to spin_lock_irqsave()/spin_unlock_irqrestore()
-	 * will be made, instead the normal spin_lock()/spin_unlock() function
-	 */
-	spin_lock_irqsave(&list_update_lock, irq_flags);
-	list_add_tail_rcu(&entry->list, &dog_list);
-	dog_list_size++;
-	spin_unlock_irqrestore(&list_update_lock, irq_flags);
+	/* The breed is copied into the entry, the input buffer isn't needed
+	 * after this point */
+	entry = dog_alloc(dog_attr[0], dog_age, dog_training);
+	if (!entry) {
+		err = -ENOMEM;
+		goto out;
+	}
+	dog_store_add(entry);
 
 	PR_DEBUG("%s %d %s\n", dog_attr[0], dog_age,
 		 dog_training ? "true" : "false");
-	return count;
+	err = count;
+out:
+	kfree(kbuf);
+	return err;
 }
 
+/*
+ * Records are copied from userspace in chunks of this many records, bounding
+ * the temporary buffer size for huge writes.
+ */
+#define DOG_BULK_CHUNK 4096
+
+/* Nobody can be reading a list that isn't published yet, there is no grace
+ * period to wait for before splicing it into the store */
+static void dog_bulk_nosync(void)
+{
+}
+
+/*
+ * Insert a chunk of records. Entries are allocated and sorted by shard before
+ * any lock is taken, then each shard receives all its new entries at once:
+ * one lock acquisition and one list splice per shard, no matter the number of
+ * records. Returns the number of records inserted.
+ */
+static size_t dog_bulk_insert(const struct dog_record *recs, size_t nrecs)
+{
+	struct list_head pending[DOG_NR_SHARDS];
+	char breed[DOG_BREED_NBYTES];
+	struct dog_shard *shard;
+	struct dog *entry;
+	size_t i, n;
+
+	for (i = 0; i < DOG_NR_SHARDS; i++)
+		INIT_LIST_HEAD(&pending[i]);
+
+	for (n = 0; n < nrecs; n++) {
+		/* Records' breeds aren't necessarily NUL terminated */
+		memcpy(breed, recs[n].breed, DOG_BREED_NBYTES);
+		breed[DOG_BREED_NBYTES - 1] = '\0';
+		entry = dog_alloc(breed, recs[n].age, recs[n].training_easy);
+		if (!entry)
+			break;
+		i = dog_shard_of(entry->breed, entry->age) - dog_store;
+		list_add_tail(&entry->list, &pending[i]);
+	}
+
+	for (i = 0; i < DOG_NR_SHARDS; i++) {
+		if (list_empty(&pending[i]))
+			continue;
+		shard = &dog_store[i];
+		spin_lock(&shard->lock);
+		list_for_each_entry(entry, &pending[i], list) {
+			entry->id = ++shard->last_id;
+			dog_shard_track_expiry(shard, entry);
+			shard->size++;
+			trace_dog_insert(entry, i);
+		}
+		list_splice_tail_init_rcu(&pending[i], &shard->list,
+					  dog_bulk_nosync);
+		spin_unlock(&shard->lock);
+	}
+
+	pak_stat_add(dog_stat_inserts, n);
+	pak_stat_add(dog_stat_size, n);
+	return n;
+}
+
+/*
+ * Function called everytime the character device is written. It expects an
+ * array of struct dog_record, partial records are ignored.
+ * Example: write(fd, recs, 1000 * sizeof(struct dog_record))
+ */
+static ssize_t dog_dev_write(struct file *file, const char __user *ubuf,
+			     size_t count, loff_t *ppos)
+{
+	struct dog_record *recs;
+	size_t nrecs, chunk, inserted, done = 0;
+	ssize_t err = 0;
+
+	nrecs = count / sizeof(struct dog_record);
+	if (!nrecs)
+		return -EINVAL;
+
+	recs = kvmalloc_array(min_t(size_t, nrecs, DOG_BULK_CHUNK),
+			      sizeof(*recs), GFP_KERNEL);
+	if (!recs)
+		return -ENOMEM;
+
+	while (done < nrecs) {
+		chunk = min_t(size_t, nrecs - done, DOG_BULK_CHUNK);
+		if (copy_from_user(recs, ubuf + done * sizeof(*recs),
+				   chunk * sizeof(*recs))) {
+			err = -EFAULT;
+			break;
+		}
+		inserted = dog_bulk_insert(recs, chunk);
+		done += inserted;
+		if (inserted < chunk) {
+			err = -ENOMEM;
+			break;
+		}
+		cond_resched();
+	}
+	kvfree(recs);
+
+	PR_DEBUG("%zu entries inserted in bulk\n", done);
+	/* Report what was inserted, the error only if nothing was */
+	return done ? done * sizeof(struct dog_record) : err;
+}
+
+/*
+ * Binary snapshot of the store, built on DOG_IOC_SNAPSHOT and mapped to
+ * userspace with mmap(): dumping millions of entries costs a single copy of
+ * each one, no text formatting at all.
+ */
+struct dog_dev_file {
+	/* Serializes snapshot (re)builds against mmap() */
+	struct mutex lock;
+	struct dog_snapshot *snap;
+	size_t snap_size;
+};
+
+static int dog_dev_open(struct inode *inode, struct file *file)
+{
+	struct dog_dev_file *dfile;
+
+	dfile = kzalloc(sizeof(*dfile), GFP_KERNEL);
+	if (!dfile)
+		return -ENOMEM;
+
+	mutex_init(&dfile->lock);
+	file->private_data = dfile;
+	return 0;
+}
+
+static int dog_dev_release(struct inode *inode, struct file *file)
+{
+	struct dog_dev_file *dfile = file->private_data;
+
+	/* Pages still mapped by userspace hold their own references */
+	vfree(dfile->snap);
+	kfree(dfile);
+	return 0;
+}
+
+static void dog_record_fill(struct dog_record *rec, const struct dog *entry)
+{
+	strncpy(rec->breed, entry->breed, DOG_BREED_NBYTES);
+	rec->age = entry->age;
+	rec->training_easy = entry->training_easy;
+}
+
+static long dog_snapshot_build(struct dog_dev_file *dfile)
+{
+	struct dog_snapshot *snap;
+	struct dog_shard *shard;
+	struct dog *entry;
+	size_t size, max_recs = 0, n = 0;
+	int idx;
+
+	/* Entries added while the snapshot is taken might not fit, that's
+	 * fine: the snapshot is a view of the store when it was requested */
+	for_each_dog_shard(shard)
+		max_recs += READ_ONCE(shard->size);
+	size = PAGE_ALIGN(struct_size(snap, recs, max_recs));
+
+	/* Zeroed and ready to be mapped to userspace */
+	snap = vmalloc_user(size);
+	if (!snap)
+		return -ENOMEM;
+
+	/* One read-side critical section per shard, this loop might take a
+	 * while and there is no need to block grace periods for the whole
+	 * store meanwhile */
+	for_each_dog_shard(shard) {
+		idx = dog_read_lock();
+		dog_for_each_entry(entry, &shard->list) {
+			if (n == max_recs)
+				break;
+			dog_record_fill(&snap->recs[n++], entry);
+			dog_read_cond_resched();
+		}
+		dog_read_unlock(idx);
+		cond_resched();
+	}
+	snap->nr_records = n;
+
+	mutex_lock(&dfile->lock);
+	vfree(dfile->snap);
+	dfile->snap = snap;
+	dfile->snap_size = size;
+	mutex_unlock(&dfile->lock);
+
+	return 0;
+}
+
+static long dog_dev_ioctl(struct file *file, unsigned int cmd,
+			  unsigned long arg)
+{
+	struct dog_dev_file *dfile = file->private_data;
+	u64 size;
+	long err;
+
+	switch (cmd) {
+	case DOG_IOC_SNAPSHOT:
+		err = dog_snapshot_build(dfile);
+		if (err)
+			return err;
+		size = dfile->snap_size;
+		if (copy_to_user((u64 __user *)arg, &size, sizeof(size)))
+			return -EFAULT;
+		return 0;
+	default:
+		return -ENOTTY;
+	}
+}
+
+static int dog_dev_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct dog_dev_file *dfile = file->private_data;
+	int err = -EINVAL;
+
+	/* Snapshots are read-only, also for a later mprotect() */
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vm_flags_clear(vma, VM_MAYWRITE);
+
+	mutex_lock(&dfile->lock);
+	/* remap_vmalloc_range() checks the vma fits in the snapshot */
+	if (dfile->snap)
+		err = remap_vmalloc_range(vma, dfile->snap, vma->vm_pgoff);
+	mutex_unlock(&dfile->lock);
+
+	return err;
+}
+
+static const struct file_operations dog_dev_fops = {
+	.owner = THIS_MODULE,
+	.open = dog_dev_open,
+	.release = dog_dev_release,
+	.write = dog_dev_write,
+	.unlocked_ioctl = dog_dev_ioctl,
+	.mmap = dog_dev_mmap,
+	.llseek = noop_llseek,
+};
+
+/* /dev/rcu-dog, a misc device gets its minor number dynamically */
+static struct miscdevice dog_miscdev = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = DOG_DEV_NAME,
+	.fops = &dog_dev_fops,
+	.mode = 0664,
+};
+
 /* Top-level kobject, which represents a directory within sysfs */
 static struct kobject *dog_kobj;
 
@@ -155,9 +664,85 @@ static struct kobject *dog_kobj;
 static struct kobj_attribute dog_attribute = __ATTR(dog, 0664, &dog_attr_show,
 						    &dog_attr_store);
 
+/* sysfs attribute bound to an unsigned int tunable */
+struct dog_tunable_attr {
+	struct kobj_attribute attr;
+	unsigned int *value;
+	unsigned int min;
+	unsigned int max;
+};
+
+#define DOG_TUNABLE_ATTR(_name, _min, _max)				\
+	struct dog_tunable_attr _name##_attribute = {			\
+		.attr = __ATTR(_name, 0664, &tunable_attr_show,		\
+			       &tunable_attr_store),			\
+		.value = &_name,					\
+		.min = _min,						\
+		.max = _max,						\
+	}
+
+static ssize_t tunable_attr_show(struct kobject *kobj,
+				 struct kobj_attribute *attr, char *buf)
+{
+	struct dog_tunable_attr *tattr;
+
+	tattr = container_of(attr, struct dog_tunable_attr, attr);
+	return sprintf(buf, "%u\n", READ_ONCE(*tattr->value));
+}
+
+static ssize_t tunable_attr_store(struct kobject *kobj,
+				  struct kobj_attribute *attr, const char *buf,
+				  size_t count)
+{
+	struct dog_tunable_attr *tattr;
+	unsigned int value;
+	int err;
+
+	tattr = container_of(attr, struct dog_tunable_attr, attr);
+	err = kstrtouint(buf, 10, &value);
+	if (err)
+		return err;
+	if (value < tattr->min || value > tattr->max)
+		return -EINVAL;
+
+	WRITE_ONCE(*tattr->value, value);
+	return count;
+}
+
+static DOG_TUNABLE_ATTR(ttl_ms, 0, DOG_TTL_MAX_MS);
+static DOG_TUNABLE_ATTR(reap_interval_ms, 1, UINT_MAX);
+static DOG_TUNABLE_ATTR(reap_batch, 0, UINT_MAX);
+static DOG_TUNABLE_ATTR(expedited, 0, 1);
+
+/*
+ * Number of entries currently linked in the store and the ones still waiting
+ * to be released. Example: cat /sys/rcu-linked-list/size
+ */
+static ssize_t size_attr_show(struct kobject *kobj, struct kobj_attribute *attr,
+			      char *buf)
+{
+	struct dog_shard *shard;
+	size_t size = 0;
+
+	/* Lockless sum, it's just an approximation while updaters run */
+	for_each_dog_shard(shard)
+		size += READ_ONCE(shard->size);
+
+	return sprintf(buf, "%zu %ld\n", size,
+		       atomic_long_read(&dog_pending));
+}
+
+static struct kobj_attribute size_attribute = __ATTR(size, 0444,
+						     &size_attr_show, NULL);
+
 /* List of all sysfs attribute files that should be created on module init */
 static struct attribute *attrs[] = {
 	&dog_attribute.attr,
+	&ttl_ms_attribute.attr.attr,
+	&reap_interval_ms_attribute.attr.attr,
+	&reap_batch_attribute.attr.attr,
+	&expedited_attribute.attr.attr,
+	&size_attribute.attr,
 	NULL,
 };
 
@@ -166,67 +751,508 @@ static struct attribute_group attr_group = {
 	.attrs = attrs,
 };
 
-/* Timer structure that will handle linked list nodes remocal */
-static struct timer_list removal_timer;
+/*
+ * debugfs file dumping the whole store, without sysfs' single page limit:
+ * /sys/kernel/debug/rcu-linked-list/dogs
+ *
+ * seq_file calls start()/next()/show()/stop() for every chunk handed to
+ * userspace. The RCU read-side critical section can't be kept between two
+ * read() calls, so the position is kept as a cursor: the shard being read and
+ * the id of the last entry shown. Ids only grow from head to tail, so the
+ * next read() carries on from the first entry with a greater id, no matter
+ * how many entries were added or removed meanwhile.
+ */
+struct dog_seq_cursor {
+	/* Read-side critical section between start() and stop() */
+	int read_idx;
+	unsigned int shard;
+	/* Whether last_id is valid for the current shard */
+	bool resume;
+	u32 last_id;
+};
 
 /*
- * This function is called in interrupt context, thus this need to be fast and
- * must not sleep. If needed, spinlocks is OK for this situation since they
- * don't sleep.
+ * Finding the cursor position again means walking its shard from the head,
+ * use big chunks so it happens only a few times even for huge stores.
  */
-static void timer_remove_dog(unsigned long data)
+#define DOG_SEQ_BUF_SIZE (1 << 20)
+
+/* Directory holding the module's debugfs files */
+static struct dentry *dog_debugfs;
+
+static struct dog *dog_seq_find(struct dog_seq_cursor *cur)
 {
 	struct dog *entry;
 
-	/* It isn't necessary to control the removal process because there isn't
-	 * any other thread executing this function. It'll be reexecuted just
-	 * after mod_timer() is called and than reenabling the timer for the
-	 * next interruption. */
-	if (!list_empty(&dog_list)) {
-		/* Any update (insertion/deletion) must be controlled in such a
-		 * way that just one thread traverses the list at a time. And
-		 * considering the control of IRQ vs process context lock
-		 * sharing issue was handled in reader's code,
-		 * spin_lock()/spin_unlock() calls can be made here. */
-		spin_lock(&list_update_lock);
-		entry = list_first_entry(&dog_list, struct dog, list);
+	for (; cur->shard < DOG_NR_SHARDS; cur->shard++, cur->resume = false) {
+		dog_for_each_entry(entry, &dog_store[cur->shard].list) {
+			/* Ids wrap around, but never by more than half their
+			 * range between the head and tail of a shard */
+			if (!cur->resume || (s32)(entry->id - cur->last_id) > 0)
+				return entry;
+		}
+	}
+
+	return NULL;
+}
+
+static void *dog_seq_start(struct seq_file *m, loff_t *pos)
+{
+	struct dog_seq_cursor *cur = m->private;
+
+	cur->read_idx = dog_read_lock();
+	if (!*pos) {
+		cur->shard = 0;
+		cur->resume = false;
+	}
+	return dog_seq_find(cur);
+}
+
+static void *dog_seq_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	struct dog_seq_cursor *cur = m->private;
+	struct dog *entry = v;
+	struct dog *next;
+
+	/* 'entry' was shown, move the cursor past it */
+	cur->last_id = entry->id;
+	cur->resume = true;
+	(*pos)++;
+
+	/* Still in the same critical section, the next entry can be followed
+	 * directly, even if 'entry' was removed in the meantime */
+	next = list_next_or_null_rcu(&dog_store[cur->shard].list, &entry->list,
+				     struct dog, list);
+	if (next)
+		return next;
+
+	cur->shard++;
+	cur->resume = false;
+	return dog_seq_find(cur);
+}
+
+static void dog_seq_stop(struct seq_file *m, void *v)
+{
+	struct dog_seq_cursor *cur = m->private;
+
+	dog_read_unlock(cur->read_idx);
+}
+
+static int dog_seq_show(struct seq_file *m, void *v)
+{
+	struct dog *entry = v;
+
+	seq_printf(m, "%s %d %s\n", entry->breed, entry->age,
+		   entry->training_easy ? "true" : "false");
+	return 0;
+}
+
+static const struct seq_operations dog_seq_ops = {
+	.start = dog_seq_start,
+	.next = dog_seq_next,
+	.stop = dog_seq_stop,
+	.show = dog_seq_show,
+};
+
+static int dog_seq_open(struct inode *inode, struct file *file)
+{
+	struct seq_file *m;
+	int err;
+
+	err = seq_open_private(file, &dog_seq_ops,
+			       sizeof(struct dog_seq_cursor));
+	if (err)
+		return err;
+
+	/* seq_file allocates a single page otherwise. It's released with
+	 * kvfree() by seq_release_private() */
+	m = file->private_data;
+	m->buf = kvmalloc(DOG_SEQ_BUF_SIZE, GFP_KERNEL);
+	if (m->buf)
+		m->size = DOG_SEQ_BUF_SIZE;
+	return 0;
+}
+
+static const struct file_operations dog_seq_fops = {
+	.owner = THIS_MODULE,
+	.open = dog_seq_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = seq_release_private,
+};
+
+/*
+ * Cost of walking the whole store: number of entries, memory they take and
+ * the time a reader takes to go through all of them.
+ * Example: cat /sys/kernel/debug/rcu-linked-list/walk
+ */
+static int dog_walk_show(struct seq_file *m, void *v)
+{
+	struct dog_shard *shard;
+	struct dog *entry;
+	unsigned long n = 0, sum = 0;
+	unsigned int obj_size = kmem_cache_size(dog_cache);
+	u64 start, ns;
+	int idx;
+
+	start = ktime_get_ns();
+	idx = dog_read_lock();
+	for_each_dog_shard(shard) {
+		dog_for_each_entry(entry, &shard->list) {
+			/* Touch the fields every reader uses */
+			sum += READ_ONCE(entry->age) + entry->training_easy +
+			       entry->breed[0];
+			n++;
+		}
+	}
+	dog_read_unlock(idx);
+	ns = ktime_get_ns() - start;
+
+	seq_printf(m, "entries: %lu\n", n);
+	seq_printf(m, "bytes per entry: %u\n", obj_size);
+	seq_printf(m, "memory: %lu KiB\n", n * obj_size / 1024);
+	seq_printf(m, "walk: %llu ns\n", ns);
+	seq_printf(m, "walk per entry: %llu ns\n", n ? div64_u64(ns, n) : 0);
+	/* Not interesting by itself, keeps the compiler from dropping the
+	 * fields access */
+	seq_printf(m, "checksum: %lu\n", sum);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(dog_walk);
+
+/*
+ * Expired entries are removed from the store in batches, all of them sharing a
+ * single grace period: only one call_rcu() is issued for the whole batch,
+ * instead of one per entry.
+ */
+struct dog_reap_batch {
+	struct rcu_head rh;
+	/* Releasing the entries is done in process context, not in the RCU
+	 * callback itself (softirq), since batches might be huge */
+	struct work_struct free_work;
+	/* Chain of unlinked entries, see dog_reap_link() */
+	struct dog *head;
+	unsigned long count;
+};
+
+/* Workqueue running both the expiration passes and batch releases */
+static struct workqueue_struct *dog_wq;
+
+/* Periodic expiration pass */
+static struct delayed_work reap_work;
+
+/* Shard where the next expiration pass starts, so a limited 'reap_batch'
+ * doesn't starve the last shards */
+static unsigned int reap_shard;
+
+/*
+ * Add an entry just unlinked from its shard to the 'reaped' chain. Its
+ * 'list.prev' was poisoned by list_del_rcu() and readers never follow it,
+ * thus it's free to be used as the chain link.
+ */
+static void dog_reap_link(struct dog *entry, struct dog **reaped)
+{
+	entry->list.prev = *reaped ? &(*reaped)->list : NULL;
+	*reaped = entry;
+}
+
+static void dog_free_chain(struct dog *head, unsigned long count)
+{
+	struct dog *entry;
+
+	while (head) {
+		entry = head;
+		head = entry->list.prev ?
+			list_entry(entry->list.prev, struct dog, list) : NULL;
+		kmem_cache_free(dog_cache, entry);
+		cond_resched();
+	}
+	atomic_long_sub(count, &dog_pending);
+}
+
+static void dog_reap_batch_free(struct work_struct *work)
+{
+	struct dog_reap_batch *batch;
+
+	batch = container_of(work, struct dog_reap_batch, free_work);
+	dog_free_chain(batch->head, batch->count);
+	kfree(batch);
+}
+
+/*
+ * RCU callback, called in softirq context once all readers that could still
+ * see the batch entries left their read-side critical sections. It must be
+ * fast, so the actual release is handed over to the workqueue.
+ */
+static void dog_reap_batch_rcu(struct rcu_head *rh)
+{
+	struct dog_reap_batch *batch;
+
+	batch = container_of(rh, struct dog_reap_batch, rh);
+	INIT_WORK(&batch->free_work, dog_reap_batch_free);
+	queue_work(dog_wq, &batch->free_work);
+}
+
+/*
+ * Release a chain of entries, already unlinked from the store, once all
+ * readers that could still see them are gone. Might sleep.
+ */
+void dog_store_reclaim(struct dog *reaped, unsigned long count)
+{
+	struct dog_reap_batch *batch;
+
+	atomic_long_add(count, &dog_pending);
+	batch = READ_ONCE(expedited) ? NULL :
+		kmalloc(sizeof(*batch), GFP_KERNEL);
+	if (batch) {
+		batch->head = reaped;
+		batch->count = count;
+		/* Wait all RCU readers left their read-side critical sections
+		 * and free the whole batch */
+		dog_call_rcu(&batch->rh, dog_reap_batch_rcu);
+	} else {
+		/* Expedited mode, or no memory for the batch descriptor: wait
+		 * the grace period right here instead */
+		dog_synchronize();
+		dog_free_chain(reaped, count);
+	}
+}
+EXPORT_SYMBOL_GPL(dog_store_reclaim);
+
+/*
+ * Unlink all expired entries of a shard, up to 'budget' of them, adding them
+ * to the 'reaped' chain. Returns the number of entries unlinked.
+ */
+static unsigned long dog_shard_expire(struct dog_shard *shard,
+				      unsigned long now, unsigned long budget,
+				      struct dog **reaped)
+{
+	struct dog *entry, *tmp, *live = NULL;
+	unsigned long count = 0;
+	bool sorted = true;
+
+	spin_lock(&shard->lock);
+	list_for_each_entry_safe(entry, tmp, &shard->list, list) {
+		if (count == budget)
+			goto unlock;
+		/* A sorted shard has nothing expired past its first live
+		 * entry. Once ttl_ms went down, entries added after it may
+		 * expire before those added earlier: the whole shard is walked
+		 * then, until what's left is sorted again */
+		if (time_before32((u32)now, entry->expires)) {
+			if (!shard->unsorted)
+				goto unlock;
+			if (live && time_before32(entry->expires, live->expires))
+				sorted = false;
+			live = entry;
+			continue;
+		}
 		/* Delete dog entry following RCU mechanism */
+		trace_dog_delete(entry, shard - dog_store);
 		list_del_rcu(&entry->list);
-		PR_DEBUG("entry deleted: %s,%d,%s\n", entry->breed, entry->age,
-			 entry->training_easy ? "true" : "false");
-		/* Wait all RCU readers left their read-side critical sections
-		 * and free the old entry memory. This function abrevs the use
-		 * of call_rcu(), a dummy callback just for kfree() the element
-		 * and a rcu_barrier() in module's __exit for any additional
-		 * callbacks */
-		kfree_rcu(entry, rh);
-		spin_unlock(&list_update_lock);
+		shard->size--;
+		dog_reap_link(entry, reaped);
+		count++;
+	}
+	if (sorted && live) {
+		shard->unsorted = false;
+		shard->last_expires = live->expires;
+	}
+unlock:
+	spin_unlock(&shard->lock);
+
+	pak_stat_add(dog_stat_deletes, count);
+	pak_stat_add(dog_stat_size, -(long)count);
+	return count;
+}
+
+/*
+ * Expiration pass. It runs from a deferrable work, in process context, thus
+ * it doesn't take any softirq time and doesn't wake up idle CPUs just to
+ * expire entries.
+ */
+static void reap_expired_dogs(struct work_struct *work)
+{
+	struct dog *reaped = NULL;
+	unsigned long budget, count = 0;
+	unsigned long now = jiffies;
+	unsigned int i;
+
+	budget = READ_ONCE(reap_batch) ? : ULONG_MAX;
+	for (i = 0; i < DOG_NR_SHARDS && count < budget; i++) {
+		count += dog_shard_expire(&dog_store[reap_shard], now,
+					  budget - count, &reaped);
+		reap_shard = (reap_shard + 1) & (DOG_NR_SHARDS - 1);
+	}
+
+	if (reaped) {
+		PR_DEBUG("%lu entries expired\n", count);
+		dog_store_reclaim(reaped, count);
+	}
+
+	queue_delayed_work(dog_wq, &reap_work,
+			   msecs_to_jiffies(READ_ONCE(reap_interval_ms)));
+}
+
+/* Release every entry still in the store, used on module removal */
+static void dog_store_destroy(void)
+{
+	struct dog_shard *shard;
+	struct dog *entry, *tmp, *reaped = NULL;
+	unsigned long count = 0;
+
+	for_each_dog_shard(shard) {
+		spin_lock(&shard->lock);
+		list_for_each_entry_safe(entry, tmp, &shard->list, list) {
+			list_del_rcu(&entry->list);
+			dog_reap_link(entry, &reaped);
+			count++;
+		}
+		shard->size = 0;
+		spin_unlock(&shard->lock);
+	}
+
+	atomic_long_add(count, &dog_pending);
+	dog_synchronize();
+	dog_free_chain(reaped, count);
+}
+
+/*
+ * The rest of the store API exported to other modules, see dog-store.h
+ */
+int dog_store_insert(const char *breed, int age, bool training_easy)
+{
+	struct dog *entry;
+
+	entry = dog_alloc(breed, age, training_easy);
+	if (!entry)
+		return -ENOMEM;
+
+	dog_store_add(entry);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(dog_store_insert);
+
+unsigned long dog_store_count_age(unsigned int shard, int age)
+{
+	struct dog *entry;
+	unsigned long n = 0;
+	int idx;
+
+	idx = dog_read_lock();
+	dog_for_each_entry(entry, &dog_store[shard & (DOG_NR_SHARDS - 1)].list) {
+		if (entry->age == age)
+			n++;
 	}
-	/* Reassign timer's expiration time */
-	mod_timer(&removal_timer, jiffies + msecs_to_jiffies(5000));
+	dog_read_unlock(idx);
+
+	return n;
+}
+EXPORT_SYMBOL_GPL(dog_store_count_age);
+
+bool dog_store_unlink_oldest(unsigned int shard_idx, struct dog **reaped)
+{
+	struct dog_shard *shard = &dog_store[shard_idx & (DOG_NR_SHARDS - 1)];
+	struct dog *entry;
+
+	spin_lock(&shard->lock);
+	entry = list_first_entry_or_null(&shard->list, struct dog, list);
+	if (entry) {
+		trace_dog_delete(entry, shard - dog_store);
+		list_del_rcu(&entry->list);
+		shard->size--;
+		dog_reap_link(entry, reaped);
+	}
+	spin_unlock(&shard->lock);
+
+	if (!entry)
+		return false;
+	pak_stat_inc(dog_stat_deletes);
+	pak_stat_dec(dog_stat_size);
+	return true;
 }
+EXPORT_SYMBOL_GPL(dog_store_unlink_oldest);
+
+void dog_store_call_rcu(struct rcu_head *rh, rcu_callback_t func)
+{
+	dog_call_rcu(rh, func);
+}
+EXPORT_SYMBOL_GPL(dog_store_call_rcu);
+
+const char *dog_store_flavor(void)
+{
+	return use_srcu ? "srcu" : "rcu";
+}
+EXPORT_SYMBOL_GPL(dog_store_flavor);
+
+unsigned long dog_store_pending_bytes(void)
+{
+	return atomic_long_read(&dog_pending) * kmem_cache_size(dog_cache);
+}
+EXPORT_SYMBOL_GPL(dog_store_pending_bytes);
 
 static int __init rcu_linked_list_init(void)
 {
+	struct dog_shard *shard;
 	int err;
 
-	spin_lock_init(&list_update_lock);
+	for_each_dog_shard(shard) {
+		spin_lock_init(&shard->lock);
+		INIT_LIST_HEAD(&shard->list);
+		shard->size = 0;
+	}
+
+	/* struct dog is laid out to fit in a single cache line */
+	BUILD_BUG_ON(sizeof(struct dog) > 64);
+	/* Stats aren't essential, the store works without them */
+	dog_stats = pak_stats_create(KBUILD_MODNAME);
+	dog_stat_inserts = pak_stat_create(dog_stats, "inserts",
+					   PAK_STAT_COUNTER);
+	dog_stat_deletes = pak_stat_create(dog_stats, "deletes",
+					   PAK_STAT_COUNTER);
+	dog_stat_size = pak_stat_create(dog_stats, "size", PAK_STAT_GAUGE);
+
+	dog_cache = kmem_cache_create("rcu_dog", sizeof(struct dog), 0,
+				      SLAB_HWCACHE_ALIGN, NULL);
+	if (!dog_cache) {
+		err = -ENOMEM;
+		goto stats_cleanup;
+	}
+
+	dog_wq = alloc_workqueue("rcu-linked-list", 0, 0);
+	if (!dog_wq) {
+		err = -ENOMEM;
+		goto cache_cleanup;
+	}
 
 	/* Create and add a kobject dentry (directory entry) in sysfs */
 	dog_kobj = kobject_create_and_add("rcu-linked-list", NULL);
 	if (!dog_kobj) {
 		 err = -ENOMEM;
-		 goto timer_cleanup;
+		 goto wq_cleanup;
 	}
 	/* Add all attributes (files) inside the dentry previously created */
 	err = sysfs_create_group(dog_kobj, &attr_group);
 	if (err)
 		goto sysfs_cleanup;
 
-	/* Removal timer setup and initialization */
-	setup_timer(&removal_timer, timer_remove_dog, 0);
-	/* Set expiration time for 5 seconds from now */
-	mod_timer(&removal_timer, jiffies + msecs_to_jiffies(5000));
+	/* Binary interface for bulk operations */
+	err = misc_register(&dog_miscdev);
+	if (err)
+		goto sysfs_cleanup;
+
+	/* Full store dump. debugfs being just a debugging aid, its failures
+	 * aren't fatal */
+	dog_debugfs = debugfs_create_dir("rcu-linked-list", NULL);
+	debugfs_create_file("dogs", 0444, dog_debugfs, NULL, &dog_seq_fops);
+	debugfs_create_file("walk", 0444, dog_debugfs, NULL, &dog_walk_fops);
+
+	/* Expiration work setup. Being deferrable, its timer doesn't wake up
+	 * an idle CPU by itself, it's handled on the next non-deferrable
+	 * wake up */
+	INIT_DEFERRABLE_WORK(&reap_work, reap_expired_dogs);
+	queue_delayed_work(dog_wq, &reap_work,
+			   msecs_to_jiffies(reap_interval_ms));
 
 	PR_DEBUG("module loaded\n");
 	return 0;
@@ -234,21 +1260,35 @@ static int __init rcu_linked_list_init(void)
 sysfs_cleanup:
 	/* Decrement dentry reference counter in case of error */
 	kobject_put(dog_kobj);
-timer_cleanup:
-	/* Destroy timer and spins until its handler finishes (case running) */
-	del_timer_sync(&removal_timer);
+wq_cleanup:
+	destroy_workqueue(dog_wq);
+cache_cleanup:
+	kmem_cache_destroy(dog_cache);
+stats_cleanup:
+	pak_stats_destroy(dog_stats);
 	return err;
 }
 
 static void __exit rcu_linked_list_exit(void)
 {
-	/* Destroy timer and spins until its handler finishes (case running) */
-	del_timer_sync(&removal_timer);
-
 	/* Decrement kobject dentry reference counter when exiting the module.
 	 * In this way the kernel can safely free the memory used by the
-	 * kobject. */
+	 * kobject. Removing the sysfs files first guarantees no other updater
+	 * or reader shows up from now on. */
+	debugfs_remove_recursive(dog_debugfs);
+	misc_deregister(&dog_miscdev);
 	kobject_put(dog_kobj);
+
+	/* Stop the expiration work and wait it finishes (case running) */
+	cancel_delayed_work_sync(&reap_work);
+	dog_store_destroy();
+
+	/* Wait for the RCU callbacks of batches still in flight, which queue
+	 * their release works, then drain the workqueue running them */
+	dog_barrier();
+	destroy_workqueue(dog_wq);
+	kmem_cache_destroy(dog_cache);
+	pak_stats_destroy(dog_stats);
 	PR_DEBUG("module unloaded\n");
 }
 
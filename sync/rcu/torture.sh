@@ -0,0 +1,60 @@
+#!/bin/bash
+#
+# Drive the dog-torture harness: run every store variant (rcu, spinlock and
+# rwlock) with a few read/insert/delete mixes and print the results of each
+# run. The rcu store is run under both classic RCU and SRCU, each with normal
+# and expedited grace periods. Must run as root, from this directory, after
+# 'make'.
+#
+# Usage: ./torture.sh [duration_ms] [initial_size]
+
+DURATION_MS=${1:-5000}
+INITIAL_SIZE=${2:-10000}
+MODES="rcu spinlock rwlock"
+# read_pct:insert_pct, deletes take the rest
+MIXES="100:0 90:5 50:25 10:45"
+
+PARAMS=/sys/module/dog_torture/parameters
+DEBUGFS=/sys/kernel/debug/dog-torture
+STORE=/sys/rcu-linked-list
+
+# The flavor is chosen at load time, so both modules are reloaded for each one
+load()
+{
+	rmmod dog-torture 2>/dev/null
+	rmmod rcu-linked-list 2>/dev/null
+	insmod rcu-linked-list.ko srcu=$1 || exit 1
+	insmod dog-torture.ko || exit 1
+
+	# Entries must not expire while the harness runs, only its deletes
+	# count
+	echo 86400000 > $STORE/ttl_ms
+	echo $DURATION_MS > $PARAMS/duration_ms
+	echo $INITIAL_SIZE > $PARAMS/initial_size
+}
+
+run()
+{
+	for mix in $MIXES; do
+		echo $1 > $PARAMS/mode
+		echo ${mix%:*} > $PARAMS/read_pct
+		echo ${mix#*:} > $PARAMS/insert_pct
+		echo 1 > $DEBUGFS/run || exit 1
+		echo "### $1 $2 read_pct=${mix%:*} insert_pct=${mix#*:}"
+		cat $DEBUGFS/results
+		echo
+	done
+}
+
+for srcu in 0 1; do
+	load $srcu
+	for exp in 0 1; do
+		echo $exp > $STORE/expedited
+		run rcu "srcu=$srcu expedited=$exp"
+	done
+done
+
+# Baseline stores don't depend on the flavor
+for mode in $MODES; do
+	[ $mode = rcu ] || run $mode
+done
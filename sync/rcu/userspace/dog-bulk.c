@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2017 Bruno E. O. Meneguele <bmeneguele@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ */
+
+/*
+ * Compare the insert rate of the sysfs text interface, one "breed,age,flag"
+ * string per write(), against the binary bulk interface of /dev/rcu-dog, many
+ * packed records per write(). Build and run it as:
+ *
+ *	$ gcc -O2 -o dog-bulk dog-bulk.c
+ *	# ./dog-bulk [records_per_write] [seconds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "../rcu-dog.h"
+
+#define DOG_SYSFS_FILE "/sys/rcu-linked-list/dog"
+#define DOG_DEV_FILE "/dev/" DOG_DEV_NAME
+
+static double elapsed_since(struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) +
+	       (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* One entry per write(), the way the sysfs interface works */
+static double bench_text(int seconds)
+{
+	struct timespec start;
+	unsigned long inserts = 0;
+	char entry[64];
+	int fd, len;
+
+	fd = open(DOG_SYSFS_FILE, O_WRONLY);
+	if (fd < 0) {
+		perror("failed to open " DOG_SYSFS_FILE);
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (elapsed_since(&start) < seconds) {
+		len = snprintf(entry, sizeof(entry), "text-%lu,%lu,%lu",
+			       inserts, inserts % 240, inserts & 1);
+		if (pwrite(fd, entry, len, 0) != len) {
+			perror("sysfs write failed");
+			break;
+		}
+		inserts++;
+	}
+
+	close(fd);
+	return inserts / elapsed_since(&start);
+}
+
+/* 'nrecs' packed records per write() */
+static double bench_bulk(int seconds, size_t nrecs)
+{
+	struct dog_record *recs;
+	struct timespec start;
+	unsigned long inserts = 0;
+	ssize_t len = nrecs * sizeof(*recs);
+	size_t i;
+	int fd;
+
+	recs = calloc(nrecs, sizeof(*recs));
+	if (!recs) {
+		fprintf(stderr, "not enough memory\n");
+		return -1;
+	}
+
+	fd = open(DOG_DEV_FILE, O_WRONLY);
+	if (fd < 0) {
+		perror("failed to open " DOG_DEV_FILE);
+		free(recs);
+		return -1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while (elapsed_since(&start) < seconds) {
+		for (i = 0; i < nrecs; i++) {
+			snprintf(recs[i].breed, DOG_BREED_NBYTES, "bulk-%lu",
+				 inserts + i);
+			recs[i].age = (inserts + i) % 240;
+			recs[i].training_easy = (inserts + i) & 1;
+		}
+		if (write(fd, recs, len) != len) {
+			perror("bulk write failed");
+			break;
+		}
+		inserts += nrecs;
+	}
+
+	close(fd);
+	free(recs);
+	return inserts / elapsed_since(&start);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t nrecs = 4096;
+	int seconds = 5;
+	double text, bulk;
+
+	if (argc > 1)
+		nrecs = strtoul(argv[1], NULL, 10);
+	if (argc > 2)
+		seconds = atoi(argv[2]);
+	if (!nrecs || seconds <= 0) {
+		fprintf(stderr, "usage: %s [records_per_write] [seconds]\n",
+			argv[0]);
+		return -EINVAL;
+	}
+
+	text = bench_text(seconds);
+	if (text < 0)
+		return -1;
+	bulk = bench_bulk(seconds, nrecs);
+	if (bulk < 0)
+		return -1;
+
+	printf("%-28s %16s\n", "interface", "inserts/sec");
+	printf("%-28s %16.0f\n", "sysfs (1 per write)", text);
+	printf("bulk (%6zu per write)       %16.0f\n", nrecs, bulk);
+	printf("speedup: %.1fx\n", bulk / text);
+
+	return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2017 Bruno E. O. Meneguele <bmeneguele@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License version 2 as published by the
+ * Free Software Foundation.
+ */
+
+/*
+ * Insert throughput benchmark for the rcu-linked-list module.
+ *
+ * Spawns an increasing number of writer threads (1, 2, 4, ... up to the max
+ * given) that keep writing new entries to the sysfs interface during a fixed
+ * amount of time, then prints the number of inserts per second achieved with
+ * each thread count. Build and run it as:
+ *
+ *	$ gcc -O2 -pthread -o dog-writers dog-writers.c
+ *	# ./dog-writers [max_threads] [seconds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+
+#define DOG_SYSFS_FILE "/sys/rcu-linked-list/dog"
+
+/* Written by the main thread only, read by the writers to know when to stop */
+static volatile int running;
+
+struct writer {
+	pthread_t thread;
+	int id;
+	unsigned long inserts;
+	unsigned long errors;
+};
+
+static void *writer_fn(void *arg)
+{
+	struct writer *w = arg;
+	char entry[64];
+	int fd, len;
+
+	fd = open(DOG_SYSFS_FILE, O_WRONLY);
+	if (fd < 0) {
+		perror("failed to open " DOG_SYSFS_FILE);
+		return NULL;
+	}
+
+	while (running) {
+		/* Different breeds for each writer and insert, otherwise all
+		 * entries would be routed to the very same shard */
+		len = snprintf(entry, sizeof(entry), "w%d-%lu,%lu,%lu", w->id,
+			       w->inserts, w->inserts % 240, w->inserts & 1);
+		/* sysfs store callbacks always see the file from offset 0,
+		 * but pwrite() avoids any doubt about it */
+		if (pwrite(fd, entry, len, 0) == len)
+			w->inserts++;
+		else
+			w->errors++;
+	}
+
+	close(fd);
+	return NULL;
+}
+
+static double run_writers(int nthreads, int seconds, unsigned long *errors)
+{
+	struct writer *writers;
+	struct timespec start, end;
+	unsigned long total = 0;
+	double elapsed;
+	int i;
+
+	writers = calloc(nthreads, sizeof(*writers));
+	if (!writers)
+		return -ENOMEM;
+
+	running = 1;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nthreads; i++) {
+		writers[i].id = i;
+		pthread_create(&writers[i].thread, NULL, writer_fn, &writers[i]);
+	}
+
+	sleep(seconds);
+	running = 0;
+
+	*errors = 0;
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(writers[i].thread, NULL);
+		total += writers[i].inserts;
+		*errors += writers[i].errors;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	elapsed = (end.tv_sec - start.tv_sec) +
+		  (end.tv_nsec - start.tv_nsec) / 1e9;
+	free(writers);
+	return total / elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+	int max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int seconds = 5;
+	unsigned long errors;
+	double rate;
+	int n;
+
+	if (argc > 1)
+		max_threads = atoi(argv[1]);
+	if (argc > 2)
+		seconds = atoi(argv[2]);
+	if (max_threads <= 0 || seconds <= 0) {
+		fprintf(stderr, "usage: %s [max_threads] [seconds]\n", argv[0]);
+		return -EINVAL;
+	}
+
+	if (access(DOG_SYSFS_FILE, W_OK)) {
+		perror("can't write to " DOG_SYSFS_FILE);
+		return -errno;
+	}
+
+	printf("%8s %16s %10s\n", "threads", "inserts/sec", "errors");
+	for (n = 1; n <= max_threads; n *= 2) {
+		rate = run_writers(n, seconds, &errors);
+		if (rate < 0) {
+			fprintf(stderr, "not enough memory\n");
+			return -ENOMEM;
+		}
+		printf("%8d %16.0f %10lu\n", n, rate, errors);
+	}
+
+	return 0;
+}